@@ -1,3 +1,4 @@
+#include <ctype.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,6 +9,10 @@
 
 #define MAX_FUNCTIONS 128
 
+// Options of execute, both link the profile runtime into the expression
+static bool profile = false;
+static bool perf_map = false;
+
 void usage_and_error();
 void validate_args(int argc, char **argv);
 
@@ -20,10 +25,12 @@ void copy_file(const char *src, const char *dest);
 void eval_expression(const char *expression);
 char *read_whole_file(const char *file_name);
 char **extract_function_declarations(const char *input, int *out_function_count);
+void function_name(const char *declaration, int *out_start, int *out_length);
+void generate_profile_runtime(const char *file_name);
 void generate_executing_code(const char *file_name, char **function_declarations, int function_count, const char *expression);
 
 void compile(const char *file_name, const char *compiled_file_name);
-void run_lli(const char *user_code_file, const char *generated_file, const char *linked_file_name);
+void run_lli(const char *user_code_file, const char *generated_file, const char *profile_runtime_file, const char *linked_file_name);
 
 int main(int argc, char **argv) {
     validate_args(argc, argv);
@@ -33,6 +40,13 @@ int main(int argc, char **argv) {
 	const char *file_name = argv[2];
 	mode_compile(file_name);
     } else if (strcmp(mode, "execute") == 0) {
+	for (int i = 2; i < argc; i++) {
+	    if (strcmp(argv[i], "--profile") == 0) {
+		profile = true;
+	    } else if (strcmp(argv[i], "--perf-map") == 0) {
+		perf_map = true;
+	    }
+	}
 	mode_execute();
     } else if (strcmp(mode, "clean") == 0) {
 	mode_clean();
@@ -43,7 +57,7 @@ int main(int argc, char **argv) {
 
 void usage_and_error() {
     fprintf(stderr, ("Usage: jit-calc compile file\n"
-		     "       jit-calc execute\n"
+		     "       jit-calc execute [--profile] [--perf-map]\n"
 		     "       jit-calc clean\n"));
     exit(1);
 }
@@ -59,7 +73,13 @@ void validate_args(int argc, char **argv) {
 	if (argc != 3) {
 	    usage_and_error();
 	}
-    } else if (strcmp(mode, "execute") == 0 || strcmp(mode, "clean") == 0) {
+    } else if (strcmp(mode, "execute") == 0) {
+	for (int i = 2; i < argc; i++) {
+	    if (strcmp(argv[i], "--profile") != 0 && strcmp(argv[i], "--perf-map") != 0) {
+		usage_and_error();
+	    }
+	}
+    } else if (strcmp(mode, "clean") == 0) {
 	if (argc != 2) {
 	    usage_and_error();
 	}
@@ -78,6 +98,9 @@ void mode_compile(const char *file_name) {
     copy_file(file_name, "_generated/user_code.c");
 
     compile("_generated/user_code.c", "_generated/user_code.ll");
+
+    generate_profile_runtime("_generated/profile_runtime.c");
+    compile("_generated/profile_runtime.c", "_generated/profile_runtime.ll");
 }
 
 static char stdin_buffer[1024 * 1024];
@@ -114,6 +137,12 @@ void mode_clean() {
     if (unlink("_generated/combined.ll") != 0) {
 	perror("Failed to remove _generated/combined.ll");
     }
+    if (unlink("_generated/profile_runtime.c") != 0) {
+	perror("Failed to remove _generated/profile_runtime.c");
+    }
+    if (unlink("_generated/profile_runtime.ll") != 0) {
+	perror("Failed to remove _generated/profile_runtime.ll");
+    }
 
     if (rmdir("_generated") != 0) {
 	perror("Failed to remove _generated");
@@ -142,7 +171,8 @@ void eval_expression(const char *expression) {
     generate_executing_code("_generated/generated.c", function_declarations, function_count, expression);
 
     compile("_generated/generated.c", "_generated/generated.ll");
-    run_lli("_generated/generated.ll", "_generated/user_code.ll", "_generated/combined.ll");
+    const char *profile_runtime_file = profile || perf_map ? "_generated/profile_runtime.ll" : NULL;
+    run_lli("_generated/generated.ll", "_generated/user_code.ll", profile_runtime_file, "_generated/combined.ll");
 
     for (int i = 0; i < function_count; i++) {
 	free(function_declarations[i]);
@@ -230,6 +260,248 @@ char **extract_function_declarations(const char *input, int *out_function_count)
     return functions;
 }
 
+// "int *make_thing(int a)" gives the span of "make_thing"
+void function_name(const char *declaration, int *out_start, int *out_length) {
+    const char *end = strchr(declaration, '(');
+    while (end > declaration && isspace((unsigned char)end[-1])) {
+	end--;
+    }
+    const char *start = end;
+    while (start > declaration && (isalnum((unsigned char)start[-1]) || start[-1] == '_')) {
+	start--;
+    }
+    *out_start = (int)(start - declaration);
+    *out_length = (int)(end - start);
+}
+
+// Linked into the JIT'd module by execute --profile or --perf-map. Sampling has to happen in the process running
+// the code, which is lli, and only that process knows where lli put each function.
+static const char *profile_runtime_source =
+    "#define _GNU_SOURCE\n"
+    "#include <dlfcn.h>\n"
+    "#include <signal.h>\n"
+    "#include <stdint.h>\n"
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include <string.h>\n"
+    "#include <sys/time.h>\n"
+    "#include <time.h>\n"
+    "#include <ucontext.h>\n"
+    "#include <unistd.h>\n"
+    "\n"
+    "#define MAX_SAMPLES (1 << 16)\n"
+    "#define SAMPLE_INTERVAL_US 1000\n"
+    "// Only start addresses are known, a function ends where the next one starts, or this far after its start\n"
+    "#define MAX_FUNCTION_SIZE (64 * 1024)\n"
+    "\n"
+    "struct Profile_Function {\n"
+    "    const char *name;\n"
+    "    uintptr_t start;\n"
+    "    uintptr_t end;\n"
+    "    int samples;\n"
+    "};\n"
+    "\n"
+    "static struct Profile_Function *functions;\n"
+    "static int function_count;\n"
+    "static int sampling;\n"
+    "static clock_t sampling_start;\n"
+    "\n"
+    "static volatile uintptr_t samples[MAX_SAMPLES];\n"
+    "static volatile sig_atomic_t sample_count;\n"
+    "\n"
+    "void jit_calc_profile_begin(const char **names, void **addresses, int count, int perf_map, int sample);\n"
+    "void jit_calc_profile_end();\n"
+    "\n"
+    "static void on_sample(int signal_number, siginfo_t *info, void *context) {\n"
+    "    (void)signal_number;\n"
+    "    (void)info;\n"
+    "    ucontext_t *ucontext = context;\n"
+    "    uintptr_t pc = 0;\n"
+    "#if defined(__x86_64__)\n"
+    "    pc = (uintptr_t)ucontext->uc_mcontext.gregs[REG_RIP];\n"
+    "#elif defined(__aarch64__)\n"
+    "    pc = (uintptr_t)ucontext->uc_mcontext.pc;\n"
+    "#else\n"
+    "    (void)ucontext;\n"
+    "#endif\n"
+    "    if (sample_count < MAX_SAMPLES) {\n"
+    "        samples[sample_count] = pc;\n"
+    "        sample_count++;\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "static int compare_starts(const void *a, const void *b) {\n"
+    "    const struct Profile_Function *fa = a;\n"
+    "    const struct Profile_Function *fb = b;\n"
+    "    return (fa->start > fb->start) - (fa->start < fb->start);\n"
+    "}\n"
+    "\n"
+    "static int compare_samples(const void *a, const void *b) {\n"
+    "    const struct Profile_Function *fa = a;\n"
+    "    const struct Profile_Function *fb = b;\n"
+    "    return fb->samples - fa->samples;\n"
+    "}\n"
+    "\n"
+    "static void add_function(const char *name, void *address) {\n"
+    "    functions[function_count].name = name;\n"
+    "    functions[function_count].start = (uintptr_t)address;\n"
+    "    functions[function_count].samples = 0;\n"
+    "    function_count++;\n"
+    "}\n"
+    "\n"
+    "void jit_calc_profile_begin(const char **names, void **addresses, int count, int perf_map, int sample) {\n"
+    "    functions = malloc((count + 3) * sizeof(*functions));\n"
+    "    if (functions == NULL) {\n"
+    "        fprintf(stderr, \"ERROR: Failed to alloc profile function table\\n\");\n"
+    "        exit(1);\n"
+    "    }\n"
+    "    for (int i = 0; i < count; i++) {\n"
+    "        add_function(names[i], addresses[i]);\n"
+    "    }\n"
+    "    // The runtime is JIT'd along with the user code, so its samples must not land on a user function\n"
+    "    add_function(\"jit_calc_profile_begin\", (void *)jit_calc_profile_begin);\n"
+    "    add_function(\"jit_calc_profile_end\", (void *)jit_calc_profile_end);\n"
+    "    add_function(\"on_sample\", (void *)on_sample);\n"
+    "\n"
+    "    qsort(functions, function_count, sizeof(*functions), compare_starts);\n"
+    "    for (int i = 0; i < function_count; i++) {\n"
+    "        uintptr_t end = functions[i].start + MAX_FUNCTION_SIZE;\n"
+    "        if (i + 1 < function_count && functions[i + 1].start < end) {\n"
+    "            end = functions[i + 1].start;\n"
+    "        }\n"
+    "        functions[i].end = end;\n"
+    "    }\n"
+    "\n"
+    "    if (perf_map) {\n"
+    "        // perf looks these up by pid, and this code runs inside lli\n"
+    "        char file_name[64];\n"
+    "        snprintf(file_name, sizeof(file_name), \"/tmp/perf-%d.map\", (int)getpid());\n"
+    "        FILE *file = fopen(file_name, \"w\");\n"
+    "        if (file == NULL) {\n"
+    "            perror(\"Failed to open perf map\");\n"
+    "        } else {\n"
+    "            for (int i = 0; i < function_count; i++) {\n"
+    "                fprintf(file, \"%lx %lx %s\\n\", (unsigned long)functions[i].start,\n"
+    "                        (unsigned long)(functions[i].end - functions[i].start), functions[i].name);\n"
+    "            }\n"
+    "            fclose(file);\n"
+    "            fprintf(stderr, \"INFO: Wrote %s\\n\", file_name);\n"
+    "        }\n"
+    "    }\n"
+    "\n"
+    "    if (sample) {\n"
+    "        struct sigaction action;\n"
+    "        memset(&action, 0, sizeof(action));\n"
+    "        action.sa_sigaction = on_sample;\n"
+    "        action.sa_flags = SA_SIGINFO | SA_RESTART;\n"
+    "        sigemptyset(&action.sa_mask);\n"
+    "        if (sigaction(SIGPROF, &action, NULL) != 0) {\n"
+    "            perror(\"Failed to install SIGPROF handler\");\n"
+    "            exit(1);\n"
+    "        }\n"
+    "        struct itimerval timer;\n"
+    "        timer.it_interval.tv_sec = 0;\n"
+    "        timer.it_interval.tv_usec = SAMPLE_INTERVAL_US;\n"
+    "        timer.it_value = timer.it_interval;\n"
+    "        if (setitimer(ITIMER_PROF, &timer, NULL) != 0) {\n"
+    "            perror(\"Failed to start profiling timer\");\n"
+    "            exit(1);\n"
+    "        }\n"
+    "        sampling = 1;\n"
+    "        sampling_start = clock();\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "void jit_calc_profile_end() {\n"
+    "    if (!sampling) {\n"
+    "        free(functions);\n"
+    "        return;\n"
+    "    }\n"
+    "    struct itimerval timer;\n"
+    "    memset(&timer, 0, sizeof(timer));\n"
+    "    setitimer(ITIMER_PROF, &timer, NULL);\n"
+    "    double cpu_ms = 1000.0 * (clock() - sampling_start) / CLOCKS_PER_SEC;\n"
+    "    signal(SIGPROF, SIG_IGN);\n"
+    "\n"
+    "    // Samples outside the user code (libc, lli itself) are grouped by the symbol or object dladdr finds\n"
+    "    struct Profile_Function *others = calloc(sample_count + 1, sizeof(*others));\n"
+    "    if (others == NULL) {\n"
+    "        fprintf(stderr, \"ERROR: Failed to alloc profile results\\n\");\n"
+    "        exit(1);\n"
+    "    }\n"
+    "    int other_count = 0;\n"
+    "\n"
+    "    for (int i = 0; i < sample_count; i++) {\n"
+    "        uintptr_t pc = samples[i];\n"
+    "        struct Profile_Function *found = NULL;\n"
+    "        for (int j = 0; j < function_count; j++) {\n"
+    "            if (pc >= functions[j].start && pc < functions[j].end) {\n"
+    "                found = &functions[j];\n"
+    "                break;\n"
+    "            }\n"
+    "        }\n"
+    "        if (found == NULL) {\n"
+    "            const char *name = \"[unknown]\";\n"
+    "            Dl_info info;\n"
+    "            if (pc != 0 && dladdr((void *)pc, &info) != 0) {\n"
+    "                if (info.dli_sname != NULL) {\n"
+    "                    name = info.dli_sname;\n"
+    "                } else if (info.dli_fname != NULL) {\n"
+    "                    const char *slash = strrchr(info.dli_fname, '/');\n"
+    "                    name = slash != NULL ? slash + 1 : info.dli_fname;\n"
+    "                }\n"
+    "            }\n"
+    "            for (int j = 0; j < other_count; j++) {\n"
+    "                if (strcmp(others[j].name, name) == 0) {\n"
+    "                    found = &others[j];\n"
+    "                    break;\n"
+    "                }\n"
+    "            }\n"
+    "            if (found == NULL) {\n"
+    "                found = &others[other_count];\n"
+    "                found->name = name;\n"
+    "                other_count++;\n"
+    "            }\n"
+    "        }\n"
+    "        found->samples++;\n"
+    "    }\n"
+    "\n"
+    "    // The timer fires at most once per kernel tick, so the real interval is usually longer than asked for\n"
+    "    fprintf(stderr, \"\\nINFO: %d samples over %.1f ms of CPU time\\n\", (int)sample_count, cpu_ms);\n"
+    "    if (sample_count == MAX_SAMPLES) {\n"
+    "        fprintf(stderr, \"INFO: Sample buffer full, later samples were dropped\\n\");\n"
+    "    }\n"
+    "\n"
+    "    qsort(functions, function_count, sizeof(*functions), compare_samples);\n"
+    "    qsort(others, other_count, sizeof(*others), compare_samples);\n"
+    "    int f = 0;\n"
+    "    int o = 0;\n"
+    "    while ((f < function_count && functions[f].samples > 0) || o < other_count) {\n"
+    "        struct Profile_Function *next;\n"
+    "        if (o >= other_count || (f < function_count && functions[f].samples >= others[o].samples)) {\n"
+    "            next = &functions[f];\n"
+    "            f++;\n"
+    "        } else {\n"
+    "            next = &others[o];\n"
+    "            o++;\n"
+    "        }\n"
+    "        fprintf(stderr, \"%8d %6.1f%%  %s\\n\", next->samples, 100.0 * next->samples / sample_count, next->name);\n"
+    "    }\n"
+    "\n"
+    "    free(others);\n"
+    "    free(functions);\n"
+    "}\n";
+
+void generate_profile_runtime(const char *file_name) {
+    FILE *file = fopen(file_name, "w");
+    if (file == NULL) {
+	fprintf(stderr, "ERROR: Failed to open %s for writing.", file_name);
+	exit(1);
+    }
+    fputs(profile_runtime_source, file);
+    fclose(file);
+}
+
 void generate_executing_code(const char *file_name, char **function_declarations, int function_count, const char *expression) {
     /* printf("INFO: Generating executing code...\n"); */
     FILE *file = fopen(file_name, "w");
@@ -242,8 +514,35 @@ void generate_executing_code(const char *file_name, char **function_declarations
     for (int i = 0; i < function_count; i++) {
 	fprintf(file, "%s;\n", function_declarations[i]);
     }
-    fprintf(file, "\nint main() {\n");
-    fprintf(file, "    int result = %s;\n", expression);
+    if (profile || perf_map) {
+	// The expression gets its own function so its samples don't blend into the profiler setup in main
+	fprintf(file, "\nvoid jit_calc_profile_begin(const char **names, void **addresses, int count, int perf_map, int sample);\n");
+	fprintf(file, "void jit_calc_profile_end();\n");
+	fprintf(file, "\nint jit_calc_expression() {\n");
+	fprintf(file, "    return %s;\n", expression);
+	fprintf(file, "}\n");
+	fprintf(file, "\nint main() {\n");
+	fprintf(file, "    const char *names[] = {");
+	for (int i = 0; i < function_count; i++) {
+	    int start, length;
+	    function_name(function_declarations[i], &start, &length);
+	    fprintf(file, "\"%.*s\", ", length, function_declarations[i] + start);
+	}
+	fprintf(file, "\"jit_calc_expression\", \"main\"};\n");
+	fprintf(file, "    void *addresses[] = {");
+	for (int i = 0; i < function_count; i++) {
+	    int start, length;
+	    function_name(function_declarations[i], &start, &length);
+	    fprintf(file, "(void *)%.*s, ", length, function_declarations[i] + start);
+	}
+	fprintf(file, "(void *)jit_calc_expression, (void *)main};\n");
+	fprintf(file, "    jit_calc_profile_begin(names, addresses, %d, %d, %d);\n", function_count + 2, perf_map, profile);
+	fprintf(file, "    int result = jit_calc_expression();\n");
+	fprintf(file, "    jit_calc_profile_end();\n");
+    } else {
+	fprintf(file, "\nint main() {\n");
+	fprintf(file, "    int result = %s;\n", expression);
+    }
     fprintf(file, "    printf(\"%%d\", result);\n");
     fprintf(file, "    return 0;\n");
     fprintf(file, "}\n");
@@ -263,15 +562,17 @@ void compile(const char *file_name, const char *compiled_file_name) {
     }
 }
 
-void run_lli(const char *user_code_file, const char *generated_file, const char *linked_file_name) {
+void run_lli(const char *user_code_file, const char *generated_file, const char *profile_runtime_file, const char *linked_file_name) {
     char command[256];
-    snprintf(command, sizeof(command), "llvm-link -S %s %s -o %s", user_code_file, generated_file, linked_file_name);
+    snprintf(command, sizeof(command), "llvm-link -S %s %s %s -o %s", user_code_file, generated_file,
+	     profile_runtime_file != NULL ? profile_runtime_file : "", linked_file_name);
     int ret = system(command);
     if (ret != 0) {
 	fprintf(stderr, "\"%s\" failed with error code %d\n", command, ret);
 	exit(1);
     }
-    snprintf(command, sizeof(command), "lli %s", linked_file_name);
+    // Lazy ORC hands out stubs when the runtime takes function addresses, MCJIT gives the addresses the code runs at
+    snprintf(command, sizeof(command), "lli %s%s", profile_runtime_file != NULL ? "-jit-kind=mcjit " : "", linked_file_name);
     ret = system(command);
     if (ret != 0) {
 	fprintf(stderr, "\"%s\" failed with error code %d\n", command, ret);
@@ -0,0 +1,85 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+struct Arena_Block {
+    Arena_Block *prev;
+    size_t cap, used;
+    _Alignas(ARENA_ALIGN) uint8_t data[];
+};
+
+Arena g_frame_arena = { .name = "frame" };
+Arena g_general_arena = { .name = "general" };
+
+static void push_block(Arena *arena, size_t min_cap) {
+    size_t cap = ARENA_MIN_BLOCK;
+    while (cap < min_cap) cap *= 2;
+    Arena_Block *block = xmalloc(sizeof(Arena_Block) + cap);
+    block->prev = arena->block;
+    block->cap = cap;
+    block->used = 0;
+    arena->block = block;
+    arena->heap_blocks++;
+}
+
+void arena_reserve(Arena *arena, size_t bytes) {
+    if (arena->block && arena->block->cap - arena->block->used >= bytes) return;
+    push_block(arena, bytes);
+}
+
+void *arena_alloc(Arena *arena, size_t bytes) {
+    size_t size = (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    Arena_Block *block = arena->block;
+    if (!block || block->cap - block->used < size) {
+        // NOTE: The tail of the full block is wasted, it is gone at the next reset anyway
+        push_block(arena, size);
+        block = arena->block;
+    }
+    void *result = block->data + block->used;
+    block->used += size;
+    arena->used += size;
+    if (arena->used > arena->high_water) arena->high_water = arena->used;
+    return result;
+}
+
+void *arena_alloc_zero(Arena *arena, size_t bytes) {
+    void *result = arena_alloc(arena, bytes);
+    memset(result, 0, bytes);
+    return result;
+}
+
+void arena_reset(Arena *arena) {
+    Arena_Block *block = arena->block;
+    if (block && block->prev) {
+        // Outgrew its block since the last reset: swap the chain for one block that fits the high-water mark
+        while (block) {
+            Arena_Block *prev = block->prev;
+            free(block);
+            block = prev;
+        }
+        arena->block = NULL;
+        push_block(arena, arena->high_water);
+    } else if (block) {
+        block->used = 0;
+    }
+    arena->used = 0;
+}
+
+void arena_free(Arena *arena) {
+    Arena_Block *block = arena->block;
+    while (block) {
+        Arena_Block *prev = block->prev;
+        free(block);
+        block = prev;
+    }
+    arena->block = NULL;
+    arena->used = 0;
+}
+
+void arena_log_stats(const Arena *arena) {
+    size_t reserved = 0;
+    for (const Arena_Block *block = arena->block; block; block = block->prev) reserved += block->cap;
+    trace_log("Arena %s: %.1f KB high water, %.1f KB reserved, %llu heap blocks",
+              arena->name, arena->high_water / 1024.0, reserved / 1024.0, (unsigned long long)arena->heap_blocks);
+}
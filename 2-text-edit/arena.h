@@ -0,0 +1,34 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "common.h"
+
+enum { ARENA_ALIGN = 16, ARENA_MIN_BLOCK = 64 * 1024 };
+
+typedef struct Arena_Block Arena_Block;
+
+// Bump allocator. Nothing is freed on its own, the whole arena is reset at once.
+// An arena that runs out chains another heap block. A reset folds the chain into one block
+// big enough for the high-water mark, so an arena that is reset every frame stops touching
+// the heap once it has seen its largest frame. Zero initialized is a valid empty arena.
+typedef struct Arena {
+    const char *name;
+    Arena_Block *block; // Newest block, older ones are linked behind it
+    size_t used;        // Across all blocks
+    size_t high_water;
+    uint64_t heap_blocks; // Blocks taken from the heap so far
+} Arena;
+
+// Render thread only. Reset at the top of every main loop iteration, so nothing in it outlives the frame.
+extern Arena g_frame_arena;
+// Objects that live as long as the process: fonts, the profiler history. Main thread only, never reset.
+extern Arena g_general_arena;
+
+void arena_reserve(Arena *arena, size_t bytes);
+void *arena_alloc(Arena *arena, size_t bytes);
+void *arena_alloc_zero(Arena *arena, size_t bytes);
+void arena_reset(Arena *arena);
+void arena_free(Arena *arena);
+void arena_log_stats(const Arena *arena);
+
+#endif
@@ -0,0 +1,272 @@
+// Headless frame-time benchmark. Renders scripted scenes through the editor's own draw path,
+// either into an offscreen framebuffer on an EGL context that needs no display (Mesa llvmpipe in CI),
+// or on the null backend, which only counts draw calls and uploaded bytes.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "glad/glad.h"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "arena.h"
+#include "common.h"
+#include "editor.h"
+#include "profiler.h"
+#include "renderer.h"
+#include "view.h"
+
+enum { BENCH_WIDTH = 800, BENCH_HEIGHT = 600 };
+enum { BENCH_DEFAULT_FRAMES = 300, BENCH_WARMUP_FRAMES = 5 };
+enum { SCROLL_LINES_PER_FRAME = 3 };
+
+typedef enum Scene_Action {
+    SCENE_STATIC, // Nothing changes, only the cursor blinks
+    SCENE_SCROLL, // Cursor jumps a few lines down every frame, dragging the view with it
+    SCENE_TYPING  // One character per frame in the middle of the file
+} Scene_Action;
+
+typedef struct Bench_Scene {
+    const char *name;
+    size_t file_size;
+    Scene_Action action;
+} Bench_Scene;
+
+typedef struct Frame_Sample {
+    double ms;
+    Render_Stats stats;
+} Frame_Sample;
+
+static const Bench_Scene g_scenes[] = {
+    { "1kb_static",   1024,            SCENE_STATIC },
+    { "1kb_typing",   1024,            SCENE_TYPING },
+    { "1mb_scroll",   ONE_MB,          SCENE_SCROLL },
+    { "1mb_typing",   ONE_MB,          SCENE_TYPING },
+    { "100mb_scroll", 100 * ONE_MB,    SCENE_SCROLL },
+    { "100mb_typing", 100 * ONE_MB,    SCENE_TYPING },
+};
+
+static Text_Edit_State g_text_edit_state;
+static Render_Snapshot g_snapshot; // NOTE: Built and drawn on one thread, the bench doesn't measure the editor thread handoff
+static Layout_Cache g_layout;
+static EGLDisplay g_egl_display = EGL_NO_DISPLAY;
+static EGLContext g_egl_context = EGL_NO_CONTEXT;
+
+void create_headless_gl_context(int width, int height);
+void destroy_headless_gl_context();
+void run_scene(const Bench_Scene *scene, Editor_View *view, int frame_count, Render_Backend backend);
+
+int main(int argc, char **argv) {
+    Render_Backend backend = RENDER_BACKEND_GL;
+    int frame_count = BENCH_DEFAULT_FRAMES;
+    const char *scene_filter = NULL;
+    bool sdf_font = false;
+    bool cell_grid = false;
+    bool wrap = true;
+    bool layers = true;
+    const char *profile_file_name = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            if (strcmp(name, "gl") == 0)        backend = RENDER_BACKEND_GL;
+            else if (strcmp(name, "null") == 0) backend = RENDER_BACKEND_NULL;
+            else exit_with_error("Unknown backend %s, expected gl or null", name);
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frame_count = atoi(argv[++i]);
+            if (frame_count <= 0) exit_with_error("--frames needs a positive count");
+        } else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+            scene_filter = argv[++i];
+        } else if (strcmp(argv[i], "--sdf") == 0) {
+            sdf_font = true;
+        } else if (strcmp(argv[i], "--cell-grid") == 0) {
+            cell_grid = true;
+        } else if (strcmp(argv[i], "--no-wrap") == 0) {
+            wrap = false;
+        } else if (strcmp(argv[i], "--no-layers") == 0) {
+            layers = false;
+        } else if (strcmp(argv[i], "--profile-json") == 0 && i + 1 < argc) {
+            profile_file_name = argv[++i];
+        } else {
+            exit_with_error("Usage: %s [--backend gl|null] [--frames N] [--scene NAME] [--sdf] [--cell-grid] [--no-wrap] [--no-layers] [--profile-json FILE]", argv[0]);
+        }
+    }
+
+    if (backend == RENDER_BACKEND_GL) {
+        create_headless_gl_context(BENCH_WIDTH, BENCH_HEIGHT);
+    }
+
+    renderer_init(backend, BENCH_WIDTH, BENCH_HEIGHT);
+    profiler_init(backend == RENDER_BACKEND_GL);
+    Font font = load_font("res/ubuntu_mono.ttf", 32.0f, 512, sdf_font);
+    Editor_View view;
+    view_init(&view, &font, BENCH_WIDTH, BENCH_HEIGHT, cell_grid, layers);
+    view.background = load_texture("res/claesz.png");
+    layout_init(&g_layout, &font, wrap);
+    layout_resize(&g_layout, BENCH_WIDTH, BENCH_HEIGHT);
+    editor_init(&g_text_edit_state, UNDO_DEFAULT_MEMORY_LIMIT);
+
+    printf("%-14s %7s %9s %8s %8s %8s %8s %10s %12s %9s %9s\n",
+           "scene", "frames", "load ms", "p50 ms", "p90 ms", "p99 ms", "max ms", "draws/f", "upload KB/f",
+           "allocs/f", "arena KB");
+
+    for (size_t i = 0; i < sizeof(g_scenes) / sizeof(g_scenes[0]); i++) {
+        if (scene_filter && strcmp(scene_filter, g_scenes[i].name) != 0) continue;
+        run_scene(&g_scenes[i], &view, frame_count, backend);
+    }
+
+    // NOTE: The ring only holds the most recent frames, so this is the tail of the last scene
+    if (profile_file_name && !profiler_write_chrome_trace(profile_file_name)) {
+        exit_with_error("Failed to write profile trace to %s", profile_file_name);
+    }
+
+    view_free(&view);
+    if (backend == RENDER_BACKEND_GL) {
+        destroy_headless_gl_context();
+    }
+
+    return 0;
+}
+
+// Surfaceless EGL context rendering into a framebuffer object, so no window system is involved
+void create_headless_gl_context(int width, int height) {
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (get_platform_display) {
+        g_egl_display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+    if (g_egl_display == EGL_NO_DISPLAY) {
+        g_egl_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    EGLint major, minor;
+    if (g_egl_display == EGL_NO_DISPLAY || !eglInitialize(g_egl_display, &major, &minor)) {
+        exit_with_error("Failed to initialize EGL (0x%04X). Try --backend null.", eglGetError());
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        exit_with_error("EGL has no desktop OpenGL support (0x%04X)", eglGetError());
+    }
+
+    // NOTE: The surfaceless platform exposes no configs, the context is then created without one
+    EGLint config_attribs[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    EGLint config_count = 0;
+    if (!eglChooseConfig(g_egl_display, config_attribs, &config, 1, &config_count) || config_count == 0) {
+        config = EGL_NO_CONFIG_KHR;
+    }
+
+    EGLint context_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    g_egl_context = eglCreateContext(g_egl_display, config, EGL_NO_CONTEXT, context_attribs);
+    if (g_egl_context == EGL_NO_CONTEXT) {
+        exit_with_error("Failed to create a GL 4.3 core context (0x%04X)", eglGetError());
+    }
+    if (!eglMakeCurrent(g_egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, g_egl_context)) {
+        exit_with_error("Failed to make the surfaceless context current (0x%04X)", eglGetError());
+    }
+
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+        exit_with_error("Failed to load GL function pointers");
+    }
+
+    trace_log("EGL %d.%d, %s on %s", major, minor, glGetString(GL_VERSION), glGetString(GL_RENDERER));
+
+    uint32_t framebuffer, color_buffer;
+    glGenFramebuffers(1, &framebuffer);
+    glGenRenderbuffers(1, &color_buffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, color_buffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_buffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        exit_with_error("Offscreen framebuffer is incomplete");
+    }
+}
+
+void destroy_headless_gl_context() {
+    eglMakeCurrent(g_egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(g_egl_display, g_egl_context);
+    eglTerminate(g_egl_display);
+}
+
+static void scene_step(const Bench_Scene *scene, int frame) {
+    static const char typed[] = "value = compute(value, 42); // typed\n";
+
+    if (scene->action == SCENE_SCROLL) {
+        Syntax_State *syntax = &g_text_edit_state.syntax;
+        size_t line = (size_t)frame * SCROLL_LINES_PER_FRAME;
+        if (line >= syntax->line_count) line = syntax->line_count - 1;
+        g_text_edit_state.text_buffer_cursor = syntax_line_start(syntax, line);
+    } else if (scene->action == SCENE_TYPING) {
+        handle_input_char(&g_text_edit_state, (uint8_t)typed[frame % (sizeof(typed) - 1)]);
+    }
+}
+
+// Frame time covers the scripted input, the editor's per-frame work and all GL work up to glFinish,
+// which on a software rasterizer is where the pixels actually get drawn
+void run_scene(const Bench_Scene *scene, Editor_View *view, int frame_count, Render_Backend backend) {
+    double load_begin_ms = get_time_ms();
+    char *text = generate_c_text(scene->file_size);
+    editor_set_text(&g_text_edit_state, text, scene->file_size);
+    free(text);
+    syntax_update(&g_text_edit_state.syntax, g_text_edit_state.text_buffer, g_text_edit_state.used_size);
+    double load_ms = get_time_ms() - load_begin_ms;
+
+    if (scene->action == SCENE_TYPING) {
+        Syntax_State *syntax = &g_text_edit_state.syntax;
+        g_text_edit_state.text_buffer_cursor = syntax_line_start(syntax, syntax->line_count / 2);
+    }
+
+    Frame_Sample *samples = xmalloc(frame_count * sizeof(Frame_Sample));
+    for (int frame = -BENCH_WARMUP_FRAMES; frame < frame_count; frame++) {
+        renderer_take_stats();
+        double begin_ms = get_time_ms();
+        arena_reset(&g_frame_arena);
+        profiler_begin_frame();
+
+        profile_begin(PROFILE_ZONE_INPUT);
+        scene_step(scene, frame < 0 ? 0 : frame);
+        profile_end(PROFILE_ZONE_INPUT);
+        profile_begin(PROFILE_ZONE_SNAPSHOT);
+        view_build_snapshot(&g_snapshot, &g_text_edit_state, &g_layout);
+        profile_end(PROFILE_ZONE_SNAPSHOT);
+        draw_editor_frame(view, &g_snapshot);
+        if (backend == RENDER_BACKEND_GL) glFinish();
+
+        double ms = get_time_ms() - begin_ms;
+        Render_Stats stats = renderer_take_stats();
+        profiler_end_frame(stats);
+        if (frame >= 0) {
+            samples[frame].ms = ms;
+            samples[frame].stats = stats;
+        }
+    }
+
+    double *sorted = xmalloc(frame_count * sizeof(double));
+    uint64_t total_draw_calls = 0, total_upload_bytes = 0, total_heap_allocations = 0, max_arena_bytes = 0;
+    for (int i = 0; i < frame_count; i++) {
+        sorted[i] = samples[i].ms;
+        total_draw_calls += samples[i].stats.draw_calls;
+        total_upload_bytes += samples[i].stats.upload_bytes;
+        total_heap_allocations += samples[i].stats.heap_allocations;
+        if (samples[i].stats.frame_arena_bytes > max_arena_bytes) max_arena_bytes = samples[i].stats.frame_arena_bytes;
+    }
+    sort_doubles(sorted, frame_count);
+
+    // NOTE: Allocations include the scripted edits, which run on this thread here but on the editor thread in the app
+    printf("%-14s %7d %9.1f %8.3f %8.3f %8.3f %8.3f %10.1f %12.2f %9.2f %9.1f\n",
+           scene->name, frame_count, load_ms,
+           percentile(sorted, frame_count, 0.5), percentile(sorted, frame_count, 0.9),
+           percentile(sorted, frame_count, 0.99), sorted[frame_count - 1],
+           (double)total_draw_calls / frame_count, total_upload_bytes / 1024.0 / frame_count,
+           (double)total_heap_allocations / frame_count, max_arena_bytes / 1024.0);
+    fflush(stdout);
+
+    free(sorted);
+    free(samples);
+}
@@ -0,0 +1,210 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+
+double g_startup_begin_ms;
+static _Thread_local uint64_t g_heap_allocations;
+
+// NOTE: Anything that needs tearing down on a fatal error (e.g. GLFW) registers it with atexit
+void exit_with_error(const char *msg, ...) {
+    fprintf(stderr, "FATAL: ");
+    va_list ap;
+    va_start(ap, msg);
+    vfprintf(stderr, msg, ap);
+    va_end(ap);
+    fprintf(stderr, "\n");
+
+    exit(1);
+}
+
+void trace_log(const char *msg, ...) {
+    printf("INFO: ");
+    va_list ap;
+    va_start(ap, msg);
+    vprintf(msg, ap);
+    va_end(ap);
+    printf("\n");
+}
+
+void *xmalloc(size_t bytes) {
+    g_heap_allocations++;
+    void *d = malloc(bytes);
+    if (d == NULL) exit_with_error("Failed to malloc");
+    return d;
+}
+void *xcalloc(size_t bytes) {
+    g_heap_allocations++;
+    void *d = calloc(1, bytes);
+    if (d == NULL) exit_with_error("Failed to calloc");
+    return d;
+}
+void *xrealloc(void *ptr, size_t bytes) {
+    g_heap_allocations++;
+    void *d = realloc(ptr, bytes);
+    if (d == NULL) exit_with_error("Failed to realloc");
+    return d;
+}
+
+uint64_t heap_allocation_count() {
+    return g_heap_allocations;
+}
+
+double get_time_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+uint64_t get_time_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void trace_startup(const char *phase) {
+    trace_log("Startup: %-28s %8.2f ms", phase, get_time_ms() - g_startup_begin_ms);
+}
+
+// FNV-1a
+uint64_t hash_bytes(const void *bytes, size_t size) {
+    const uint8_t *b = bytes;
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= b[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+bool make_private_temp_dir(const char *prefix, char *out, size_t out_size) {
+    int len = snprintf(out, out_size, "/tmp/%s-XXXXXX", prefix);
+    if (len < 0 || (size_t)len >= out_size) return false;
+    // NOTE: mkdtemp creates it with mode 0700
+    return mkdtemp(out) != NULL;
+}
+
+size_t utf8_encode(uint32_t codepoint, char *out) {
+    if (codepoint < 0x80) {
+        out[0] = (char)codepoint;
+        return 1;
+    } else if (codepoint < 0x800) {
+        out[0] = (char)(0xC0 | (codepoint >> 6));
+        out[1] = (char)(0x80 | (codepoint & 0x3F));
+        return 2;
+    } else if (codepoint < 0x10000) {
+        if (codepoint >= 0xD800 && codepoint <= 0xDFFF) return 0; // Surrogates are not valid scalar values
+        out[0] = (char)(0xE0 | (codepoint >> 12));
+        out[1] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (codepoint & 0x3F));
+        return 3;
+    } else if (codepoint < 0x110000) {
+        out[0] = (char)(0xF0 | (codepoint >> 18));
+        out[1] = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+        out[2] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        out[3] = (char)(0x80 | (codepoint & 0x3F));
+        return 4;
+    }
+    return 0;
+}
+
+// NOTE: Relies on str being null terminated -- the terminator fails the continuation byte check,
+//       so a truncated sequence at the end never reads past it.
+//       Malformed sequences decode as U+FFFD and consume a single byte.
+size_t utf8_decode(const char *str, uint32_t *out_codepoint) {
+    const uint8_t *s = (const uint8_t *)str;
+    uint32_t cp;
+    size_t len;
+
+    if (s[0] < 0x80) {
+        *out_codepoint = s[0];
+        return 1;
+    } else if ((s[0] & 0xE0) == 0xC0) {
+        cp = s[0] & 0x1F; len = 2;
+    } else if ((s[0] & 0xF0) == 0xE0) {
+        cp = s[0] & 0x0F; len = 3;
+    } else if ((s[0] & 0xF8) == 0xF0) {
+        cp = s[0] & 0x07; len = 4;
+    } else {
+        *out_codepoint = UTF8_REPLACEMENT_CHAR;
+        return 1;
+    }
+
+    for (size_t i = 1; i < len; i++) {
+        if ((s[i] & 0xC0) != 0x80) {
+            *out_codepoint = UTF8_REPLACEMENT_CHAR;
+            return 1;
+        }
+        cp = (cp << 6) | (s[i] & 0x3F);
+    }
+
+    static const uint32_t min_for_len[] = {0, 0, 0x80, 0x800, 0x10000};
+    if (cp < min_for_len[len] || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+        *out_codepoint = UTF8_REPLACEMENT_CHAR;
+        return 1;
+    }
+
+    *out_codepoint = cp;
+    return len;
+}
+
+size_t utf8_prev(const char *str, size_t pos) {
+    if (pos == 0) return 0;
+    size_t start = pos - 1;
+    // Step back over at most 3 continuation bytes
+    while (start > 0 && pos - start < 4 && ((uint8_t)str[start] & 0xC0) == 0x80) start--;
+
+    // Only accept the lead byte if it decodes to exactly the bytes we stepped over
+    uint32_t cp;
+    if (utf8_decode(str + start, &cp) != pos - start) return pos - 1;
+    return start;
+}
+
+// Deterministic C-looking text, so every syntax color class and some long lines show up
+char *generate_c_text(size_t size) {
+    static const char *templates[] = {
+        "#include <stdio.h>\n",
+        "// Line comment number %zu with a few words in it\n",
+        "static int counter_%zu = %zu;\n",
+        "int function_%zu(int x, float y) {\n",
+        "    if (x > 0 && y < 1.5e3f) { return x * %zu; }\n",
+        "    const char *s = \"string literal %zu\\n\";\n",
+        "    /* block comment\n       spanning lines %zu */\n",
+        "\tuint64_t mask = 0x%zxull; // Tab indented\n",
+        "    for (size_t i = 0; i < %zu; i++) { total += values[i] * weights[i] + bias; }\n",
+        "}\n\n",
+    };
+    size_t template_count = sizeof(templates) / sizeof(templates[0]);
+
+    char *text = xmalloc(size + 1);
+    size_t used = 0;
+    for (size_t line = 0; used < size; line++) {
+        char buffer[256];
+        int len = snprintf(buffer, sizeof(buffer), templates[line % template_count], line, line);
+        size_t copy_len = (size_t)len < size - used ? (size_t)len : size - used;
+        memcpy(text + used, buffer, copy_len);
+        used += copy_len;
+    }
+    text[size] = '\0';
+    return text;
+}
+
+double percentile(const double *sorted, size_t count, double p) {
+    size_t index = (size_t)ceil(p * count);
+    if (index > 0) index--;
+    if (index >= count) index = count - 1;
+    return sorted[index];
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+void sort_doubles(double *values, size_t count) {
+    qsort(values, count, sizeof(double), compare_doubles);
+}
@@ -0,0 +1,42 @@
+#ifndef COMMON_H
+#define COMMON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum { ONE_MB = 1024 * 1024 };
+enum { UTF8_REPLACEMENT_CHAR = 0xFFFD };
+
+// Byte range [start, end) into the text buffer
+typedef struct Text_Range {
+    size_t start, end;
+} Text_Range;
+
+extern double g_startup_begin_ms;
+
+void exit_with_error(const char *msg, ...);
+void trace_log(const char *msg, ...);
+void *xmalloc(size_t bytes);
+void *xcalloc(size_t bytes);
+void *xrealloc(void *ptr, size_t bytes);
+// xmalloc, xcalloc and xrealloc calls made by the calling thread so far
+uint64_t heap_allocation_count();
+double get_time_ms();
+uint64_t get_time_ns();
+void trace_startup(const char *phase);
+uint64_t hash_bytes(const void *bytes, size_t size);
+// A new /tmp/prefix-XXXXXX only this user can enter. Files written there for the compiler and loaded back
+// with dlopen can't be swapped by someone else, unlike predictable names directly in /tmp.
+bool make_private_temp_dir(const char *prefix, char *out, size_t out_size);
+
+// Benchmark helpers
+char *generate_c_text(size_t size);
+void sort_doubles(double *values, size_t count);
+double percentile(const double *sorted, size_t count, double p);
+
+size_t utf8_encode(uint32_t codepoint, char *out);
+size_t utf8_decode(const char *str, uint32_t *out_codepoint);
+size_t utf8_prev(const char *str, size_t pos);
+
+#endif
@@ -0,0 +1,1424 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "editor.h"
+
+enum { SAVE_RESULT_CAPACITY = 8, AUTOSAVE_INTERVAL_MS = 30000 };
+enum { TEXT_INITIAL_CAPACITY = 64 * 1024 };
+
+typedef enum Save_Kind {
+    SAVE_KIND_EXPLICIT, // To file_name, on Ctrl+S
+    SAVE_KIND_AUTOSAVE, // To file_name.autosave, periodically
+    SAVE_KIND_COUNT
+} Save_Kind;
+
+typedef struct Save_Job {
+    const char *file_name;
+    char *bytes; // Snapshot of the buffer, owned by the job
+    size_t size;
+    uint64_t edit_version;
+} Save_Job;
+
+typedef struct Save_Result {
+    Save_Kind kind;
+    bool ok;
+    uint64_t edit_version;
+    char error[256];
+} Save_Result;
+
+// Writes happen on a background thread, so a slow disk never stalls frames.
+// At most one job per kind is pending, a newer snapshot replaces an unstarted one.
+typedef struct Save_Worker {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool quit;
+
+    Save_Job pending[SAVE_KIND_COUNT];
+    bool has_pending[SAVE_KIND_COUNT];
+
+    Save_Result results[SAVE_RESULT_CAPACITY];
+    size_t result_count;
+
+    char autosave_file_name[4096];
+} Save_Worker;
+
+static Save_Worker g_save_worker;
+
+// A save being copied out of the buffer, a chunk per editor thread iteration, so saving a large buffer
+// doesn't hold up input for one long memcpy. Edits behind the copied part are copied again, so the copy
+// ends up matching the buffer as it is when the last chunk is taken. Editor thread only.
+enum { SAVE_SNAPSHOT_CHUNK = 4 * ONE_MB };
+
+typedef struct Save_Snapshot {
+    bool active;
+    char *bytes;
+    size_t capacity;
+    size_t copied; // [0, copied) matches text_buffer
+} Save_Snapshot;
+
+static Save_Snapshot g_save_snapshots[SAVE_KIND_COUNT];
+
+static void queue_save(Text_Edit_State *state, Save_Kind kind);
+static void save_snapshots_on_edit(Text_Edit_State *state, size_t pos, size_t removed, size_t inserted);
+
+// Grows the buffer so it holds at least `size` bytes, counting the null terminator
+static void text_reserve(Text_Edit_State *state, size_t size) {
+    if (size <= state->text_capacity) return;
+
+    size_t capacity = state->text_capacity ? state->text_capacity : TEXT_INITIAL_CAPACITY;
+    while (capacity < size) capacity *= 2;
+    state->text_buffer = xrealloc(state->text_buffer, capacity);
+    state->text_capacity = capacity;
+}
+
+void editor_init(Text_Edit_State *state, size_t undo_memory_limit) {
+    text_reserve(state, 1);
+    state->text_buffer[0] = '\0';
+    state->used_size = 0;
+    state->zoom = 1.0f;
+    undo_init(&state->undo, undo_memory_limit);
+    syntax_reset(&state->syntax, 0);
+}
+
+// Replaces the whole buffer. History does not survive this, it would refer to the old text.
+void editor_free(Text_Edit_State *state) {
+    undo_free(&state->undo);
+    free(state->syntax.colors);
+    free(state->syntax.lines);
+    free(state->text_buffer);
+    memset(state, 0, sizeof(*state));
+}
+
+void editor_set_text(Text_Edit_State *state, const char *bytes, size_t size) {
+    text_reserve(state, size + 1);
+    memmove(state->text_buffer, bytes, size);
+    state->text_buffer[size] = '\0';
+    state->used_size = size;
+    state->text_buffer_cursor = 0;
+    state->scroll_line = 0;
+    state->scroll_row = 0;
+    state->has_mark = false;
+    state->edit_version++;
+    save_snapshots_on_edit(state, 0, SIZE_MAX, size);
+
+    size_t memory_limit = state->undo.memory_limit;
+    undo_free(&state->undo);
+    undo_init(&state->undo, memory_limit);
+    syntax_reset(&state->syntax, size);
+}
+
+// Raw buffer edits. Everything that changes text_buffer goes through these two.
+void buffer_insert(Text_Edit_State *state, size_t pos, const char *bytes, size_t len) {
+    text_reserve(state, state->used_size + len + 1);
+
+    // NOTE: Include the null terminator at used_size in the move
+    memmove(state->text_buffer + pos + len,
+            state->text_buffer + pos,
+            state->used_size - pos + 1);
+    memcpy(state->text_buffer + pos, bytes, len);
+
+    state->used_size += len;
+    state->edit_version++;
+    if (state->has_mark && state->mark >= pos) state->mark += len;
+    syntax_on_insert(&state->syntax, pos, len);
+    save_snapshots_on_edit(state, pos, 0, len);
+}
+
+void buffer_delete(Text_Edit_State *state, size_t pos, size_t len) {
+    // NOTE: Include used_size as well, to move back the null terminator
+    //       Even if buffer is zero-initialized, not carrying the null terminator would be a problem
+    //       since more than one byte can be deleted at a time.
+    memmove(state->text_buffer + pos,
+            state->text_buffer + pos + len,
+            state->used_size - (pos + len) + 1);
+
+    state->used_size -= len;
+    state->edit_version++;
+    if (state->has_mark && state->mark > pos) state->mark = state->mark > pos + len ? state->mark - len : pos;
+    syntax_on_delete(&state->syntax, pos, len);
+    save_snapshots_on_edit(state, pos, len, 0);
+}
+
+// Buffer edits that are recorded for undo
+void edit_insert(Text_Edit_State *state, size_t pos, const char *bytes, size_t len) {
+    size_t cursor_before = state->text_buffer_cursor;
+    buffer_insert(state, pos, bytes, len);
+    undo_record(&state->undo, EDIT_INSERT, pos, state->text_buffer + pos, len, cursor_before);
+}
+
+void edit_delete(Text_Edit_State *state, size_t pos, size_t len) {
+    undo_record(&state->undo, EDIT_DELETE, pos, state->text_buffer + pos, len,
+                state->text_buffer_cursor);
+    buffer_delete(state, pos, len);
+}
+
+void handle_input_char(Text_Edit_State *state, uint32_t c) {
+    char encoded[4];
+    size_t len = utf8_encode(c, encoded);
+    if (len == 0) {
+        trace_log("Invalid codepoint: 0x%08X", c);
+        return;
+    }
+
+    edit_insert(state, state->text_buffer_cursor, encoded, len);
+    state->text_buffer_cursor += len;
+}
+
+void handle_backspace_char(Text_Edit_State *state) {
+    if (state->text_buffer_cursor > 0) {
+        size_t start = utf8_prev(state->text_buffer, state->text_buffer_cursor);
+        edit_delete(state, start, state->text_buffer_cursor - start);
+        state->text_buffer_cursor = start;
+    }
+}
+
+void advance_cursor(Text_Edit_State *state, bool forward) {
+    // Moving away ends the current typing run, so the next edit is undone separately
+    undo_break_coalescing(&state->undo);
+
+    if (forward) {
+        if (state->text_buffer_cursor < state->used_size) {
+            uint32_t codepoint;
+            state->text_buffer_cursor += utf8_decode(state->text_buffer + state->text_buffer_cursor, &codepoint);
+        }
+    } else {
+        state->text_buffer_cursor = utf8_prev(state->text_buffer, state->text_buffer_cursor);
+    }
+}
+
+static const char *g_edit_op_names[EDIT_OP_COUNT] = {
+    [EDIT_OP_CHAR]      = "char",
+    [EDIT_OP_BACKSPACE] = "backspace",
+    [EDIT_OP_LEFT]      = "left",
+    [EDIT_OP_RIGHT]     = "right",
+    [EDIT_OP_UNDO]      = "undo",
+    [EDIT_OP_REDO]      = "redo",
+    [EDIT_OP_CURSOR]    = "cursor",
+};
+
+void apply_edit_op(Text_Edit_State *state, Edit_Op op) {
+    switch (op.kind) {
+        case EDIT_OP_CHAR:      handle_input_char(state, (uint32_t)op.arg); break;
+        case EDIT_OP_BACKSPACE: handle_backspace_char(state); break;
+        case EDIT_OP_LEFT:      advance_cursor(state, false); break;
+        case EDIT_OP_RIGHT:     advance_cursor(state, true); break;
+        case EDIT_OP_UNDO:      undo(state); break;
+        case EDIT_OP_REDO:      redo(state); break;
+        case EDIT_OP_CURSOR: {
+            undo_break_coalescing(&state->undo);
+            size_t pos = op.arg < state->used_size ? (size_t)op.arg : state->used_size;
+            // NOTE: Snap back to a code point boundary
+            while (pos > 0 && pos < state->used_size && (state->text_buffer[pos] & 0xC0) == 0x80) pos--;
+            state->text_buffer_cursor = pos;
+        } break;
+        default: break;
+    }
+}
+
+const char *edit_op_name(Edit_Op_Kind kind) {
+    return kind < EDIT_OP_COUNT ? g_edit_op_names[kind] : "unknown";
+}
+
+// One line of the trace format, e.g. "char 97" or "backspace", without the newline
+int format_edit_op(Edit_Op op, char *out, size_t out_size) {
+    if (op.kind == EDIT_OP_CHAR || op.kind == EDIT_OP_CURSOR) {
+        return snprintf(out, out_size, "%s %llu", edit_op_name(op.kind), (unsigned long long)op.arg);
+    }
+    return snprintf(out, out_size, "%s", edit_op_name(op.kind));
+}
+
+// Returns false for blank lines, '#' comments and anything malformed
+bool parse_edit_op(const char *line, Edit_Op *out) {
+    while (*line == ' ' || *line == '\t') line++;
+    if (*line == '\0' || *line == '\n' || *line == '#') return false;
+
+    for (int kind = 0; kind < EDIT_OP_COUNT; kind++) {
+        size_t name_len = strlen(g_edit_op_names[kind]);
+        if (strncmp(line, g_edit_op_names[kind], name_len) != 0) continue;
+
+        const char *rest = line + name_len;
+        bool takes_arg = kind == EDIT_OP_CHAR || kind == EDIT_OP_CURSOR;
+        if (takes_arg) {
+            char *end;
+            errno = 0;
+            unsigned long long arg = strtoull(rest, &end, 10);
+            if (end == rest || errno != 0) return false;
+            out->arg = arg;
+            rest = end;
+        } else {
+            out->arg = 0;
+        }
+        while (*rest == ' ' || *rest == '\t' || *rest == '\r' || *rest == '\n') rest++;
+        if (*rest != '\0') return false;
+
+        out->kind = (Edit_Op_Kind)kind;
+        return true;
+    }
+    return false;
+}
+
+void undo_init(Undo_Log *log, size_t memory_limit) {
+    memset(log, 0, sizeof(*log));
+    log->memory_limit = memory_limit;
+}
+
+void undo_free(Undo_Log *log) {
+    Undo_Chunk *chunk = log->first_chunk;
+    while (chunk) {
+        Undo_Chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    memset(log, 0, sizeof(*log));
+}
+
+void undo_break_coalescing(Undo_Log *log) {
+    log->coalesce_open = false;
+}
+
+void undo_begin_group(Undo_Log *log) {
+    log->current_group = ++log->next_group;
+    log->group_open = true;
+    log->coalesce_open = false;
+}
+
+void undo_end_group(Undo_Log *log) {
+    log->group_open = false;
+    log->coalesce_open = false;
+}
+
+static size_t undo_align(size_t size) {
+    return (size + 15) & ~(size_t)15;
+}
+
+static void undo_free_chunks_after(Undo_Log *log, Undo_Chunk *chunk) {
+    Undo_Chunk *cur = chunk ? chunk->next : log->first_chunk;
+    while (cur) {
+        Undo_Chunk *next = cur->next;
+        log->total_bytes -= cur->capacity;
+        free(cur);
+        cur = next;
+    }
+    if (chunk) chunk->next = NULL;
+    else       log->first_chunk = NULL;
+    log->last_chunk = chunk;
+}
+
+// Records are bump allocated in order, so everything after `applied` sits at the end of the arena
+static void undo_truncate_redo(Undo_Log *log) {
+    Edit_Record *first_redo = log->applied ? log->applied->next : log->oldest;
+    if (!first_redo) return;
+
+    Undo_Chunk *chunk = first_redo->chunk;
+    chunk->used = (uint8_t *)first_redo - chunk->bytes;
+    undo_free_chunks_after(log, chunk);
+
+    log->newest = log->applied;
+    if (log->newest) log->newest->next = NULL;
+    else             log->oldest = NULL;
+}
+
+// Drops the oldest chunks while over the limit, but only ever whole groups: undoing part of a group
+// would apply the rest of it to text it no longer matches. The newest group is always kept, even when
+// it alone is over the limit, so the edit that was just made can still be undone.
+static void undo_trim_to_limit(Undo_Log *log) {
+    if (!log->newest) return;
+
+    Edit_Record *newest_group_first = log->newest;
+    while (newest_group_first->prev && newest_group_first->prev->group == log->newest->group) {
+        newest_group_first = newest_group_first->prev;
+    }
+
+    while (log->total_bytes > log->memory_limit && log->first_chunk != newest_group_first->chunk) {
+        Undo_Chunk *dropped = log->first_chunk;
+
+        Edit_Record *r = log->oldest;
+        while (r && r->chunk == dropped) r = r->next;
+        // NOTE: A group that starts in the dropped chunk goes with it, even the part in later chunks.
+        //       Those records stay allocated until their own chunk is dropped.
+        if (r && r->prev && r->prev->group == r->group) {
+            uint32_t group = r->group;
+            while (r && r->group == group) r = r->next;
+        }
+        // NOTE: `applied` is always the newest record here (redo was truncated before appending),
+        //       and the newest group is never dropped, so `applied` stays valid.
+        log->oldest = r;
+        if (r) r->prev = NULL;
+
+        log->first_chunk = dropped->next;
+        log->first_chunk->prev = NULL;
+        log->total_bytes -= dropped->capacity;
+        free(dropped);
+    }
+}
+
+static void *undo_alloc(Undo_Log *log, size_t size) {
+    size = undo_align(size);
+    Undo_Chunk *chunk = log->last_chunk;
+    if (!chunk || chunk->capacity - chunk->used < size) {
+        size_t capacity = size > UNDO_CHUNK_SIZE ? size : UNDO_CHUNK_SIZE;
+        chunk = xmalloc(sizeof(Undo_Chunk) + capacity);
+        chunk->prev = log->last_chunk;
+        chunk->next = NULL;
+        chunk->capacity = capacity;
+        chunk->used = 0;
+        if (log->last_chunk) log->last_chunk->next = chunk;
+        else                 log->first_chunk = chunk;
+        log->last_chunk = chunk;
+        log->total_bytes += capacity;
+    }
+
+    void *result = chunk->bytes + chunk->used;
+    chunk->used += size;
+    return result;
+}
+
+// Grows the newest record in place. Only possible while it is the last allocation in its chunk.
+static bool undo_try_grow(Undo_Log *log, Edit_Record *record, size_t extra) {
+    Undo_Chunk *chunk = record->chunk;
+    if (chunk != log->last_chunk) return false;
+
+    size_t record_offset = (uint8_t *)record - chunk->bytes;
+    size_t old_size = undo_align(sizeof(Edit_Record) + record->len);
+    size_t new_size = undo_align(sizeof(Edit_Record) + record->len + extra);
+    if (record_offset + old_size != chunk->used) return false;
+    if (record_offset + new_size > chunk->capacity) return false;
+
+    chunk->used = record_offset + new_size;
+    return true;
+}
+
+static bool undo_try_coalesce(Undo_Log *log, Edit_Kind kind, size_t pos, const char *bytes, size_t len) {
+    Edit_Record *last = log->applied;
+    if (!log->coalesce_open || !last || last != log->newest || last->kind != kind) return false;
+    if (last->len + len > UNDO_COALESCE_MAX) return false;
+
+    if (kind == EDIT_INSERT) {
+        // Typing forward. A newline ends the run, so each line is undone on its own.
+        if (last->pos + last->len != pos || last->bytes[last->len - 1] == '\n') return false;
+        if (!undo_try_grow(log, last, len)) return false;
+        memcpy(last->bytes + last->len, bytes, len);
+        last->len += len;
+    } else {
+        // Backspacing: the new bytes come right before the ones already recorded
+        if (pos + len != last->pos) return false;
+        if (!undo_try_grow(log, last, len)) return false;
+        memmove(last->bytes + len, last->bytes, last->len);
+        memcpy(last->bytes, bytes, len);
+        last->pos = pos;
+        last->len += len;
+    }
+
+    return true;
+}
+
+// Links a new record with room for len bytes after the newest one. Redo must be truncated already.
+static Edit_Record *undo_append(Undo_Log *log, Edit_Kind kind, size_t pos, size_t len, size_t cursor_before) {
+    Edit_Record *record = undo_alloc(log, sizeof(Edit_Record) + len);
+    record->chunk = log->last_chunk;
+    record->kind = kind;
+    record->group = log->group_open ? log->current_group : ++log->next_group;
+    record->pos = pos;
+    record->len = len;
+    record->cursor_before = cursor_before;
+
+    record->prev = log->newest;
+    record->next = NULL;
+    if (log->newest) log->newest->next = record;
+    else             log->oldest = record;
+    log->newest = record;
+    log->applied = record;
+    return record;
+}
+
+void undo_record(Undo_Log *log, Edit_Kind kind, size_t pos, const char *bytes, size_t len, size_t cursor_before) {
+    if (len == 0) return;
+
+    undo_truncate_redo(log);
+
+    if (undo_try_coalesce(log, kind, pos, bytes, len)) return;
+
+    Edit_Record *record = undo_append(log, kind, pos, len, cursor_before);
+    memcpy(record->bytes, bytes, len);
+    log->coalesce_open = !log->group_open;
+
+    undo_trim_to_limit(log);
+}
+
+// Costs a word per match plus the two strings, however far apart the matches are
+void undo_record_replace(Undo_Log *log, const size_t *matches, size_t match_count, const char *query, size_t query_len,
+                         const char *replacement, size_t replacement_len, size_t cursor_before) {
+    if (match_count == 0) return;
+
+    undo_truncate_redo(log);
+
+    size_t matches_size = match_count * sizeof(size_t);
+    size_t len = sizeof(Replace_Payload) + matches_size + query_len + replacement_len;
+    Edit_Record *record = undo_append(log, EDIT_REPLACE, matches[0], len, cursor_before);
+    Replace_Payload *payload = (Replace_Payload *)record->bytes;
+    payload->match_count = match_count;
+    payload->query_len = query_len;
+    payload->replacement_len = replacement_len;
+    memcpy(payload->matches, matches, matches_size);
+    char *strings = (char *)(payload->matches + match_count);
+    memcpy(strings, query, query_len);
+    memcpy(strings + query_len, replacement, replacement_len);
+    log->coalesce_open = false;
+
+    undo_trim_to_limit(log);
+}
+
+// Rewrites the span from the first to the last match in one pass. Match i starts at matches[i] + i * shift
+// in the current text, so the offsets from before a replace also find the matches after it.
+// NOTE: shift is negative, wrapped, when the replacement is shorter than the query.
+static void buffer_replace_matches(Text_Edit_State *state, const size_t *matches, size_t match_count, size_t shift,
+                                   size_t match_len, const char *replacement, size_t replacement_len) {
+    size_t first = matches[0];
+    size_t span_end = matches[match_count - 1] + (match_count - 1) * shift + match_len;
+    size_t scratch_len = span_end - first - match_count * match_len + match_count * replacement_len;
+    char *scratch = xmalloc(scratch_len + 1);
+
+    const char *text = state->text_buffer;
+    size_t used = 0;
+    size_t copied_to = first;
+    for (size_t i = 0; i < match_count; i++) {
+        size_t pos = matches[i] + i * shift;
+        memcpy(scratch + used, text + copied_to, pos - copied_to);
+        used += pos - copied_to;
+        memcpy(scratch + used, replacement, replacement_len);
+        used += replacement_len;
+        copied_to = pos + match_len;
+    }
+
+    buffer_delete(state, first, span_end - first);
+    buffer_insert(state, first, scratch, scratch_len);
+    free(scratch);
+}
+
+static void undo_replace(Text_Edit_State *state, const Edit_Record *r, bool forward) {
+    const Replace_Payload *payload = (const Replace_Payload *)r->bytes;
+    const char *query = (const char *)(payload->matches + payload->match_count);
+    const char *replacement = query + payload->query_len;
+    if (forward) {
+        buffer_replace_matches(state, payload->matches, payload->match_count, 0,
+                               payload->query_len, replacement, payload->replacement_len);
+    } else {
+        buffer_replace_matches(state, payload->matches, payload->match_count, payload->replacement_len - payload->query_len,
+                               payload->replacement_len, query, payload->query_len);
+    }
+}
+
+// NOTE: Finding and reading a record is O(edit size), but applying it goes through buffer_insert/buffer_delete,
+//       which memmove the rest of the flat text buffer. A step costs about as much as a keystroke at the same
+//       spot, O(file size) at worst, until the text itself moves onto a gap or piece structure.
+bool undo(Text_Edit_State *state) {
+    Undo_Log *log = &state->undo;
+    Edit_Record *r = log->applied;
+    if (!r) return false;
+
+    uint32_t group = r->group;
+    for (; r && r->group == group; r = r->prev) {
+        if (r->kind == EDIT_INSERT)      buffer_delete(state, r->pos, r->len);
+        else if (r->kind == EDIT_DELETE) buffer_insert(state, r->pos, r->bytes, r->len);
+        else                             undo_replace(state, r, false);
+        state->text_buffer_cursor = r->cursor_before;
+        log->applied = r->prev;
+    }
+
+    log->coalesce_open = false;
+    return true;
+}
+
+bool redo(Text_Edit_State *state) {
+    Undo_Log *log = &state->undo;
+    Edit_Record *r = log->applied ? log->applied->next : log->oldest;
+    if (!r) return false;
+
+    uint32_t group = r->group;
+    for (; r && r->group == group; r = r->next) {
+        if (r->kind == EDIT_INSERT) {
+            buffer_insert(state, r->pos, r->bytes, r->len);
+            state->text_buffer_cursor = r->pos + r->len;
+        } else if (r->kind == EDIT_DELETE) {
+            buffer_delete(state, r->pos, r->len);
+            state->text_buffer_cursor = r->pos;
+        } else {
+            undo_replace(state, r, true);
+            state->text_buffer_cursor = r->pos;
+        }
+        log->applied = r;
+    }
+
+    log->coalesce_open = false;
+    return true;
+}
+
+static size_t color_gap_len(const Syntax_State *syntax) {
+    return syntax->color_gap_end - syntax->color_gap_start;
+}
+
+// Moves the color gap so it starts at pos, which costs the distance it moves
+static void colors_move_gap(Syntax_State *syntax, size_t pos) {
+    size_t gap_len = color_gap_len(syntax);
+    if (pos < syntax->color_gap_start) {
+        size_t count = syntax->color_gap_start - pos;
+        memmove(syntax->colors + pos + gap_len, syntax->colors + pos, count);
+    } else if (pos > syntax->color_gap_start) {
+        size_t count = pos - syntax->color_gap_start;
+        memmove(syntax->colors + syntax->color_gap_start, syntax->colors + syntax->color_gap_end, count);
+    }
+    syntax->color_gap_start = pos;
+    syntax->color_gap_end = pos + gap_len;
+}
+
+static void colors_reserve_gap(Syntax_State *syntax, size_t len) {
+    if (color_gap_len(syntax) >= len) return;
+
+    size_t used = syntax->colors_cap - color_gap_len(syntax);
+    size_t tail_len = syntax->colors_cap - syntax->color_gap_end;
+    size_t capacity = syntax->colors_cap ? syntax->colors_cap : TEXT_INITIAL_CAPACITY;
+    while (capacity - used < len) capacity *= 2;
+    syntax->colors = xrealloc(syntax->colors, capacity);
+    memmove(syntax->colors + capacity - tail_len, syntax->colors + syntax->color_gap_end, tail_len);
+    syntax->color_gap_end = capacity - tail_len;
+    syntax->colors_cap = capacity;
+}
+
+// Copies the colors of [pos, pos + len), the range may span the gap
+void syntax_copy_colors(const Syntax_State *syntax, size_t pos, size_t len, uint8_t *out) {
+    size_t before = 0;
+    if (pos < syntax->color_gap_start) {
+        before = syntax->color_gap_start - pos;
+        if (before > len) before = len;
+        memcpy(out, syntax->colors + pos, before);
+    }
+    memcpy(out + before, syntax->colors + pos + before + color_gap_len(syntax), len - before);
+}
+
+static size_t line_gap_len(const Syntax_State *syntax) {
+    return syntax->line_cap - syntax->line_count;
+}
+
+static Syntax_Line *syntax_line(const Syntax_State *syntax, size_t line) {
+    return syntax->lines + (line < syntax->line_gap ? line : line + line_gap_len(syntax));
+}
+
+size_t syntax_line_start(const Syntax_State *syntax, size_t line) {
+    if (line < syntax->line_gap) return syntax->lines[line].start;
+    return syntax->lines[line + line_gap_len(syntax)].start + syntax->line_tail_shift;
+}
+
+uint32_t syntax_line_id(const Syntax_State *syntax, size_t line) {
+    return syntax_line(syntax, line)->id;
+}
+
+// Lines crossing the gap trade the shift for their real start or the other way around
+static void lines_move_gap(Syntax_State *syntax, size_t line) {
+    size_t gap_len = line_gap_len(syntax);
+    while (syntax->line_gap < line) {
+        Syntax_Line *moved = &syntax->lines[syntax->line_gap];
+        *moved = syntax->lines[syntax->line_gap + gap_len];
+        moved->start += syntax->line_tail_shift;
+        syntax->line_gap++;
+    }
+    while (syntax->line_gap > line) {
+        syntax->line_gap--;
+        Syntax_Line *moved = &syntax->lines[syntax->line_gap + gap_len];
+        *moved = syntax->lines[syntax->line_gap];
+        moved->start -= syntax->line_tail_shift;
+    }
+}
+
+static void lines_insert(Syntax_State *syntax, size_t line, Syntax_Line value) {
+    lines_move_gap(syntax, line);
+    if (syntax->line_count == syntax->line_cap) {
+        size_t tail_len = syntax->line_count - syntax->line_gap;
+        size_t capacity = syntax->line_cap * 2;
+        syntax->lines = xrealloc(syntax->lines, capacity * sizeof(Syntax_Line));
+        memmove(syntax->lines + capacity - tail_len, syntax->lines + syntax->line_gap, tail_len * sizeof(Syntax_Line));
+        syntax->line_cap = capacity;
+    }
+    syntax->lines[syntax->line_gap++] = value;
+    syntax->line_count++;
+}
+
+// The lines right after the gap become part of it
+static void lines_remove(Syntax_State *syntax, size_t line, size_t count) {
+    lines_move_gap(syntax, line);
+    syntax->line_count -= count;
+}
+
+void syntax_reset(Syntax_State *syntax, size_t text_size) {
+    if (syntax->colors_cap < text_size + 1) {
+        size_t capacity = syntax->colors_cap ? syntax->colors_cap : TEXT_INITIAL_CAPACITY;
+        while (capacity < text_size + 1) capacity *= 2;
+        syntax->colors = xrealloc(syntax->colors, capacity);
+        syntax->colors_cap = capacity;
+    }
+    // NOTE: The gap starts at 0, where the first re-lex starts, so lexing the whole text moves nothing
+    syntax->color_gap_start = 0;
+    syntax->color_gap_end = syntax->colors_cap - (text_size + 1);
+    memset(syntax->colors, SYNTAX_DEFAULT, syntax->colors_cap);
+
+    syntax->line_count = 1;
+    if (syntax->line_cap == 0) {
+        syntax->line_cap = 1024;
+        syntax->lines = xmalloc(syntax->line_cap * sizeof(Syntax_Line));
+    }
+    syntax->lines[0] = (Syntax_Line){0, LEX_NORMAL, syntax->next_line_id++};
+    syntax->line_gap = 1;
+    syntax->line_tail_shift = 0;
+    syntax->dirty_line = 0;
+    syntax->dirty_end = text_size;
+    syntax->has_dirty = true;
+}
+
+// Index of the line containing pos
+size_t syntax_find_line(const Syntax_State *syntax, size_t pos) {
+    size_t lo = 0, hi = syntax->line_count;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (syntax_line_start(syntax, mid) <= pos) lo = mid;
+        else                                        hi = mid;
+    }
+    return lo;
+}
+
+static void syntax_mark_dirty(Syntax_State *syntax, size_t line, size_t end) {
+    if (!syntax->has_dirty || line < syntax->dirty_line) syntax->dirty_line = line;
+    if (!syntax->has_dirty || end > syntax->dirty_end)   syntax->dirty_end = end;
+    syntax->has_dirty = true;
+}
+
+// NOTE: Line starts after the edit are shifted right away, so they stay valid
+//       and the re-lex can stop as soon as its state matches a cached line start again.
+//       Moving the line gap behind the edited line shifts all of them through line_tail_shift.
+void syntax_on_insert(Syntax_State *syntax, size_t pos, size_t len) {
+    colors_move_gap(syntax, pos);
+    colors_reserve_gap(syntax, len);
+    memset(syntax->colors + pos, SYNTAX_DEFAULT, len);
+    syntax->color_gap_start += len;
+
+    size_t line = syntax_find_line(syntax, pos);
+    syntax_line(syntax, line)->id = syntax->next_line_id++;
+    lines_move_gap(syntax, line + 1);
+    syntax->line_tail_shift += len;
+
+    if (syntax->has_dirty && syntax->dirty_end >= pos) syntax->dirty_end += len;
+    syntax_mark_dirty(syntax, line, pos + len);
+}
+
+void syntax_on_delete(Syntax_State *syntax, size_t pos, size_t len) {
+    colors_move_gap(syntax, pos);
+    syntax->color_gap_end += len;
+
+    size_t line = syntax_find_line(syntax, pos);
+    syntax_line(syntax, line)->id = syntax->next_line_id++;
+
+    // Lines that started inside the deleted range lost their newline
+    size_t first_kept = line + 1;
+    while (first_kept < syntax->line_count && syntax_line_start(syntax, first_kept) <= pos + len) first_kept++;
+    lines_remove(syntax, line + 1, first_kept - (line + 1));
+    syntax->line_tail_shift -= len;
+
+    if (syntax->has_dirty) {
+        if (syntax->dirty_end > pos + len) syntax->dirty_end -= len;
+        else if (syntax->dirty_end > pos)  syntax->dirty_end = pos;
+    }
+    syntax_mark_dirty(syntax, line, pos);
+}
+
+static bool is_ident_start(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static bool is_ident_char(char c) {
+    return is_ident_start(c) || (c >= '0' && c <= '9');
+}
+
+static Syntax_Color classify_identifier(const char *ident, size_t len) {
+    static const char *keywords[] = {
+        "auto", "break", "case", "const", "continue", "default", "do", "else", "enum", "extern",
+        "for", "goto", "if", "inline", "register", "restrict", "return", "sizeof", "static",
+        "struct", "switch", "typedef", "union", "volatile", "while", "_Alignas", "_Alignof",
+        "_Atomic", "_Generic", "_Noreturn", "_Static_assert", "_Thread_local", "NULL", "true", "false"
+    };
+    static const char *types[] = {
+        "bool", "char", "double", "float", "int", "long", "short", "signed", "unsigned", "void",
+        "_Bool", "size_t", "ssize_t", "ptrdiff_t", "intptr_t", "uintptr_t",
+        "int8_t", "int16_t", "int32_t", "int64_t", "uint8_t", "uint16_t", "uint32_t", "uint64_t", "FILE"
+    };
+
+    for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
+        if (strlen(keywords[i]) == len && memcmp(keywords[i], ident, len) == 0) return SYNTAX_KEYWORD;
+    }
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        if (strlen(types[i]) == len && memcmp(types[i], ident, len) == 0) return SYNTAX_TYPE;
+    }
+    return SYNTAX_DEFAULT;
+}
+
+// Lexes [start, end) where end is the newline (or end of text) and returns the state for the next line
+static uint8_t lex_line(const char *text, size_t start, size_t end, uint8_t state, uint8_t *colors) {
+    bool preproc = (state & LEX_PREPROC_FLAG) != 0;
+    uint8_t mode = state & ~LEX_PREPROC_FLAG;
+    bool continued = end > start && text[end - 1] == '\\';
+
+    size_t i = start;
+    if (mode == LEX_NORMAL && !preproc) {
+        size_t first = start;
+        while (first < end && (text[first] == ' ' || text[first] == '\t')) first++;
+        if (first < end && text[first] == '#') preproc = true;
+    }
+    uint8_t base_color = preproc ? SYNTAX_PREPROC : SYNTAX_DEFAULT;
+
+    while (i < end) {
+        char c = text[i];
+
+        if (mode == LEX_BLOCK_COMMENT) {
+            colors[i] = SYNTAX_COMMENT;
+            if (c == '*' && i + 1 < end && text[i + 1] == '/') {
+                colors[i + 1] = SYNTAX_COMMENT;
+                i += 2;
+                mode = LEX_NORMAL;
+            } else {
+                i++;
+            }
+        } else if (mode == LEX_LINE_COMMENT) {
+            colors[i++] = SYNTAX_COMMENT;
+        } else if (mode == LEX_STRING || mode == LEX_CHAR) {
+            char quote = (mode == LEX_STRING) ? '"' : '\'';
+            colors[i] = SYNTAX_STRING;
+            if (c == '\\' && i + 1 < end) {
+                colors[i + 1] = SYNTAX_STRING;
+                i += 2;
+            } else {
+                i++;
+                if (c == quote) mode = LEX_NORMAL;
+            }
+        } else if (c == '/' && i + 1 < end && text[i + 1] == '*') {
+            colors[i] = colors[i + 1] = SYNTAX_COMMENT;
+            i += 2;
+            mode = LEX_BLOCK_COMMENT;
+        } else if (c == '/' && i + 1 < end && text[i + 1] == '/') {
+            mode = LEX_LINE_COMMENT;
+        } else if (c == '"') {
+            colors[i++] = SYNTAX_STRING;
+            mode = LEX_STRING;
+        } else if (c == '\'') {
+            colors[i++] = SYNTAX_STRING;
+            mode = LEX_CHAR;
+        } else if (preproc && c == '<' && i > start) {
+            // #include <header>
+            size_t j = i;
+            while (j < end && text[j] != '>') j++;
+            bool is_header = j < end;
+            for (size_t k = i; k <= j && k < end; k++) colors[k] = is_header ? SYNTAX_STRING : base_color;
+            i = is_header ? j + 1 : i + 1;
+        } else if ((c >= '0' && c <= '9') || (c == '.' && i + 1 < end && text[i + 1] >= '0' && text[i + 1] <= '9')) {
+            size_t j = i;
+            while (j < end && (is_ident_char(text[j]) || text[j] == '.' ||
+                               ((text[j] == '+' || text[j] == '-') && (text[j - 1] == 'e' || text[j - 1] == 'E' ||
+                                                                       text[j - 1] == 'p' || text[j - 1] == 'P')))) {
+                j++;
+            }
+            memset(colors + i, SYNTAX_NUMBER, j - i);
+            i = j;
+        } else if (is_ident_start(c)) {
+            size_t j = i;
+            while (j < end && is_ident_char(text[j])) j++;
+            uint8_t color = preproc ? SYNTAX_PREPROC : classify_identifier(text + i, j - i);
+            memset(colors + i, color, j - i);
+            i = j;
+        } else {
+            colors[i++] = (c == ' ' || c == '\t') ? SYNTAX_DEFAULT : (preproc ? SYNTAX_PREPROC : SYNTAX_PUNCT);
+        }
+    }
+
+    // Line comments, strings and directives only carry over an escaped newline
+    if (!continued) {
+        if (mode != LEX_BLOCK_COMMENT) mode = LEX_NORMAL;
+        preproc = false;
+    }
+    colors[end] = preproc ? SYNTAX_PREPROC : SYNTAX_DEFAULT;
+
+    return mode | (preproc ? LEX_PREPROC_FLAG : 0);
+}
+
+// Re-lexes from the first dirty line until a line start is reached past the edits
+// whose cached state matches the freshly computed one
+void syntax_update(Syntax_State *syntax, const char *text, size_t text_size) {
+    if (!syntax->has_dirty) return;
+
+    size_t line = syntax->dirty_line;
+    // NOTE: Everything lexed lies at or after the dirty line, so with the gap moved there
+    //       the colors from there on are one flat array. The gaps follow the lexer, line by line.
+    colors_move_gap(syntax, syntax_line_start(syntax, line));
+    uint8_t *colors = syntax->colors + color_gap_len(syntax);
+    uint8_t state = syntax_line(syntax, line)->start_state;
+    for (;;) {
+        size_t start = syntax_line_start(syntax, line);
+        const char *newline = memchr(text + start, '\n', text_size - start);
+        size_t end = newline ? (size_t)(newline - text) : text_size;
+
+        state = lex_line(text, start, end, state, colors);
+        if (!newline) {
+            lines_remove(syntax, line + 1, syntax->line_count - (line + 1));
+            break;
+        }
+
+        size_t next_start = end + 1;
+        size_t next = line + 1;
+
+        // Drop stale entries, then add the line if a newline was inserted here
+        size_t stale = 0;
+        while (next + stale < syntax->line_count && syntax_line_start(syntax, next + stale) < next_start) stale++;
+        if (stale > 0) lines_remove(syntax, next, stale);
+
+        if (next < syntax->line_count && syntax_line_start(syntax, next) == next_start) {
+            Syntax_Line *next_line = syntax_line(syntax, next);
+            bool converged = next_line->start_state == state && next_start > syntax->dirty_end;
+            next_line->start_state = state;
+            if (converged) break;
+        } else {
+            lines_insert(syntax, next, (Syntax_Line){next_start, state, syntax->next_line_id++});
+        }
+
+        line = next;
+    }
+
+    syntax->has_dirty = false;
+}
+
+static size_t find_bytes_scalar(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len) {
+    if (needle_len > haystack_len) return SEARCH_NOT_FOUND;
+
+    const char *cur = haystack;
+    const char *last_start = haystack + (haystack_len - needle_len);
+    while (cur <= last_start) {
+        cur = memchr(cur, needle[0], last_start - cur + 1);
+        if (!cur) break;
+        if (memcmp(cur + 1, needle + 1, needle_len - 1) == 0) return cur - haystack;
+        cur++;
+    }
+    return SEARCH_NOT_FOUND;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// First-and-last-byte filter: compare a block of candidate start positions against the needle's
+// first byte and the positions needle_len - 1 further against its last byte. Only positions where
+// both match go to memcmp, which in practice is almost never a false positive.
+static size_t find_bytes_sse2(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len) {
+    __m128i first = _mm_set1_epi8(needle[0]);
+    __m128i last = _mm_set1_epi8(needle[needle_len - 1]);
+
+    size_t i = 0;
+    for (; i + needle_len - 1 + 16 <= haystack_len; i += 16) {
+        __m128i block_first = _mm_loadu_si128((const __m128i *)(haystack + i));
+        __m128i block_last = _mm_loadu_si128((const __m128i *)(haystack + i + needle_len - 1));
+        __m128i eq = _mm_and_si128(_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(eq);
+        while (mask) {
+            int bit = __builtin_ctz(mask);
+            if (memcmp(haystack + i + bit + 1, needle + 1, needle_len - 2) == 0) return i + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    size_t tail = find_bytes_scalar(haystack + i, haystack_len - i, needle, needle_len);
+    return tail == SEARCH_NOT_FOUND ? SEARCH_NOT_FOUND : i + tail;
+}
+
+__attribute__((target("avx2")))
+static size_t find_bytes_avx2(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len) {
+    __m256i first = _mm256_set1_epi8(needle[0]);
+    __m256i last = _mm256_set1_epi8(needle[needle_len - 1]);
+
+    size_t i = 0;
+    for (; i + needle_len - 1 + 32 <= haystack_len; i += 32) {
+        __m256i block_first = _mm256_loadu_si256((const __m256i *)(haystack + i));
+        __m256i block_last = _mm256_loadu_si256((const __m256i *)(haystack + i + needle_len - 1));
+        __m256i eq = _mm256_and_si256(_mm256_cmpeq_epi8(first, block_first), _mm256_cmpeq_epi8(last, block_last));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(eq);
+        while (mask) {
+            int bit = __builtin_ctz(mask);
+            if (memcmp(haystack + i + bit + 1, needle + 1, needle_len - 2) == 0) return i + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    size_t tail = find_bytes_sse2(haystack + i, haystack_len - i, needle, needle_len);
+    return tail == SEARCH_NOT_FOUND ? SEARCH_NOT_FOUND : i + tail;
+}
+#endif
+
+// Offset of the first occurrence of needle, or SEARCH_NOT_FOUND
+size_t find_bytes(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len) {
+    if (needle_len == 0 || needle_len > haystack_len) return SEARCH_NOT_FOUND;
+    if (needle_len == 1) {
+        const char *found = memchr(haystack, needle[0], haystack_len);
+        return found ? (size_t)(found - haystack) : SEARCH_NOT_FOUND;
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    static int has_avx2 = -1;
+    if (has_avx2 < 0) has_avx2 = __builtin_cpu_supports("avx2");
+    if (has_avx2) return find_bytes_avx2(haystack, haystack_len, needle, needle_len);
+    return find_bytes_sse2(haystack, haystack_len, needle, needle_len);
+#else
+    return find_bytes_scalar(haystack, haystack_len, needle, needle_len);
+#endif
+}
+
+// Searches [from, end) first, then wraps around to the start
+static size_t search_buffer_wrapping(Text_Edit_State *state, size_t from) {
+    Search_State *search = &state->search;
+    const char *text = state->text_buffer;
+    size_t size = state->used_size;
+    if (from > size) from = size;
+
+    size_t found = find_bytes(text + from, size - from, search->query, search->query_len);
+    if (found != SEARCH_NOT_FOUND) return from + found;
+
+    size_t wrap_len = from + search->query_len - 1;
+    if (wrap_len > size) wrap_len = size;
+    return find_bytes(text, wrap_len, search->query, search->query_len);
+}
+
+static void search_jump(Text_Edit_State *state, size_t from) {
+    Search_State *search = &state->search;
+    size_t found = search->query_len ? search_buffer_wrapping(state, from) : SEARCH_NOT_FOUND;
+    search->has_match = found != SEARCH_NOT_FOUND;
+    if (search->has_match) {
+        search->match_pos = found;
+        state->text_buffer_cursor = found;
+    } else {
+        state->text_buffer_cursor = search->origin;
+    }
+}
+
+void search_begin(Text_Edit_State *state) {
+    Search_State *search = &state->search;
+    undo_break_coalescing(&state->undo);
+    search->mode = INPUT_MODE_SEARCH;
+    search->origin = state->text_buffer_cursor;
+    search->has_match = false;
+    search->replacement_len = 0;
+    search->replacement[0] = '\0';
+    // NOTE: The previous query is kept, so Ctrl+F Enter repeats the last search
+    if (search->query_len) search_jump(state, search->origin);
+}
+
+void search_find_next(Text_Edit_State *state) {
+    Search_State *search = &state->search;
+    search_jump(state, search->has_match ? search->match_pos + 1 : state->text_buffer_cursor);
+}
+
+void search_input_char(Text_Edit_State *state, uint32_t codepoint) {
+    Search_State *search = &state->search;
+    char encoded[4];
+    size_t len = utf8_encode(codepoint, encoded);
+    if (len == 0) return;
+
+    if (search->mode == INPUT_MODE_REPLACE) {
+        if (search->replacement_len + len >= SEARCH_MAX_QUERY) return;
+        memcpy(search->replacement + search->replacement_len, encoded, len);
+        search->replacement_len += len;
+        search->replacement[search->replacement_len] = '\0';
+        return;
+    }
+
+    if (search->query_len + len >= SEARCH_MAX_QUERY) return;
+    memcpy(search->query + search->query_len, encoded, len);
+    search->query_len += len;
+    search->query[search->query_len] = '\0';
+
+    // A longer query can only match at or after the previous match, so resume from there
+    search_jump(state, search->has_match ? search->match_pos : search->origin);
+}
+
+void search_backspace(Text_Edit_State *state) {
+    Search_State *search = &state->search;
+    if (search->mode == INPUT_MODE_REPLACE) {
+        search->replacement_len = utf8_prev(search->replacement, search->replacement_len);
+        search->replacement[search->replacement_len] = '\0';
+        return;
+    }
+
+    search->query_len = utf8_prev(search->query, search->query_len);
+    search->query[search->query_len] = '\0';
+    search_jump(state, search->origin);
+}
+
+// One undo step that records only where the matches were, see Replace_Payload
+size_t replace_all(Text_Edit_State *state, const char *query, size_t query_len, const char *replacement, size_t replacement_len) {
+    const char *text = state->text_buffer;
+    size_t size = state->used_size;
+    if (query_len == 0) return 0;
+
+    size_t *matches = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    size_t pos = 0;
+    for (;;) {
+        size_t found = find_bytes(text + pos, size - pos, query, query_len);
+        if (found == SEARCH_NOT_FOUND) break;
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            matches = xrealloc(matches, capacity * sizeof(size_t));
+        }
+        matches[count++] = pos + found;
+        pos += found + query_len;
+    }
+    if (count == 0) return 0;
+
+    size_t cursor_before = state->text_buffer_cursor;
+    buffer_replace_matches(state, matches, count, 0, query_len, replacement, replacement_len);
+    undo_record_replace(&state->undo, matches, count, query, query_len, replacement, replacement_len, cursor_before);
+    state->text_buffer_cursor = matches[0];
+
+    free(matches);
+    return count;
+}
+
+// Matches in [start, end) for highlighting. Only ever called with the visible range.
+size_t search_visible_matches(Text_Edit_State *state, size_t start, size_t end, Text_Range *out, size_t max_count) {
+    Search_State *search = &state->search;
+    if (search->mode == INPUT_MODE_EDIT || search->query_len == 0) return 0;
+
+    const char *text = state->text_buffer;
+    end += search->query_len - 1;
+    if (end > state->used_size) end = state->used_size;
+
+    size_t count = 0;
+    size_t pos = start;
+    while (count < max_count && pos < end) {
+        size_t found = find_bytes(text + pos, end - pos, search->query, search->query_len);
+        if (found == SEARCH_NOT_FOUND) break;
+        out[count].start = pos + found;
+        out[count].end = pos + found + search->query_len;
+        pos = out[count].end;
+        count++;
+    }
+    return count;
+}
+
+// Output is folded onto one line, it is shown next to the code
+void set_annotation(Text_Edit_State *state, size_t pos, uint64_t version, const char *text) {
+    char *out = state->annotation;
+    size_t used = 0;
+    bool space = false;
+    const char *cur = text;
+    for (; *cur && used + 1 < ANNOTATION_MAX; cur++) {
+        if (*cur == '\n' || *cur == '\r' || *cur == '\t') {
+            space = used > 0;
+            continue;
+        }
+        if (space && used + 2 < ANNOTATION_MAX) out[used++] = ' ';
+        space = false;
+        out[used++] = *cur;
+    }
+    if (*cur) {
+        // NOTE: Cut, don't leave half a multi-byte character behind
+        while (used > 0 && ((unsigned char)out[used - 1] & 0xC0) == 0x80) used--;
+        if (used > 0 && ((unsigned char)out[used - 1] & 0x80)) used--;
+    }
+    out[used] = '\0';
+    state->annotation_pos = pos;
+    state->annotation_version = version;
+}
+
+void save_file(Text_Edit_State *state) {
+    queue_save(state, SAVE_KIND_EXPLICIT);
+}
+
+void try_load_file(Text_Edit_State *state) {
+    FILE *file = fopen(state->file_name, "r");
+    if (!file) {
+        trace_log("File doesn't exist. Will create new file: %s.", state->file_name);
+        return;
+    }
+
+    fseek(file, 0, SEEK_END);
+    size_t file_size = ftell(file);
+    rewind(file);
+
+    // NOTE: Read straight into the buffer and hand it to editor_set_text in place,
+    //       so a large file is never held in memory twice
+    text_reserve(state, file_size + 1);
+    size_t bytes_copied = fread(state->text_buffer, 1, file_size, file);
+    fclose(file);
+    editor_set_text(state, state->text_buffer, bytes_copied);
+
+    trace_log("Read %zu bytes from file: %s.", bytes_copied, state->file_name);
+}
+
+static void *save_worker_proc(void *arg) {
+    Save_Worker *worker = arg;
+
+    pthread_mutex_lock(&worker->mutex);
+    for (;;) {
+        while (!worker->has_pending[SAVE_KIND_EXPLICIT] && !worker->has_pending[SAVE_KIND_AUTOSAVE] && !worker->quit) {
+            pthread_cond_wait(&worker->cond, &worker->mutex);
+        }
+
+        // Explicit saves go first. Pending jobs are always drained before quitting.
+        Save_Kind kind;
+        if (worker->has_pending[SAVE_KIND_EXPLICIT])      kind = SAVE_KIND_EXPLICIT;
+        else if (worker->has_pending[SAVE_KIND_AUTOSAVE]) kind = SAVE_KIND_AUTOSAVE;
+        else break;
+
+        Save_Job job = worker->pending[kind];
+        worker->has_pending[kind] = false;
+        pthread_mutex_unlock(&worker->mutex);
+
+        Save_Result result = {0};
+        result.kind = kind;
+        result.edit_version = job.edit_version;
+        result.ok = write_file_atomic(job.file_name, job.bytes, job.size, result.error, sizeof(result.error));
+        if (result.ok && kind == SAVE_KIND_EXPLICIT) {
+            // The real file is now at least as new as any autosave
+            unlink(worker->autosave_file_name);
+        }
+        free(job.bytes);
+
+        pthread_mutex_lock(&worker->mutex);
+        if (worker->result_count == SAVE_RESULT_CAPACITY) {
+            // Drop the oldest, the newest result is the one that matters
+            memmove(worker->results, worker->results + 1, (SAVE_RESULT_CAPACITY - 1) * sizeof(Save_Result));
+            worker->result_count--;
+        }
+        worker->results[worker->result_count++] = result;
+    }
+    pthread_mutex_unlock(&worker->mutex);
+
+    return NULL;
+}
+
+void start_save_worker(Text_Edit_State *state) {
+    Save_Worker *worker = &g_save_worker;
+    snprintf(worker->autosave_file_name, sizeof(worker->autosave_file_name), "%s.autosave", state->file_name);
+    pthread_mutex_init(&worker->mutex, NULL);
+    pthread_cond_init(&worker->cond, NULL);
+    if (pthread_create(&worker->thread, NULL, save_worker_proc, worker) != 0) {
+        exit_with_error("Failed to start save thread");
+    }
+    state->last_autosave_ms = get_time_ms();
+}
+
+void stop_save_worker(Text_Edit_State *state) {
+    Save_Worker *worker = &g_save_worker;
+    // A save that was asked for is still written
+    while (save_snapshot_step(state)) {}
+    pthread_mutex_lock(&worker->mutex);
+    worker->quit = true;
+    pthread_cond_signal(&worker->cond);
+    pthread_mutex_unlock(&worker->mutex);
+    pthread_join(worker->thread, NULL);
+    poll_save_results(state);
+}
+
+// The worker gets its own copy of the buffer, so it never touches text_buffer while it is being edited.
+// The copy is taken by save_snapshot_step, a buffer up to a chunk long right away. A save asked for while
+// one of its kind is still being copied is already covered, that copy ends up with the text as it is when it finishes.
+static void queue_save(Text_Edit_State *state, Save_Kind kind) {
+    Save_Snapshot *snapshot = &g_save_snapshots[kind];
+    if (snapshot->active) return;
+    snapshot->active = true;
+    snapshot->copied = 0;
+    save_snapshot_step(state);
+}
+
+static void save_snapshot_reserve(Save_Snapshot *snapshot, Text_Edit_State *state) {
+    if (snapshot->capacity >= state->used_size + 1) return;
+    snapshot->capacity = state->text_capacity;
+    snapshot->bytes = xrealloc(snapshot->bytes, snapshot->capacity);
+}
+
+// Text before pos is unchanged, anything copied past it has moved. It is copied again right away rather than
+// dropped, since typing just behind the copied part would otherwise keep a save from ever finishing.
+// NOTE: That is never more than the edit itself just moved in text_buffer
+static void save_snapshots_on_edit(Text_Edit_State *state, size_t pos, size_t removed, size_t inserted) {
+    for (int kind = 0; kind < SAVE_KIND_COUNT; kind++) {
+        Save_Snapshot *snapshot = &g_save_snapshots[kind];
+        if (snapshot->copied <= pos) continue;
+        if (snapshot->copied - pos < removed) {
+            // Ended inside the removed bytes
+            snapshot->copied = pos;
+            continue;
+        }
+        size_t copied = snapshot->copied - removed + inserted;
+        save_snapshot_reserve(snapshot, state);
+        memcpy(snapshot->bytes + pos, state->text_buffer + pos, copied - pos);
+        snapshot->copied = copied;
+    }
+}
+
+static void submit_save_job(Save_Kind kind, Save_Job job) {
+    Save_Worker *worker = &g_save_worker;
+
+    pthread_mutex_lock(&worker->mutex);
+    if (worker->has_pending[kind]) {
+        // Superseded before the worker got to it
+        free(worker->pending[kind].bytes);
+    }
+    worker->pending[kind] = job;
+    worker->has_pending[kind] = true;
+    if (kind == SAVE_KIND_EXPLICIT && worker->has_pending[SAVE_KIND_AUTOSAVE] &&
+        worker->pending[SAVE_KIND_AUTOSAVE].edit_version <= job.edit_version) {
+        // Would only recreate an outdated autosave after the real file is written
+        free(worker->pending[SAVE_KIND_AUTOSAVE].bytes);
+        worker->has_pending[SAVE_KIND_AUTOSAVE] = false;
+    }
+    pthread_cond_signal(&worker->cond);
+    pthread_mutex_unlock(&worker->mutex);
+}
+
+bool save_snapshot_step(Text_Edit_State *state) {
+    bool more = false;
+    for (int kind = 0; kind < SAVE_KIND_COUNT; kind++) {
+        Save_Snapshot *snapshot = &g_save_snapshots[kind];
+        if (!snapshot->active) continue;
+
+        save_snapshot_reserve(snapshot, state);
+        size_t chunk = state->used_size - snapshot->copied;
+        if (chunk > SAVE_SNAPSHOT_CHUNK) chunk = SAVE_SNAPSHOT_CHUNK;
+        memcpy(snapshot->bytes + snapshot->copied, state->text_buffer + snapshot->copied, chunk);
+        snapshot->copied += chunk;
+        if (snapshot->copied < state->used_size) {
+            more = true;
+            continue;
+        }
+
+        Save_Job job = {0};
+        job.file_name = (kind == SAVE_KIND_EXPLICIT) ? state->file_name : g_save_worker.autosave_file_name;
+        job.bytes = snapshot->bytes;
+        job.size = state->used_size;
+        job.edit_version = state->edit_version;
+        *snapshot = (Save_Snapshot){0};
+        submit_save_job(kind, job);
+    }
+    return more;
+}
+
+void poll_save_results(Text_Edit_State *state) {
+    Save_Worker *worker = &g_save_worker;
+
+    Save_Result results[SAVE_RESULT_CAPACITY];
+    size_t result_count;
+    pthread_mutex_lock(&worker->mutex);
+    result_count = worker->result_count;
+    memcpy(results, worker->results, result_count * sizeof(Save_Result));
+    worker->result_count = 0;
+    pthread_mutex_unlock(&worker->mutex);
+
+    for (size_t i = 0; i < result_count; i++) {
+        Save_Result *result = &results[i];
+        const char *file_name = (result->kind == SAVE_KIND_EXPLICIT) ? state->file_name : worker->autosave_file_name;
+        if (!result->ok) {
+            trace_log("Failed to save %s: %s", file_name, result->error);
+        } else if (result->kind == SAVE_KIND_EXPLICIT) {
+            state->saved_version = result->edit_version;
+            state->save_count++;
+        } else {
+            // NOTE: Only now, so a failed autosave is tried again at the next interval even without new edits
+            state->autosaved_version = result->edit_version;
+            trace_log("Autosaved to %s", file_name);
+        }
+    }
+}
+
+void maybe_autosave(Text_Edit_State *state) {
+    double now = get_time_ms();
+    if (now - state->last_autosave_ms < AUTOSAVE_INTERVAL_MS) return;
+    state->last_autosave_ms = now;
+
+    if (state->edit_version != state->saved_version &&
+        state->edit_version != state->autosaved_version) {
+        queue_save(state, SAVE_KIND_AUTOSAVE);
+    }
+}
+
+// Writes to a temp file next to the target, then renames it over the target. A crash at any
+// point leaves either the old or the new contents, never a truncated file.
+// NOTE: The temp file gets a fresh name from mkstemp, which creates it exclusively. A fixed name could be
+//       a symlink someone placed there, and two editors saving the same file would share it.
+bool write_file_atomic(const char *file_name, const char *bytes, size_t size, char *error, size_t error_size) {
+    char temp_file_name[4096];
+    int len = snprintf(temp_file_name, sizeof(temp_file_name), "%s.XXXXXX", file_name);
+    if (len < 0 || (size_t)len >= sizeof(temp_file_name)) {
+        snprintf(error, error_size, "file name too long: %s", file_name);
+        return false;
+    }
+
+    mode_t mode = 0644;
+    struct stat existing;
+    if (stat(file_name, &existing) == 0) mode = existing.st_mode & 0777;
+
+    int fd = mkstemp(temp_file_name);
+    if (fd < 0) {
+        snprintf(error, error_size, "mkstemp %s: %s", temp_file_name, strerror(errno));
+        return false;
+    }
+    // mkstemp creates it 0600, the saved file keeps the mode it had
+    if (fchmod(fd, mode) != 0) {
+        snprintf(error, error_size, "fchmod %s: %s", temp_file_name, strerror(errno));
+        close(fd);
+        unlink(temp_file_name);
+        return false;
+    }
+
+    size_t written = 0;
+    while (written < size) {
+        ssize_t result = write(fd, bytes + written, size - written);
+        if (result < 0) {
+            if (errno == EINTR) continue;
+            snprintf(error, error_size, "write %s: %s", temp_file_name, strerror(errno));
+            close(fd);
+            unlink(temp_file_name);
+            return false;
+        }
+        written += result;
+    }
+
+    if (fsync(fd) != 0) {
+        snprintf(error, error_size, "fsync %s: %s", temp_file_name, strerror(errno));
+        close(fd);
+        unlink(temp_file_name);
+        return false;
+    }
+    close(fd);
+
+    if (rename(temp_file_name, file_name) != 0) {
+        snprintf(error, error_size, "rename %s: %s", temp_file_name, strerror(errno));
+        unlink(temp_file_name);
+        return false;
+    }
+
+    // Persist the rename itself
+    char dir_name[4096];
+    snprintf(dir_name, sizeof(dir_name), "%s", file_name);
+    char *last_slash = strrchr(dir_name, '/');
+    if (last_slash == dir_name)  last_slash[1] = '\0';
+    else if (last_slash)         last_slash[0] = '\0';
+    else                         snprintf(dir_name, sizeof(dir_name), ".");
+
+    int dir_fd = open(dir_name, O_RDONLY);
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+
+    return true;
+}
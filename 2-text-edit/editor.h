@@ -0,0 +1,238 @@
+#ifndef EDITOR_H
+#define EDITOR_H
+
+#include "common.h"
+
+enum { SEARCH_MAX_QUERY = 256 };
+enum { ANNOTATION_MAX = 160 };
+#define SEARCH_NOT_FOUND SIZE_MAX
+enum { UNDO_CHUNK_SIZE = 64 * 1024, UNDO_DEFAULT_MEMORY_LIMIT = 16 * ONE_MB, UNDO_COALESCE_MAX = 256 };
+
+typedef enum Edit_Kind {
+    EDIT_INSERT,
+    EDIT_DELETE,
+    EDIT_REPLACE // Every match of a query replaced, see Replace_Payload
+} Edit_Kind;
+
+typedef struct Undo_Chunk {
+    struct Undo_Chunk *prev, *next;
+    size_t capacity;
+    size_t used;
+    _Alignas(16) uint8_t bytes[];
+} Undo_Chunk;
+
+// One insert, delete or replace. The affected bytes follow the header in the same allocation.
+typedef struct Edit_Record {
+    struct Edit_Record *prev, *next; // Chronological
+    Undo_Chunk *chunk;
+    Edit_Kind kind;
+    uint32_t group; // Consecutive records with the same group are undone together
+    size_t pos;
+    size_t len;
+    size_t cursor_before;
+    char bytes[];
+} Edit_Record;
+
+// The bytes of an EDIT_REPLACE record. Only the matches are kept, not the text between them:
+// match offsets in the text before the replace, then the query and the replacement bytes.
+typedef struct Replace_Payload {
+    size_t match_count;
+    size_t query_len;
+    size_t replacement_len;
+    size_t matches[];
+} Replace_Payload;
+
+// Operation log in a chunked arena. Records after `applied` are the redo history.
+// When total_bytes exceeds memory_limit, the oldest whole groups are dropped, chunk by chunk.
+// Memory grows with the text edited, not the file size. Undo and redo still pay the flat buffer's memmove per record.
+typedef struct Undo_Log {
+    Undo_Chunk *first_chunk, *last_chunk;
+    size_t total_bytes;
+    size_t memory_limit;
+
+    Edit_Record *oldest;
+    Edit_Record *newest;
+    Edit_Record *applied; // NULL when everything is undone
+
+    uint32_t next_group;
+    uint32_t current_group;
+    bool group_open;
+    bool coalesce_open; // The next edit may extend `applied` instead of adding a record
+} Undo_Log;
+
+typedef enum Syntax_Color {
+    SYNTAX_DEFAULT,
+    SYNTAX_KEYWORD,
+    SYNTAX_TYPE,
+    SYNTAX_NUMBER,
+    SYNTAX_STRING,
+    SYNTAX_COMMENT,
+    SYNTAX_PREPROC,
+    SYNTAX_PUNCT,
+    SYNTAX_COLOR_COUNT
+} Syntax_Color;
+
+// Lexer state at a line start. The preprocessor flag combines with any mode,
+// e.g. a block comment that starts inside a #define.
+typedef enum Lex_State {
+    LEX_NORMAL,
+    LEX_BLOCK_COMMENT,
+    LEX_LINE_COMMENT, // Only continues past an escaped newline
+    LEX_STRING,
+    LEX_CHAR,
+    LEX_PREPROC_FLAG = 0x80
+} Lex_State;
+
+typedef struct Syntax_Line {
+    size_t start;
+    uint8_t start_state;
+    uint32_t id; // New whenever the line's bytes change, keys per-line caches like the layout
+} Syntax_Line;
+
+// Per-byte color classes, kept in step with text_buffer, plus the lexer state at every line start.
+// syntax_update re-lexes from the first dirty line until the state converges.
+// Both arrays are gap buffers with the gap at the last edit, so an edit costs the lines it touches plus
+// the distance from the previous edit, not the size of the file. Read them through the functions below.
+typedef struct Syntax_State {
+    uint8_t *colors; // One byte longer than the text, byte i is at i + (color_gap_end - color_gap_start) past the gap
+    size_t colors_cap;
+    size_t color_gap_start;
+    size_t color_gap_end;
+
+    Syntax_Line *lines;
+    size_t line_count;
+    size_t line_cap;
+    size_t line_gap;        // Index of the first line stored after the gap
+    size_t line_tail_shift; // Added to the stored start of every line after the gap, wraps when negative
+    uint32_t next_line_id;
+
+    bool has_dirty;
+    size_t dirty_line;
+    size_t dirty_end; // Re-lexing can't stop before this offset
+} Syntax_State;
+
+typedef enum Input_Mode {
+    INPUT_MODE_EDIT,
+    INPUT_MODE_SEARCH,  // Typing edits the query
+    INPUT_MODE_REPLACE  // Typing edits the replacement
+} Input_Mode;
+
+typedef struct Search_State {
+    Input_Mode mode;
+    char query[SEARCH_MAX_QUERY];
+    size_t query_len;
+    char replacement[SEARCH_MAX_QUERY];
+    size_t replacement_len;
+    size_t origin; // Cursor when the search started
+    size_t match_pos;
+    bool has_match;
+} Search_State;
+
+typedef struct Text_Edit_State {
+    char *text_buffer; // Null terminated at used_size
+    size_t text_capacity;
+    size_t text_buffer_cursor;
+    size_t used_size;
+    const char *file_name;
+    uint32_t save_count; // Bumped when an explicit save lands, the view flashes a notice on change
+    float zoom;
+
+    uint64_t edit_version; // Bumped on every buffer change
+    uint64_t saved_version;
+    uint64_t autosaved_version;
+    double last_autosave_ms;
+
+    Undo_Log undo;
+    Syntax_State syntax;
+    Search_State search;
+    size_t scroll_line;
+    size_t scroll_row; // First wrapped row of scroll_line on screen
+
+    // The selection runs between mark and the cursor. Edits move the mark along with the text.
+    size_t mark;
+    bool has_mark;
+
+    // One line of text shown after annotation_pos, e.g. an evaluation result.
+    // Only shown while edit_version is still annotation_version.
+    char annotation[ANNOTATION_MAX];
+    size_t annotation_pos;
+    uint64_t annotation_version;
+} Text_Edit_State;
+
+// One user-level editing step. These are what --record writes and the replay harness plays back.
+typedef enum Edit_Op_Kind {
+    EDIT_OP_CHAR,      // arg: codepoint
+    EDIT_OP_BACKSPACE,
+    EDIT_OP_LEFT,
+    EDIT_OP_RIGHT,
+    EDIT_OP_UNDO,
+    EDIT_OP_REDO,
+    EDIT_OP_CURSOR,    // arg: byte offset, clamped to the text
+    EDIT_OP_COUNT
+} Edit_Op_Kind;
+
+typedef struct Edit_Op {
+    Edit_Op_Kind kind;
+    uint64_t arg;
+} Edit_Op;
+
+void editor_init(Text_Edit_State *state, size_t undo_memory_limit);
+void editor_free(Text_Edit_State *state);
+void editor_set_text(Text_Edit_State *state, const char *bytes, size_t size);
+
+void buffer_insert(Text_Edit_State *state, size_t pos, const char *bytes, size_t len);
+void buffer_delete(Text_Edit_State *state, size_t pos, size_t len);
+void edit_insert(Text_Edit_State *state, size_t pos, const char *bytes, size_t len);
+void edit_delete(Text_Edit_State *state, size_t pos, size_t len);
+
+void handle_input_char(Text_Edit_State *state, uint32_t c);
+void handle_backspace_char(Text_Edit_State *state);
+void advance_cursor(Text_Edit_State *state, bool forward);
+
+void apply_edit_op(Text_Edit_State *state, Edit_Op op);
+const char *edit_op_name(Edit_Op_Kind kind);
+int format_edit_op(Edit_Op op, char *out, size_t out_size);
+bool parse_edit_op(const char *line, Edit_Op *out);
+
+void undo_init(Undo_Log *log, size_t memory_limit);
+void undo_free(Undo_Log *log);
+void undo_break_coalescing(Undo_Log *log);
+void undo_begin_group(Undo_Log *log);
+void undo_end_group(Undo_Log *log);
+void undo_record(Undo_Log *log, Edit_Kind kind, size_t pos, const char *bytes, size_t len, size_t cursor_before);
+void undo_record_replace(Undo_Log *log, const size_t *matches, size_t match_count, const char *query, size_t query_len,
+                         const char *replacement, size_t replacement_len, size_t cursor_before);
+bool undo(Text_Edit_State *state);
+bool redo(Text_Edit_State *state);
+void syntax_reset(Syntax_State *syntax, size_t text_size);
+void syntax_on_insert(Syntax_State *syntax, size_t pos, size_t len);
+void syntax_on_delete(Syntax_State *syntax, size_t pos, size_t len);
+void syntax_update(Syntax_State *syntax, const char *text, size_t text_size);
+size_t syntax_find_line(const Syntax_State *syntax, size_t pos);
+size_t syntax_line_start(const Syntax_State *syntax, size_t line);
+uint32_t syntax_line_id(const Syntax_State *syntax, size_t line);
+void syntax_copy_colors(const Syntax_State *syntax, size_t pos, size_t len, uint8_t *out);
+
+size_t find_bytes(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len);
+void search_begin(Text_Edit_State *state);
+void search_find_next(Text_Edit_State *state);
+void search_input_char(Text_Edit_State *state, uint32_t codepoint);
+void search_backspace(Text_Edit_State *state);
+size_t search_visible_matches(Text_Edit_State *state, size_t start, size_t end, Text_Range *out, size_t max_count);
+size_t replace_all(Text_Edit_State *state, const char *query, size_t query_len, const char *replacement, size_t replacement_len);
+
+void set_annotation(Text_Edit_State *state, size_t pos, uint64_t version, const char *text);
+
+void save_file(Text_Edit_State *state);
+void try_load_file(Text_Edit_State *state);
+
+void start_save_worker(Text_Edit_State *state);
+void stop_save_worker(Text_Edit_State *state);
+void poll_save_results(Text_Edit_State *state);
+// Copies the next chunk of the buffer for any save in progress and hands finished copies to the worker.
+// Returns true while there is more to copy, the caller should come back soon.
+bool save_snapshot_step(Text_Edit_State *state);
+void maybe_autosave(Text_Edit_State *state);
+bool write_file_atomic(const char *file_name, const char *bytes, size_t size, char *error, size_t error_size);
+
+#endif
@@ -0,0 +1,371 @@
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "editor_thread.h"
+#include "eval.h"
+#include "extension.h"
+
+// Without input the editor thread still wakes up this often, for save results and autosave
+enum { EDITOR_IDLE_WAKEUP_MS = 50 };
+// Under a flood of commands a snapshot still goes out at least this often
+enum { EDITOR_MAX_DRAIN_MS = 8 };
+#define SNAPSHOT_FRESH 4u
+
+// Single producer (render thread), single consumer (editor thread).
+// Each index is only written by one side, so acquire/release on the indices is all the sync there is.
+typedef struct Command_Queue {
+    Editor_Command commands[EDITOR_QUEUE_CAPACITY];
+    _Alignas(64) atomic_size_t head; // Next to read, written by the editor thread
+    _Alignas(64) atomic_size_t tail; // Next to write, written by the render thread
+} Command_Queue;
+
+// Triple buffer. The editor thread fills `back`, then swaps it into `middle` marked fresh.
+// The render thread swaps a fresh `middle` with `front`. Neither side ever waits for the other,
+// and the snapshot being drawn is never written to.
+typedef struct Snapshot_Exchange {
+    Render_Snapshot slots[3];
+    atomic_uint middle; // Slot index, | SNAPSHOT_FRESH until the render thread picks it up
+    unsigned back;      // Editor thread only
+    unsigned front;     // Render thread only
+} Snapshot_Exchange;
+
+typedef struct Editor_Thread {
+    pthread_t thread;
+    sem_t wakeup; // Posted once per pushed command
+    Command_Queue queue;
+    Snapshot_Exchange snapshots;
+    atomic_bool quit_requested;
+
+    // Only for editor_thread_wait_snapshot to sleep on, the exchange itself stays lock-free
+    pthread_mutex_t publish_mutex;
+    pthread_cond_t published;
+
+    // Owned by the editor thread while it runs
+    Text_Edit_State *state;
+    FILE *record_file;
+    Layout_Cache layout;
+    float goal_x; // Column kept across a run of vertical moves, negative when there is none
+    uint64_t eval_hash; // Program whose result goes into the annotation when it arrives
+} Editor_Thread;
+
+static Editor_Thread g_editor_thread;
+
+// Absolute CLOCK_REALTIME time ms from now, for the timed waits
+static struct timespec deadline_after_ms(double ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    long long ns = deadline.tv_nsec + (long long)(ms * 1000000.0);
+    deadline.tv_sec += ns / 1000000000LL;
+    deadline.tv_nsec = ns % 1000000000LL;
+    return deadline;
+}
+
+static bool queue_pop(Command_Queue *queue, Editor_Command *out) {
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&queue->tail, memory_order_acquire)) return false;
+    *out = queue->commands[head & (EDITOR_QUEUE_CAPACITY - 1)];
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return true;
+}
+
+uint64_t editor_thread_push(Editor_Command command) {
+    Command_Queue *queue = &g_editor_thread.queue;
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    while (tail - atomic_load_explicit(&queue->head, memory_order_acquire) == EDITOR_QUEUE_CAPACITY) {
+        // NOTE: Only when the editor is a full queue of keystrokes behind. Dropping input would be worse.
+        sched_yield();
+    }
+    queue->commands[tail & (EDITOR_QUEUE_CAPACITY - 1)] = command;
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    sem_post(&g_editor_thread.wakeup);
+    return tail;
+}
+
+static void publish_snapshot(Editor_Thread *thread) {
+    Snapshot_Exchange *exchange = &thread->snapshots;
+    view_build_snapshot(&exchange->slots[exchange->back], thread->state, &thread->layout);
+    extensions_fill_snapshot(&exchange->slots[exchange->back], &thread->layout);
+    exchange->slots[exchange->back].applied_commands = atomic_load_explicit(&thread->queue.head, memory_order_relaxed);
+    unsigned previous = atomic_exchange_explicit(&exchange->middle, exchange->back | SNAPSHOT_FRESH, memory_order_acq_rel);
+    exchange->back = previous & ~SNAPSHOT_FRESH;
+
+    pthread_mutex_lock(&thread->publish_mutex);
+    pthread_cond_signal(&thread->published);
+    pthread_mutex_unlock(&thread->publish_mutex);
+}
+
+const Render_Snapshot *editor_thread_latest_snapshot() {
+    Snapshot_Exchange *exchange = &g_editor_thread.snapshots;
+    if (atomic_load_explicit(&exchange->middle, memory_order_relaxed) & SNAPSHOT_FRESH) {
+        unsigned previous = atomic_exchange_explicit(&exchange->middle, exchange->front, memory_order_acq_rel);
+        exchange->front = previous & ~SNAPSHOT_FRESH;
+    }
+    return &exchange->slots[exchange->front];
+}
+
+// NOTE: The snapshot is checked with publish_mutex held and publish_snapshot signals under it after the swap,
+//       so a snapshot published between the check and the wait still wakes it.
+const Render_Snapshot *editor_thread_wait_snapshot(uint64_t applied_commands, double timeout_ms) {
+    Editor_Thread *thread = &g_editor_thread;
+    double begin_ms = get_time_ms();
+    struct timespec deadline = deadline_after_ms(timeout_ms);
+
+    pthread_mutex_lock(&thread->publish_mutex);
+    const Render_Snapshot *snapshot = editor_thread_latest_snapshot();
+    while (snapshot->applied_commands < applied_commands && get_time_ms() - begin_ms < timeout_ms) {
+        pthread_cond_timedwait(&thread->published, &thread->publish_mutex, &deadline);
+        snapshot = editor_thread_latest_snapshot();
+    }
+    pthread_mutex_unlock(&thread->publish_mutex);
+    return snapshot;
+}
+
+bool editor_thread_quit_requested() {
+    return atomic_load_explicit(&g_editor_thread.quit_requested, memory_order_relaxed);
+}
+
+void editor_thread_wake() {
+    sem_post(&g_editor_thread.wakeup);
+}
+
+static void do_edit_op(Editor_Thread *thread, Edit_Op_Kind kind, uint64_t arg) {
+    Edit_Op op = { kind, arg };
+    if (thread->record_file) {
+        char line[64];
+        format_edit_op(op, line, sizeof(line));
+        fprintf(thread->record_file, "%s\n", line);
+    }
+    apply_edit_op(thread->state, op);
+}
+
+// Returns true if the command was consumed by the search prompt
+static bool handle_search_command(Editor_Thread *thread, Editor_Command command) {
+    Text_Edit_State *state = thread->state;
+    Search_State *search = &state->search;
+    if (search->mode == INPUT_MODE_EDIT) return false;
+
+    switch (command.kind) {
+        case EDITOR_COMMAND_CHAR:      search_input_char(state, command.codepoint); break;
+        case EDITOR_COMMAND_ESCAPE:    search->mode = INPUT_MODE_EDIT; break;
+        case EDITOR_COMMAND_BACKSPACE: search_backspace(state); break;
+        case EDITOR_COMMAND_REPLACE:   search->mode = INPUT_MODE_REPLACE; break;
+        case EDITOR_COMMAND_SAVE: {
+            save_file(state);
+            extensions_on_save();
+        } break;
+        case EDITOR_COMMAND_ENTER: {
+            if (search->mode == INPUT_MODE_REPLACE) {
+                size_t count = replace_all(state, search->query, search->query_len, search->replacement, search->replacement_len);
+                trace_log("Replaced %zu occurrences of \"%s\"", count, search->query);
+                search->mode = INPUT_MODE_EDIT;
+            } else {
+                search_find_next(state);
+            }
+        } break;
+        case EDITOR_COMMAND_FIND:
+        case EDITOR_COMMAND_FIND_NEXT: search_find_next(state); break;
+        case EDITOR_COMMAND_CLICK: {
+            // Clicking into the text leaves the prompt and places the cursor
+            search->mode = INPUT_MODE_EDIT;
+            return false;
+        }
+        default: break;
+    }
+    return true;
+}
+
+static void evaluate_region(Editor_Thread *thread) {
+    Text_Edit_State *state = thread->state;
+    size_t cursor = state->text_buffer_cursor;
+
+    Text_Range region;
+    if (state->has_mark && state->mark != cursor) {
+        region.start = state->mark < cursor ? state->mark : cursor;
+        region.end = state->mark < cursor ? cursor : state->mark;
+    } else if (!eval_find_function(state->text_buffer, state->used_size, cursor, &region)) {
+        set_annotation(state, cursor, state->edit_version, "nothing to evaluate here, select a region first");
+        return;
+    }
+
+    syntax_update(&state->syntax, state->text_buffer, state->used_size);
+    size_t first_line = syntax_find_line(&state->syntax, region.start);
+    char *program = eval_build_program(state->text_buffer, state->used_size, region, first_line);
+    uint64_t hash = hash_bytes(program, strlen(program));
+
+    const Eval_Result *cached = eval_cache_find(hash);
+    if (cached) {
+        free(program);
+        set_annotation(state, region.end, state->edit_version, cached->text);
+        thread->eval_hash = 0;
+        return;
+    }
+    thread->eval_hash = hash;
+    eval_submit(program, hash);
+    set_annotation(state, region.end, state->edit_version, "evaluating...");
+}
+
+// Returns true when the annotation changed
+static bool poll_eval_results(Editor_Thread *thread) {
+    Text_Edit_State *state = thread->state;
+    bool changed = false;
+    Eval_Result result;
+    while (eval_poll(&result)) {
+        eval_cache_store(&result);
+        if (result.hash == thread->eval_hash) {
+            // An edit since submitting keeps it hidden, the result belongs to the old text
+            set_annotation(state, state->annotation_pos, state->annotation_version, result.text);
+            size_t len = strlen(state->annotation);
+            snprintf(state->annotation + len, ANNOTATION_MAX - len, "  (%.1f ms)", result.ms);
+            thread->eval_hash = 0;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+static void handle_command(Editor_Thread *thread, Editor_Command command) {
+    Text_Edit_State *state = thread->state;
+
+    if (command.kind == EDITOR_COMMAND_RESIZE) {
+        layout_resize(&thread->layout, command.width, command.height);
+        return;
+    }
+    if (command.kind != EDITOR_COMMAND_UP && command.kind != EDITOR_COMMAND_DOWN) {
+        thread->goal_x = -1.0f;
+    }
+
+    if (handle_search_command(thread, command)) return;
+
+    switch (command.kind) {
+        case EDITOR_COMMAND_CHAR:       do_edit_op(thread, EDIT_OP_CHAR, command.codepoint); break;
+        case EDITOR_COMMAND_ENTER:      do_edit_op(thread, EDIT_OP_CHAR, '\n'); break;
+        case EDITOR_COMMAND_BACKSPACE:  do_edit_op(thread, EDIT_OP_BACKSPACE, 0); break;
+        case EDITOR_COMMAND_LEFT:       do_edit_op(thread, EDIT_OP_LEFT, 0); break;
+        case EDITOR_COMMAND_RIGHT:      do_edit_op(thread, EDIT_OP_RIGHT, 0); break;
+        case EDITOR_COMMAND_UP:
+        case EDITOR_COMMAND_DOWN: {
+            int direction = command.kind == EDITOR_COMMAND_UP ? -1 : 1;
+            size_t pos = layout_move_vertical(&thread->layout, state, direction, &thread->goal_x);
+            do_edit_op(thread, EDIT_OP_CURSOR, pos);
+        } break;
+        case EDITOR_COMMAND_CLICK: {
+            size_t pos = layout_hit_test(&thread->layout, state, command.x, command.y);
+            do_edit_op(thread, EDIT_OP_CURSOR, pos);
+        } break;
+        case EDITOR_COMMAND_UNDO:       do_edit_op(thread, EDIT_OP_UNDO, 0); break;
+        case EDITOR_COMMAND_REDO:       do_edit_op(thread, EDIT_OP_REDO, 0); break;
+        case EDITOR_COMMAND_SAVE: {
+            save_file(state);
+            extensions_on_save();
+        } break;
+        case EDITOR_COMMAND_FIND:       search_begin(state); break;
+        case EDITOR_COMMAND_ZOOM_IN:    state->zoom = glm_min(state->zoom * 1.1f, 8.0f); break;
+        case EDITOR_COMMAND_ZOOM_OUT:   state->zoom = glm_max(state->zoom / 1.1f, 0.25f); break;
+        case EDITOR_COMMAND_ZOOM_RESET: state->zoom = 1.0f; break;
+        case EDITOR_COMMAND_MARK: {
+            state->has_mark = !state->has_mark;
+            state->mark = state->text_buffer_cursor;
+        } break;
+        case EDITOR_COMMAND_EVAL:       evaluate_region(thread); break;
+        case EDITOR_COMMAND_KEY:        extensions_handle_key(command.key, command.mods); break;
+        case EDITOR_COMMAND_ESCAPE: {
+            trace_log("Received ESC. Terminating...");
+            atomic_store_explicit(&thread->quit_requested, true, memory_order_relaxed);
+        } break;
+        default: break;
+    }
+}
+
+static void *editor_thread_proc(void *arg) {
+    Editor_Thread *thread = arg;
+    Text_Edit_State *state = thread->state;
+
+    for (;;) {
+        struct timespec deadline = deadline_after_ms(EDITOR_IDLE_WAKEUP_MS);
+        while (sem_timedwait(&thread->wakeup, &deadline) == -1 && errno == EINTR) {}
+
+        // NOTE: Everything queued is applied before the next snapshot, so a burst of input costs one snapshot.
+        //       Whatever is left after the time limit is picked up right away, its posts are still on the semaphore.
+        bool quit = false;
+        bool changed = false;
+        double drain_begin_ms = get_time_ms();
+        Editor_Command command;
+        while (get_time_ms() - drain_begin_ms < EDITOR_MAX_DRAIN_MS && queue_pop(&thread->queue, &command)) {
+            if (command.kind == EDITOR_COMMAND_QUIT) {
+                quit = true;
+                break;
+            }
+            handle_command(thread, command);
+            changed = true;
+        }
+        if (quit) break;
+
+        uint32_t save_count = state->save_count;
+        poll_save_results(state);
+        maybe_autosave(state);
+        // NOTE: Input in between chunks is still handled first
+        if (save_snapshot_step(state)) editor_thread_wake();
+        if (poll_eval_results(thread)) changed = true;
+        if (extensions_poll()) changed = true;
+        if (changed || state->save_count != save_count) {
+            publish_snapshot(thread);
+        }
+    }
+
+    return NULL;
+}
+
+void editor_thread_start(Text_Edit_State *state, const Font *font, int width, int height, bool wrap, FILE *record_file,
+                         const char *extension_dir) {
+    Editor_Thread *thread = &g_editor_thread;
+    thread->state = state;
+    thread->record_file = record_file;
+    thread->goal_x = -1.0f;
+    layout_init(&thread->layout, font, wrap);
+    layout_resize(&thread->layout, width, height);
+    atomic_init(&thread->queue.head, 0);
+    atomic_init(&thread->queue.tail, 0);
+    atomic_init(&thread->quit_requested, false);
+
+    if (sem_init(&thread->wakeup, 0, 0) != 0) {
+        exit_with_error("Failed to create editor thread semaphore");
+    }
+    pthread_mutex_init(&thread->publish_mutex, NULL);
+    pthread_cond_init(&thread->published, NULL);
+    start_eval_worker(editor_thread_wake);
+    extensions_init(state, editor_thread_wake);
+    if (extension_dir) extensions_load_dir(extension_dir);
+
+    Snapshot_Exchange *exchange = &thread->snapshots;
+    view_build_snapshot(&exchange->slots[0], state, &thread->layout);
+    exchange->front = 0;
+    atomic_init(&exchange->middle, 1);
+    exchange->back = 2;
+
+    if (pthread_create(&thread->thread, NULL, editor_thread_proc, thread) != 0) {
+        exit_with_error("Failed to start editor thread");
+    }
+}
+
+// Commands pushed before this are still applied. The state belongs to the caller again afterwards.
+void editor_thread_stop() {
+    Editor_Thread *thread = &g_editor_thread;
+    editor_thread_push((Editor_Command){ .kind = EDITOR_COMMAND_QUIT });
+    pthread_join(thread->thread, NULL);
+    extensions_shutdown();
+    stop_eval_worker();
+    sem_destroy(&thread->wakeup);
+    pthread_mutex_destroy(&thread->publish_mutex);
+    pthread_cond_destroy(&thread->published);
+
+    for (int i = 0; i < 3; i++) {
+        render_snapshot_free(&thread->snapshots.slots[i]);
+    }
+    layout_free(&thread->layout);
+}
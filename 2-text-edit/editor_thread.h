@@ -0,0 +1,65 @@
+#ifndef EDITOR_THREAD_H
+#define EDITOR_THREAD_H
+
+#include <stdio.h>
+
+#include "common.h"
+#include "editor.h"
+#include "view.h"
+
+enum { EDITOR_QUEUE_CAPACITY = 1024 }; // Power of two
+
+// What the render thread sends to the editor thread. Keys arrive already translated,
+// so the editor thread never sees GLFW and decides search vs edit routing itself.
+typedef enum Editor_Command_Kind {
+    EDITOR_COMMAND_CHAR,      // codepoint
+    EDITOR_COMMAND_ENTER,
+    EDITOR_COMMAND_BACKSPACE,
+    EDITOR_COMMAND_LEFT,
+    EDITOR_COMMAND_RIGHT,
+    EDITOR_COMMAND_UP,
+    EDITOR_COMMAND_DOWN,
+    EDITOR_COMMAND_CLICK,     // x, y in window pixels
+    EDITOR_COMMAND_ESCAPE,
+    EDITOR_COMMAND_UNDO,
+    EDITOR_COMMAND_REDO,
+    EDITOR_COMMAND_SAVE,
+    EDITOR_COMMAND_FIND,      // Ctrl+F: starts a search, or finds the next match while searching
+    EDITOR_COMMAND_FIND_NEXT, // F3
+    EDITOR_COMMAND_REPLACE,   // Ctrl+H while searching
+    EDITOR_COMMAND_ZOOM_IN,
+    EDITOR_COMMAND_ZOOM_OUT,
+    EDITOR_COMMAND_ZOOM_RESET,
+    EDITOR_COMMAND_MARK,      // Ctrl+Space: starts a selection at the cursor, or drops it
+    EDITOR_COMMAND_EVAL,      // Ctrl+E: evaluates the selection, or the function around the cursor
+    EDITOR_COMMAND_KEY,       // key, mods: one the editor has no use for, extensions may have bound it
+    EDITOR_COMMAND_RESIZE,    // width, height
+    EDITOR_COMMAND_QUIT
+} Editor_Command_Kind;
+
+typedef struct Editor_Command {
+    Editor_Command_Kind kind;
+    uint32_t codepoint;
+    int width, height;
+    float x, y;
+    int key, mods;
+} Editor_Command;
+
+// The editor thread owns `state` from start until stop returns. Edit ops it applies are appended to
+// record_file when one is given, vertical motion and clicks as cursor ops. The first snapshot is built before this returns.
+// It also runs the eval worker and the extensions, those in extension_dir are loaded unless it is NULL.
+void editor_thread_start(Text_Edit_State *state, const Font *font, int width, int height, bool wrap, FILE *record_file,
+                         const char *extension_dir);
+void editor_thread_stop();
+
+// Render thread only. Push never drops a command, it spins in the rare case the queue is full.
+// It returns the index of the command, snapshots count the commands applied before them in the same numbering.
+uint64_t editor_thread_push(Editor_Command command);
+const Render_Snapshot *editor_thread_latest_snapshot();
+// The latest snapshot once it has applied applied_commands commands, or whatever is latest after timeout_ms
+const Render_Snapshot *editor_thread_wait_snapshot(uint64_t applied_commands, double timeout_ms);
+bool editor_thread_quit_requested();
+// Any thread. Gets the editor thread to look at worker results right away instead of at its next idle wakeup.
+void editor_thread_wake();
+
+#endif
@@ -0,0 +1,576 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef USE_LIBTCC
+#include <libtcc.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#include "eval.h"
+
+// The child exits with this when the program does not compile
+enum { EVAL_EXIT_COMPILE_FAILED = 97 };
+// How often the worker checks on a child that closed its output but hasn't exited yet
+enum { EVAL_REAP_POLL_MS = 1 };
+
+typedef void (*Eval_Entry)(void);
+
+// Prints the value of any scalar through one call, picked by type
+static const char EVAL_PRELUDE[] =
+    "#include <stdio.h>\n"
+    "static void repl_print_int(long long x) { printf(\"=> %lld\\n\", x); }\n"
+    "static void repl_print_unsigned(unsigned long long x) { printf(\"=> %llu\\n\", x); }\n"
+    "static void repl_print_double(double x) { printf(\"=> %g\\n\", x); }\n"
+    "static void repl_print_char(char x) { printf(\"=> '%c'\\n\", x); }\n"
+    "static void repl_print_string(const char *x) { printf(\"=> \\\"%s\\\"\\n\", x); }\n"
+    "static void repl_print_pointer(const void *x) { printf(\"=> %p\\n\", x); }\n"
+    "#define REPL_PRINT(x) _Generic((x), \\\n"
+    "    char: repl_print_char, \\\n"
+    "    unsigned: repl_print_unsigned, unsigned long: repl_print_unsigned, unsigned long long: repl_print_unsigned, \\\n"
+    "    float: repl_print_double, double: repl_print_double, \\\n"
+    "    char *: repl_print_string, const char *: repl_print_string, \\\n"
+    "    void *: repl_print_pointer, const void *: repl_print_pointer, \\\n"
+    "    default: repl_print_int)(x)\n";
+
+typedef struct Eval_Job {
+    char *program; // Owned by the job
+    uint64_t hash;
+} Eval_Job;
+
+typedef struct Eval_Worker {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool quit;
+
+    Eval_Job pending;
+    bool has_pending;
+    pid_t running_pid; // 0 when no child is running
+    void (*wake)(void);
+
+    Eval_Result result; // Only the latest, an unpolled one is replaced
+    bool has_result;
+} Eval_Worker;
+
+typedef struct Eval_Cache {
+    Eval_Result entries[EVAL_CACHE_SIZE];
+    bool used[EVAL_CACHE_SIZE];
+    size_t next; // Replaced round robin once full
+} Eval_Cache;
+
+static Eval_Worker g_eval_worker;
+static Eval_Cache g_eval_cache;
+
+static bool is_ident_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static size_t line_start_before(const char *text, size_t pos) {
+    while (pos > 0 && text[pos - 1] != '\n') pos--;
+    return pos;
+}
+
+bool eval_find_function(const char *text, size_t size, size_t pos, Text_Range *out) {
+    if (size == 0) return false;
+    if (pos > size) pos = size;
+
+    // NOTE: The closing brace line of a function still belongs to it, so the search up starts above it
+    size_t start = line_start_before(text, pos);
+    if (text[start] == '}') {
+        if (start == 0) return false;
+        start = line_start_before(text, start - 1);
+    }
+    while (!is_ident_char(text[start])) {
+        if (text[start] == '}' || start == 0) return false; // Between definitions
+        start = line_start_before(text, start - 1);
+    }
+
+    for (size_t line = start; line < size;) {
+        const char *newline = memchr(text + line, '\n', size - line);
+        size_t line_end = newline ? (size_t)(newline - text) : size;
+        if (text[line] == '}') {
+            if (pos > line_end) return false;
+            out->start = start;
+            out->end = line_end;
+            return true;
+        }
+        line = line_end + 1;
+    }
+    return false;
+}
+
+typedef struct String_Builder {
+    char *data;
+    size_t len;
+    size_t cap;
+} String_Builder;
+
+static void builder_append(String_Builder *builder, const char *bytes, size_t len) {
+    if (builder->len + len + 1 > builder->cap) {
+        size_t new_cap = builder->cap ? builder->cap : 4096;
+        while (new_cap < builder->len + len + 1) new_cap *= 2;
+        builder->data = xrealloc(builder->data, new_cap);
+        builder->cap = new_cap;
+    }
+    memcpy(builder->data + builder->len, bytes, len);
+    builder->len += len;
+    builder->data[builder->len] = '\0';
+}
+
+static void builder_appendf(String_Builder *builder, const char *format, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (len > (int)sizeof(line) - 1) len = sizeof(line) - 1;
+    if (len > 0) builder_append(builder, line, len);
+}
+
+// Skips a string or character literal starting at i, returns the index after it
+static size_t skip_literal(const char *s, size_t len, size_t i) {
+    char quote = s[i++];
+    while (i < len && s[i] != quote && s[i] != '\n') {
+        if (s[i] == '\\' && i + 1 < len) i++;
+        i++;
+    }
+    return i < len ? i + 1 : len;
+}
+
+// The last `name(void) {` or `name() {` in s
+static bool find_entry_function(const char *s, size_t len, Text_Range *name, bool *returns_void) {
+    bool found = false;
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] == '"' || s[i] == '\'') {
+            i = skip_literal(s, len, i) - 1;
+            continue;
+        }
+        if (s[i] != '(') continue;
+
+        size_t j = i + 1;
+        while (j < len && is_space(s[j])) j++;
+        if (len - j >= 4 && memcmp(s + j, "void", 4) == 0) j += 4;
+        while (j < len && is_space(s[j])) j++;
+        if (j >= len || s[j] != ')') continue;
+        for (j++; j < len && is_space(s[j]); j++) {}
+        if (j >= len || s[j] != '{') continue;
+
+        size_t end = i;
+        while (end > 0 && is_space(s[end - 1])) end--;
+        size_t begin = end;
+        while (begin > 0 && is_ident_char(s[begin - 1])) begin--;
+        if (begin == end) continue;
+
+        // Returns nothing when the words in front of the name say void and there is no pointer
+        size_t header = line_start_before(s, begin);
+        bool says_void = false, has_pointer = false;
+        for (size_t k = header; k < begin; k++) {
+            if (s[k] == '*') has_pointer = true;
+            if (begin - k >= 4 && memcmp(s + k, "void", 4) == 0 &&
+                (k == header || !is_ident_char(s[k - 1])) && !is_ident_char(s[k + 4])) {
+                says_void = true;
+            }
+        }
+
+        *name = (Text_Range){ begin, end };
+        *returns_void = says_void && !has_pointer;
+        found = true;
+    }
+    return found;
+}
+
+char *eval_build_program(const char *text, size_t size, Text_Range region, size_t first_line) {
+    String_Builder builder = {0};
+    builder_append(&builder, EVAL_PRELUDE, sizeof(EVAL_PRELUDE) - 1);
+
+    // NOTE: The region usually needs the headers the file already includes, nothing else from the file is copied
+    size_t scan_end = region.start < EVAL_INCLUDE_SCAN_BYTES ? region.start : EVAL_INCLUDE_SCAN_BYTES;
+    for (size_t line = 0; line < scan_end;) {
+        const char *newline = memchr(text + line, '\n', size - line);
+        size_t line_end = newline ? (size_t)(newline - text) + 1 : size;
+        if (line_end - line > 8 && memcmp(text + line, "#include", 8) == 0) {
+            builder_append(&builder, text + line, line_end - line);
+            if (text[line_end - 1] != '\n') builder_append(&builder, "\n", 1);
+        }
+        line = line_end;
+    }
+
+    const char *region_text = text + region.start;
+    size_t region_len = region.end - region.start;
+    bool has_brace = false, has_semicolon = false;
+    for (size_t i = 0; i < region_len; i++) {
+        if (region_text[i] == '"' || region_text[i] == '\'') i = skip_literal(region_text, region_len, i) - 1;
+        else if (region_text[i] == '{') has_brace = true;
+        else if (region_text[i] == ';') has_semicolon = true;
+    }
+
+    // Compiler messages point at the buffer's own line numbers
+    if (has_brace) {
+        builder_appendf(&builder, "#line %zu \"buffer\"\n", first_line + 1);
+        builder_append(&builder, region_text, region_len);
+        builder_appendf(&builder, "\n#line 1 \"eval\"\nvoid repl_entry(void) {\n");
+
+        Text_Range name;
+        bool returns_void;
+        if (find_entry_function(region_text, region_len, &name, &returns_void)) {
+            const char *format = returns_void ? "    %.*s();\n" : "    REPL_PRINT(%.*s());\n";
+            builder_appendf(&builder, format, (int)(name.end - name.start), region_text + name.start);
+        } else {
+            builder_appendf(&builder, "    puts(\"compiled\");\n");
+        }
+    } else {
+        builder_appendf(&builder, "void repl_entry(void) {\n#line %zu \"buffer\"\n", first_line + 1);
+        if (has_semicolon) {
+            builder_append(&builder, region_text, region_len);
+            builder_append(&builder, "\n", 1);
+        } else {
+            builder_append(&builder, "REPL_PRINT((", 12);
+            builder_append(&builder, region_text, region_len);
+            builder_append(&builder, "\n));\n", 5);
+        }
+    }
+    builder_append(&builder, "}\n", 2);
+    return builder.data;
+}
+
+#ifdef USE_LIBTCC
+static void tcc_error_callback(void *opaque, const char *message) {
+    (void)opaque;
+    fprintf(stderr, "%s\n", message);
+}
+
+// Compiles into memory, nothing touches the disk
+static Eval_Entry compile_program(const char *program, const char *dir) {
+    (void)dir;
+    TCCState *tcc = tcc_new();
+    if (!tcc) return NULL;
+    tcc_set_error_func(tcc, NULL, tcc_error_callback);
+    tcc_set_options(tcc, "-w");
+    tcc_set_output_type(tcc, TCC_OUTPUT_MEMORY);
+    if (tcc_compile_string(tcc, program) < 0) return NULL;
+    tcc_add_library(tcc, "m");
+#ifdef TCC_RELOCATE_AUTO
+    if (tcc_relocate(tcc, TCC_RELOCATE_AUTO) < 0) return NULL;
+#else
+    if (tcc_relocate(tcc) < 0) return NULL;
+#endif
+    // NOTE: The state is never deleted, the child exits right after running the code it owns
+    return (Eval_Entry)tcc_get_symbol(tcc, "repl_entry");
+}
+#else
+// Without libtcc the system compiler builds a shared object in dir that is loaded back in.
+// Both files are removed as soon as they are loaded, dir itself by the parent, see remove_eval_dir.
+static Eval_Entry compile_program(const char *program, const char *dir) {
+    char source_path[128], object_path[128];
+    snprintf(source_path, sizeof(source_path), "%s/eval.c", dir);
+    snprintf(object_path, sizeof(object_path), "%s/eval.so", dir);
+
+    FILE *file = fopen(source_path, "wx");
+    if (!file) {
+        fprintf(stderr, "Failed to write %s: %s\n", source_path, strerror(errno));
+        return NULL;
+    }
+    fputs(program, file);
+    fclose(file);
+
+    char command[320];
+    snprintf(command, sizeof(command), "cc -w -shared -fPIC -o %s %s", object_path, source_path);
+    int status = system(command);
+    unlink(source_path);
+    if (status != 0) {
+        unlink(object_path);
+        return NULL;
+    }
+
+    void *library = dlopen(object_path, RTLD_NOW);
+    unlink(object_path);
+    if (!library) {
+        fprintf(stderr, "%s\n", dlerror());
+        return NULL;
+    }
+    return (Eval_Entry)dlsym(library, "repl_entry");
+}
+#endif
+
+// The child can be killed before it cleans up after itself
+static void remove_eval_dir(const char *dir) {
+    if (dir[0] == '\0') return;
+    char path[128];
+    snprintf(path, sizeof(path), "%s/eval.c", dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/eval.so", dir);
+    unlink(path);
+    rmdir(dir);
+}
+
+static void run_child(const char *program, const char *dir, int out_fd) {
+    // Reading input would only wait for the timeout
+    int null_fd = open("/dev/null", O_RDONLY);
+    if (null_fd >= 0) {
+        dup2(null_fd, STDIN_FILENO);
+        close(null_fd);
+    }
+    dup2(out_fd, STDOUT_FILENO);
+    dup2(out_fd, STDERR_FILENO);
+    close(out_fd);
+
+    Eval_Entry entry = compile_program(program, dir);
+    if (!entry) {
+        fflush(stderr);
+        _exit(EVAL_EXIT_COMPILE_FAILED);
+    }
+    entry();
+    fflush(stdout);
+    _exit(0);
+}
+
+static void eval_run(Eval_Worker *worker, const Eval_Job *job, Eval_Result *result) {
+    double begin_ms = get_time_ms();
+    result->hash = job->hash;
+    result->ok = false;
+    result->text[0] = '\0';
+
+    char dir[64] = "";
+#ifndef USE_LIBTCC
+    if (!make_private_temp_dir("text-edit-eval", dir, sizeof(dir))) {
+        snprintf(result->text, sizeof(result->text), "Failed to create a temporary directory: %s", strerror(errno));
+        return;
+    }
+#endif
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        snprintf(result->text, sizeof(result->text), "pipe failed: %s", strerror(errno));
+        remove_eval_dir(dir);
+        return;
+    }
+
+    // NOTE: Forking a threaded process only carries over this thread. The child sticks to what glibc
+    //       keeps usable after fork (malloc, stdio, system, dlopen) and never returns into the editor.
+    //       Flushing first keeps buffered output of other streams from being written twice by the child.
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        snprintf(result->text, sizeof(result->text), "fork failed: %s", strerror(errno));
+        remove_eval_dir(dir);
+        return;
+    }
+    // NOTE: The child gets its own process group, so a timeout also kills the compiler it started.
+    //       Both sides set it, whichever runs first.
+    if (pid == 0) {
+        setpgid(0, 0);
+        close(fds[0]);
+        run_child(job->program, dir, fds[1]);
+    }
+    setpgid(pid, pid);
+    close(fds[1]);
+
+    pthread_mutex_lock(&worker->mutex);
+    worker->running_pid = pid;
+    pthread_mutex_unlock(&worker->mutex);
+
+    // Output past the limit is read and dropped, so a chatty program never blocks on a full pipe
+    size_t used = 0;
+    bool timed_out = false;
+    for (;;) {
+        int remaining_ms = EVAL_TIMEOUT_MS - (int)(get_time_ms() - begin_ms);
+        if (remaining_ms <= 0) {
+            timed_out = true;
+            break;
+        }
+        struct pollfd poll_fd = { fds[0], POLLIN, 0 };
+        int ready = poll(&poll_fd, 1, remaining_ms);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready <= 0) {
+            timed_out = ready == 0;
+            break;
+        }
+
+        char chunk[1024];
+        ssize_t got = read(fds[0], chunk, sizeof(chunk));
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) break; // Every writer is gone, the child is done
+
+        size_t keep = sizeof(result->text) - 1 - used;
+        if ((size_t)got < keep) keep = (size_t)got;
+        memcpy(result->text + used, chunk, keep);
+        used += keep;
+    }
+    result->text[used] = '\0';
+    close(fds[0]);
+
+    // NOTE: EOF only means the child closed its output, it may still be running.
+    //       The deadline holds until it has exited.
+    int status = 0;
+    bool reaped = false;
+    while (!timed_out) {
+        pid_t done = waitpid(pid, &status, WNOHANG);
+        if (done == pid) {
+            reaped = true;
+            break;
+        }
+        if (done < 0 && errno != EINTR) break;
+        if (get_time_ms() - begin_ms >= EVAL_TIMEOUT_MS) {
+            timed_out = true;
+            break;
+        }
+        struct timespec pause = { 0, EVAL_REAP_POLL_MS * 1000000L };
+        nanosleep(&pause, NULL);
+    }
+    if (timed_out) kill(-pid, SIGKILL);
+    if (!reaped) {
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    }
+    remove_eval_dir(dir);
+
+    pthread_mutex_lock(&worker->mutex);
+    worker->running_pid = 0;
+    pthread_mutex_unlock(&worker->mutex);
+
+    result->ms = get_time_ms() - begin_ms;
+    char status_text[128] = "";
+    if (timed_out) {
+        snprintf(status_text, sizeof(status_text), "timed out after %d ms", EVAL_TIMEOUT_MS);
+    } else if (WIFSIGNALED(status)) {
+        snprintf(status_text, sizeof(status_text), "crashed: %s", strsignal(WTERMSIG(status)));
+    } else if (WEXITSTATUS(status) == EVAL_EXIT_COMPILE_FAILED) {
+        snprintf(status_text, sizeof(status_text), "compile error");
+    } else if (WEXITSTATUS(status) != 0) {
+        snprintf(status_text, sizeof(status_text), "exited with %d", WEXITSTATUS(status));
+    } else {
+        result->ok = true;
+    }
+
+    if (!result->ok) {
+        // The status goes first, the output may have been cut
+        if (used) strcat(status_text, ": ");
+        size_t prefix_len = strlen(status_text);
+        size_t keep = sizeof(result->text) - 1 - prefix_len;
+        if (used < keep) keep = used;
+        memmove(result->text + prefix_len, result->text, keep);
+        memcpy(result->text, status_text, prefix_len);
+        result->text[prefix_len + keep] = '\0';
+    }
+}
+
+static void *eval_worker_proc(void *arg) {
+    Eval_Worker *worker = arg;
+
+    pthread_mutex_lock(&worker->mutex);
+    for (;;) {
+        while (!worker->has_pending && !worker->quit) {
+            pthread_cond_wait(&worker->cond, &worker->mutex);
+        }
+        if (worker->quit) break;
+
+        Eval_Job job = worker->pending;
+        worker->has_pending = false;
+        pthread_mutex_unlock(&worker->mutex);
+
+        Eval_Result result;
+        eval_run(worker, &job, &result);
+        free(job.program);
+
+        pthread_mutex_lock(&worker->mutex);
+        worker->result = result;
+        worker->has_result = true;
+        pthread_mutex_unlock(&worker->mutex);
+        if (worker->wake) worker->wake();
+        pthread_mutex_lock(&worker->mutex);
+    }
+    pthread_mutex_unlock(&worker->mutex);
+
+    return NULL;
+}
+
+void start_eval_worker(void (*wake)(void)) {
+    Eval_Worker *worker = &g_eval_worker;
+    worker->quit = false;
+    worker->wake = wake;
+    pthread_mutex_init(&worker->mutex, NULL);
+    pthread_cond_init(&worker->cond, NULL);
+    if (pthread_create(&worker->thread, NULL, eval_worker_proc, worker) != 0) {
+        exit_with_error("Failed to start eval thread");
+    }
+}
+
+// A running evaluation is killed rather than waited for
+void stop_eval_worker() {
+    Eval_Worker *worker = &g_eval_worker;
+    pthread_mutex_lock(&worker->mutex);
+    worker->quit = true;
+    if (worker->running_pid > 0) kill(-worker->running_pid, SIGKILL);
+    pthread_cond_signal(&worker->cond);
+    pthread_mutex_unlock(&worker->mutex);
+    pthread_join(worker->thread, NULL);
+
+    if (worker->has_pending) {
+        free(worker->pending.program);
+        worker->has_pending = false;
+    }
+}
+
+void eval_submit(char *program, uint64_t hash) {
+    Eval_Worker *worker = &g_eval_worker;
+    pthread_mutex_lock(&worker->mutex);
+    if (worker->has_pending) {
+        // Superseded before the worker got to it
+        free(worker->pending.program);
+    }
+    worker->pending = (Eval_Job){ program, hash };
+    worker->has_pending = true;
+    pthread_cond_signal(&worker->cond);
+    pthread_mutex_unlock(&worker->mutex);
+}
+
+bool eval_poll(Eval_Result *out) {
+    Eval_Worker *worker = &g_eval_worker;
+    pthread_mutex_lock(&worker->mutex);
+    bool has_result = worker->has_result;
+    if (has_result) {
+        *out = worker->result;
+        worker->has_result = false;
+    }
+    pthread_mutex_unlock(&worker->mutex);
+    return has_result;
+}
+
+const Eval_Result *eval_cache_find(uint64_t hash) {
+    Eval_Cache *cache = &g_eval_cache;
+    for (size_t i = 0; i < EVAL_CACHE_SIZE; i++) {
+        if (cache->used[i] && cache->entries[i].hash == hash) return &cache->entries[i];
+    }
+    return NULL;
+}
+
+void eval_cache_store(const Eval_Result *result) {
+    if (!result->ok) return;
+
+    Eval_Cache *cache = &g_eval_cache;
+    for (size_t i = 0; i < EVAL_CACHE_SIZE; i++) {
+        if (cache->used[i] && cache->entries[i].hash == result->hash) {
+            cache->entries[i] = *result;
+            return;
+        }
+    }
+    cache->entries[cache->next] = *result;
+    cache->used[cache->next] = true;
+    cache->next = (cache->next + 1) % EVAL_CACHE_SIZE;
+}
@@ -0,0 +1,41 @@
+#ifndef EVAL_H
+#define EVAL_H
+
+#include "common.h"
+
+enum { EVAL_TIMEOUT_MS = 2000, EVAL_OUTPUT_MAX = 2048, EVAL_CACHE_SIZE = 64 };
+// Only the top of the buffer is searched for #include lines to copy into the program
+enum { EVAL_INCLUDE_SCAN_BYTES = 64 * 1024 };
+
+typedef struct Eval_Result {
+    uint64_t hash; // Of the program that was run
+    bool ok;       // Compiled, ran and exited normally
+    double ms;     // Compile and run, as seen from the worker
+    char text[EVAL_OUTPUT_MAX]; // What the program printed, ending in "=> value", or why it failed
+} Eval_Result;
+
+// The top-level definition around pos: from a line starting with an identifier at column 0
+// through the next line starting with '}'. Written for how C in this repo is laid out, not a parser.
+bool eval_find_function(const char *text, size_t size, size_t pos, Text_Range *out);
+
+// Wraps a region of the buffer into a program with an entry point that prints the region's value.
+// A region with braces is copied to file scope and its last function taking no arguments is called,
+// one with semicolons is run as statements and anything else is an expression.
+// first_line is the region's line in the buffer, for compiler messages. Returns a malloc'ed string.
+char *eval_build_program(const char *text, size_t size, Text_Range region, size_t first_line);
+
+// The worker compiles and runs one program at a time in a child process, killed after EVAL_TIMEOUT_MS.
+// A newer submit replaces an unstarted one. The program is owned by the worker afterwards.
+// wake is called from the worker whenever a result is ready to poll.
+void start_eval_worker(void (*wake)(void));
+void stop_eval_worker();
+void eval_submit(char *program, uint64_t hash);
+bool eval_poll(Eval_Result *out);
+
+// Results by program hash, so evaluating unchanged code again is answered right away.
+// Only successful results are kept, a compile error or a timeout may not happen again.
+// Only for whoever submits, the worker never touches it.
+const Eval_Result *eval_cache_find(uint64_t hash);
+void eval_cache_store(const Eval_Result *result);
+
+#endif
@@ -0,0 +1,660 @@
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef USE_LIBTCC
+#include <libtcc.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#include "extension.h"
+#include "extension_api.h"
+
+_Static_assert((int)TEXT_EDIT_COLOR_COUNT == (int)SYNTAX_COLOR_COUNT, "extension colors must match the syntax colors");
+_Static_assert(SYNTAX_COLOR_COUNT <= 32, "palette_mask has a bit per color");
+
+enum { EXTENSION_ERROR_MAX = 1024 };
+
+typedef void (*Extension_Load_Fn)(const Text_Edit_Api *api, void *state, bool reloaded);
+typedef void (*Extension_Unload_Fn)(const Text_Edit_Api *api, void *state);
+
+typedef struct Extension_Binding {
+    int key, mods;
+    Text_Edit_Key_Fn fn;
+} Extension_Binding;
+
+typedef struct Extension {
+    char name[EXTENSION_NAME_MAX]; // The source file name without directory and .c
+    void *handle;                  // Library, or TCCState with TCC=1
+    Extension_Unload_Fn unload;
+
+    void *state; // Kept across reloads
+    uint32_t state_size;
+
+    // Registered by the current build, dropped before the next one loads
+    Extension_Binding bindings[EXTENSION_MAX_BINDINGS];
+    size_t binding_count;
+    Text_Edit_Draw_Fn draw;
+    uint32_t palette_mask;
+    vec4 palette[SYNTAX_COLOR_COUNT];
+} Extension;
+
+typedef struct Extension_Build {
+    char name[EXTENSION_NAME_MAX];
+    char *source;       // Owned by the build until it is compiled
+    double request_ms;  // For the save to active time
+    bool from_save;
+    bool ok;
+    void *handle;
+    char error[EXTENSION_ERROR_MAX];
+} Extension_Build;
+
+// Compiling takes tens of milliseconds, far too long for the editor thread.
+// At most one build per extension is pending, a newer source replaces an unstarted one.
+typedef struct Extension_Builder {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool quit;
+    void (*wake)(void);
+
+    Extension_Build pending[EXTENSION_MAX];
+    size_t pending_count;
+    Extension_Build done[EXTENSION_MAX];
+    size_t done_count;
+} Extension_Builder;
+
+typedef struct Extension_Host {
+    Text_Edit_State *state;
+    Text_Edit_Api api;
+    Extension extensions[EXTENSION_MAX];
+    size_t extension_count;
+
+    Extension *current;        // Whose code is running, registrations go to it
+    Render_Snapshot *drawing;  // Set while draw hooks run
+    Extension_Builder builder;
+} Extension_Host;
+
+static Extension_Host g_extensions;
+
+static void close_handle(void *handle) {
+#ifdef USE_LIBTCC
+    tcc_delete(handle);
+#else
+    dlclose(handle);
+#endif
+}
+
+static void *find_symbol(void *handle, const char *name) {
+#ifdef USE_LIBTCC
+    return tcc_get_symbol(handle, name);
+#else
+    return dlsym(handle, name);
+#endif
+}
+
+#ifdef USE_LIBTCC
+static void tcc_error_callback(void *opaque, const char *message) {
+    Extension_Build *build = opaque;
+    size_t used = strlen(build->error);
+    snprintf(build->error + used, sizeof(build->error) - used, "%s\n", message);
+}
+
+static bool compile_extension(Extension_Builder *builder, Extension_Build *build) {
+    (void)builder;
+    TCCState *tcc = tcc_new();
+    if (!tcc) {
+        snprintf(build->error, sizeof(build->error), "Failed to create a compiler state");
+        return false;
+    }
+    tcc_set_error_func(tcc, build, tcc_error_callback);
+    // NOTE: Run from the source directory, like res/ and temp/, so extension_api.h is found there
+    tcc_add_include_path(tcc, ".");
+    tcc_set_output_type(tcc, TCC_OUTPUT_MEMORY);
+    bool ok = tcc_compile_string(tcc, build->source) >= 0;
+#ifdef TCC_RELOCATE_AUTO
+    ok = ok && tcc_relocate(tcc, TCC_RELOCATE_AUTO) >= 0;
+#else
+    ok = ok && tcc_relocate(tcc) >= 0;
+#endif
+    if (!ok) {
+        tcc_delete(tcc);
+        return false;
+    }
+    build->handle = tcc;
+    return true;
+}
+#else
+// Each build gets a fresh private directory, so dlopen never hands back an older library that had the same path
+// and nobody else can swap the files between the compiler writing them and dlopen reading them
+static bool compile_extension(Extension_Builder *builder, Extension_Build *build) {
+    (void)builder;
+    char dir[64];
+    if (!make_private_temp_dir("text-edit-ext", dir, sizeof(dir))) {
+        snprintf(build->error, sizeof(build->error), "Failed to create a temporary directory: %s", strerror(errno));
+        return false;
+    }
+    char source_path[96], object_path[96];
+    snprintf(source_path, sizeof(source_path), "%s/extension.c", dir);
+    snprintf(object_path, sizeof(object_path), "%s/extension.so", dir);
+
+    FILE *file = fopen(source_path, "wx");
+    if (!file) {
+        snprintf(build->error, sizeof(build->error), "Failed to write %s: %s", source_path, strerror(errno));
+        rmdir(dir);
+        return false;
+    }
+    fputs(build->source, file);
+    fclose(file);
+
+    // NOTE: Run from the source directory, like res/ and temp/, so extension_api.h is found there
+    char command[256];
+    snprintf(command, sizeof(command), "cc -shared -fPIC -O1 -I. -o %s %s 2>&1", object_path, source_path);
+    FILE *output = popen(command, "r");
+    if (!output) {
+        unlink(source_path);
+        rmdir(dir);
+        snprintf(build->error, sizeof(build->error), "Failed to run cc: %s", strerror(errno));
+        return false;
+    }
+    size_t used = fread(build->error, 1, sizeof(build->error) - 1, output);
+    build->error[used] = '\0';
+    while (fgetc(output) != EOF) {} // Keep the compiler from blocking on a full pipe
+    int status = pclose(output);
+    unlink(source_path);
+    if (status != 0) {
+        unlink(object_path);
+        rmdir(dir);
+        return false;
+    }
+
+    build->handle = dlopen(object_path, RTLD_NOW | RTLD_LOCAL);
+    unlink(object_path);
+    rmdir(dir);
+    if (!build->handle) {
+        snprintf(build->error, sizeof(build->error), "%s", dlerror());
+        return false;
+    }
+    return true;
+}
+#endif
+
+static void *extension_builder_proc(void *arg) {
+    Extension_Builder *builder = arg;
+
+    pthread_mutex_lock(&builder->mutex);
+    for (;;) {
+        while (builder->pending_count == 0 && !builder->quit) {
+            pthread_cond_wait(&builder->cond, &builder->mutex);
+        }
+        if (builder->quit) break;
+
+        Extension_Build build = builder->pending[0];
+        builder->pending_count--;
+        memmove(builder->pending, builder->pending + 1, builder->pending_count * sizeof(Extension_Build));
+        pthread_mutex_unlock(&builder->mutex);
+
+        build.error[0] = '\0';
+        build.handle = NULL;
+        build.ok = compile_extension(builder, &build);
+        free(build.source);
+        build.source = NULL;
+
+        pthread_mutex_lock(&builder->mutex);
+        if (builder->done_count == EXTENSION_MAX) {
+            // Only when the editor thread is not polling, the oldest build is dropped
+            if (builder->done[0].handle) close_handle(builder->done[0].handle);
+            builder->done_count--;
+            memmove(builder->done, builder->done + 1, builder->done_count * sizeof(Extension_Build));
+        }
+        builder->done[builder->done_count++] = build;
+        pthread_mutex_unlock(&builder->mutex);
+        if (builder->wake) builder->wake();
+        pthread_mutex_lock(&builder->mutex);
+    }
+    pthread_mutex_unlock(&builder->mutex);
+
+    return NULL;
+}
+
+// The build compiles a copy, #line keeps compiler messages pointing at the real file
+static char *extension_source(const char *path, const char *bytes, size_t size) {
+    char header[4200];
+    int header_len = snprintf(header, sizeof(header), "#line 1 \"%s\"\n", path);
+    if (header_len < 0 || header_len >= (int)sizeof(header)) header_len = 0;
+    char *source = xmalloc(header_len + size + 1);
+    memcpy(source, header, header_len);
+    memcpy(source + header_len, bytes, size);
+    source[header_len + size] = '\0';
+    return source;
+}
+
+static void queue_build(const char *name, char *source, bool from_save) {
+    Extension_Builder *builder = &g_extensions.builder;
+    pthread_mutex_lock(&builder->mutex);
+    Extension_Build *build = NULL;
+    for (size_t i = 0; i < builder->pending_count; i++) {
+        if (strcmp(builder->pending[i].name, name) == 0) {
+            // Superseded before the worker got to it
+            build = &builder->pending[i];
+            free(build->source);
+            break;
+        }
+    }
+    if (!build && builder->pending_count < EXTENSION_MAX) {
+        build = &builder->pending[builder->pending_count++];
+    }
+    if (build) {
+        memset(build, 0, sizeof(*build));
+        memcpy(build->name, name, strnlen(name, sizeof(build->name) - 1));
+        build->source = source;
+        build->request_ms = get_time_ms();
+        build->from_save = from_save;
+        pthread_cond_signal(&builder->cond);
+    } else {
+        trace_log("Too many extension builds queued, dropped %s", name);
+        free(source);
+    }
+    pthread_mutex_unlock(&builder->mutex);
+}
+
+// The file name without directory and extension
+static void extension_name(const char *path, char *out, size_t out_size) {
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    size_t len = strlen(base);
+    if (len > 2 && strcmp(base + len - 2, ".c") == 0) len -= 2;
+    if (len >= out_size) len = out_size - 1;
+    memcpy(out, base, len);
+    out[len] = '\0';
+}
+
+//
+// The api, every entry runs on the editor thread
+//
+
+static const char *api_text() {
+    return g_extensions.state->text_buffer;
+}
+
+static size_t api_text_size() {
+    return g_extensions.state->used_size;
+}
+
+static size_t api_cursor() {
+    return g_extensions.state->text_buffer_cursor;
+}
+
+static void api_set_cursor(size_t pos) {
+    apply_edit_op(g_extensions.state, (Edit_Op){ EDIT_OP_CURSOR, pos });
+}
+
+// The cursor stays on the same text, and ends up after text inserted right at it
+static void api_insert(size_t pos, const char *bytes, size_t len) {
+    Text_Edit_State *state = g_extensions.state;
+    if (pos > state->used_size) pos = state->used_size;
+    if (len == 0) return;
+
+    // NOTE: Copying part of the buffer is common, and the insert moves or reallocates what bytes points at
+    char *copy = NULL;
+    if (bytes >= state->text_buffer && bytes < state->text_buffer + state->text_capacity) {
+        copy = xmalloc(len);
+        memcpy(copy, bytes, len);
+        bytes = copy;
+    }
+    edit_insert(state, pos, bytes, len);
+    free(copy);
+    if (state->text_buffer_cursor >= pos) state->text_buffer_cursor += len;
+}
+
+static void api_remove(size_t pos, size_t len) {
+    Text_Edit_State *state = g_extensions.state;
+    if (pos > state->used_size) pos = state->used_size;
+    if (len > state->used_size - pos) len = state->used_size - pos;
+    if (len == 0) return;
+    edit_delete(state, pos, len);
+    size_t *cursor = &state->text_buffer_cursor;
+    if (*cursor > pos) *cursor = *cursor > pos + len ? *cursor - len : pos;
+}
+
+static const char *api_file_name() {
+    return g_extensions.state->file_name;
+}
+
+static void api_bind_key(int key, int mods, Text_Edit_Key_Fn fn) {
+    Extension *extension = g_extensions.current;
+    if (!extension) return;
+    for (size_t i = 0; i < extension->binding_count; i++) {
+        Extension_Binding *binding = &extension->bindings[i];
+        if (binding->key == key && binding->mods == mods) {
+            binding->fn = fn;
+            return;
+        }
+    }
+    if (extension->binding_count == EXTENSION_MAX_BINDINGS) {
+        trace_log("Extension %s has too many key bindings", extension->name);
+        return;
+    }
+    extension->bindings[extension->binding_count++] = (Extension_Binding){ key, mods, fn };
+}
+
+static void api_set_draw_hook(Text_Edit_Draw_Fn fn) {
+    if (g_extensions.current) g_extensions.current->draw = fn;
+}
+
+static void api_set_color(Text_Edit_Color color, float r, float g, float b, float a) {
+    Extension *extension = g_extensions.current;
+    if (!extension || (unsigned)color >= SYNTAX_COLOR_COUNT) return;
+    extension->palette_mask |= 1u << color;
+    glm_vec4_copy((vec4){r, g, b, a}, extension->palette[color]);
+}
+
+static void api_draw_quad(float x, float y, float w, float h, float r, float g, float b, float a) {
+    if (g_extensions.drawing) snapshot_overlay_quad(g_extensions.drawing, (Rect){x, y, w, h}, (vec4){r, g, b, a});
+}
+
+static void api_draw_text(float x, float y, const char *text, float r, float g, float b, float a) {
+    if (g_extensions.drawing) snapshot_overlay_text(g_extensions.drawing, (vec2){x, y}, text, (vec4){r, g, b, a});
+}
+
+static void api_log(const char *format, ...) {
+    char message[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    trace_log("[%s] %s", g_extensions.current ? g_extensions.current->name : "extension", message);
+}
+
+//
+// Host
+//
+
+void extensions_init(Text_Edit_State *state, void (*wake)(void)) {
+    Extension_Host *host = &g_extensions;
+    memset(host, 0, sizeof(*host));
+    host->state = state;
+    host->api = (Text_Edit_Api){
+        .version = TEXT_EDIT_API_VERSION,
+        .size = sizeof(Text_Edit_Api),
+        .text = api_text,
+        .text_size = api_text_size,
+        .cursor = api_cursor,
+        .set_cursor = api_set_cursor,
+        .insert = api_insert,
+        .remove = api_remove,
+        .file_name = api_file_name,
+        .bind_key = api_bind_key,
+        .set_draw_hook = api_set_draw_hook,
+        .set_color = api_set_color,
+        .draw_quad = api_draw_quad,
+        .draw_text = api_draw_text,
+        .log = api_log,
+    };
+
+    Extension_Builder *builder = &host->builder;
+    builder->wake = wake;
+    pthread_mutex_init(&builder->mutex, NULL);
+    pthread_cond_init(&builder->cond, NULL);
+    if (pthread_create(&builder->thread, NULL, extension_builder_proc, builder) != 0) {
+        exit_with_error("Failed to start extension build thread");
+    }
+}
+
+// Unloads everything. A build still compiling is waited for, queued ones are dropped.
+void extensions_shutdown() {
+    Extension_Host *host = &g_extensions;
+    Extension_Builder *builder = &host->builder;
+    pthread_mutex_lock(&builder->mutex);
+    builder->quit = true;
+    pthread_cond_signal(&builder->cond);
+    pthread_mutex_unlock(&builder->mutex);
+    pthread_join(builder->thread, NULL);
+
+    for (size_t i = 0; i < builder->pending_count; i++) free(builder->pending[i].source);
+    for (size_t i = 0; i < builder->done_count; i++) {
+        if (builder->done[i].handle) close_handle(builder->done[i].handle);
+    }
+    builder->pending_count = 0;
+    builder->done_count = 0;
+
+    for (size_t i = 0; i < host->extension_count; i++) {
+        Extension *extension = &host->extensions[i];
+        if (extension->unload) {
+            host->current = extension;
+            extension->unload(&host->api, extension->state);
+            host->current = NULL;
+        }
+        close_handle(extension->handle);
+        free(extension->state);
+    }
+    host->extension_count = 0;
+}
+
+void extensions_load_dir(const char *dir) {
+    DIR *directory = opendir(dir);
+    if (!directory) return; // No extensions
+
+    struct dirent *entry;
+    while ((entry = readdir(directory)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        if (len < 3 || strcmp(entry->d_name + len - 2, ".c") != 0) continue;
+
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        FILE *file = fopen(path, "rb");
+        if (!file) {
+            trace_log("Failed to open extension %s", path);
+            continue;
+        }
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        char *bytes = xmalloc(size > 0 ? (size_t)size : 1);
+        size_t read = size > 0 ? fread(bytes, 1, (size_t)size, file) : 0;
+        fclose(file);
+        char *source = extension_source(path, bytes, read);
+        free(bytes);
+
+        char name[EXTENSION_NAME_MAX];
+        extension_name(path, name, sizeof(name));
+        queue_build(name, source, false);
+    }
+    closedir(directory);
+}
+
+// An #include "extension_api.h" or <extension_api.h> line. The name mentioned anywhere else,
+// in a comment or a string, doesn't make the buffer an extension.
+static bool includes_extension_api(const char *text, size_t size) {
+    static const char header[] = "extension_api.h";
+    size_t header_len = sizeof(header) - 1;
+    for (size_t pos = 0; pos < size;) {
+        size_t found = find_bytes(text + pos, size - pos, header, header_len);
+        if (found == SEARCH_NOT_FOUND) return false;
+        found += pos;
+        pos = found + header_len;
+
+        size_t i = found;
+        while (i > 0 && text[i - 1] != '\n') i--;
+        while (i < found && (text[i] == ' ' || text[i] == '\t')) i++;
+        if (i == found || text[i] != '#') continue;
+        for (i++; i < found && (text[i] == ' ' || text[i] == '\t'); i++) {}
+        if (found - i < 7 || memcmp(text + i, "include", 7) != 0) continue;
+        for (i += 7; i < found && (text[i] == ' ' || text[i] == '\t'); i++) {}
+        if (i + 1 != found || (text[i] != '"' && text[i] != '<')) continue;
+        if (pos < size && text[pos] == (text[i] == '"' ? '"' : '>')) return true;
+    }
+    return false;
+}
+
+void extensions_on_save() {
+    Text_Edit_State *state = g_extensions.state;
+    if (!includes_extension_api(state->text_buffer, state->used_size)) return;
+
+    // NOTE: Built from the buffer rather than the file, so the build does not wait for the write
+    char *source = extension_source(state->file_name, state->text_buffer, state->used_size);
+    char name[EXTENSION_NAME_MAX];
+    extension_name(state->file_name, name, sizeof(name));
+    queue_build(name, source, true);
+}
+
+// Builds started by a save report back next to the cursor, only the first line fits there
+static void annotate_build(const Extension_Build *build, const char *text) {
+    if (!build->from_save) return;
+    Text_Edit_State *state = g_extensions.state;
+    char line[ANNOTATION_MAX];
+    snprintf(line, sizeof(line), "%s: %.*s", build->name, (int)strcspn(text, "\n"), text);
+    set_annotation(state, state->text_buffer_cursor, state->edit_version, line);
+}
+
+// Swaps a build in for the extension of the same name, keeping its state
+static void activate_build(Extension_Build *build) {
+    Extension_Host *host = &g_extensions;
+
+    const Text_Edit_Extension_Info *info = find_symbol(build->handle, "text_edit_extension_info");
+    Extension_Load_Fn load = (Extension_Load_Fn)find_symbol(build->handle, "text_edit_extension_load");
+    Extension_Unload_Fn unload = (Extension_Unload_Fn)find_symbol(build->handle, "text_edit_extension_unload");
+
+    char error[128] = "";
+    if (!info || !load) {
+        snprintf(error, sizeof(error), "missing text_edit_extension_info or text_edit_extension_load");
+    } else if (info->api_version != TEXT_EDIT_API_VERSION) {
+        snprintf(error, sizeof(error), "built for api version %u, this editor has %d", info->api_version, TEXT_EDIT_API_VERSION);
+    }
+    Extension *extension = NULL;
+    for (size_t i = 0; i < host->extension_count; i++) {
+        if (strcmp(host->extensions[i].name, build->name) == 0) extension = &host->extensions[i];
+    }
+    if (!error[0] && !extension && host->extension_count == EXTENSION_MAX) {
+        snprintf(error, sizeof(error), "too many extensions");
+    }
+    if (error[0]) {
+        // The previous build, if any, stays active
+        close_handle(build->handle);
+        trace_log("Extension %s not loaded: %s", build->name, error);
+        annotate_build(build, error);
+        return;
+    }
+
+    bool reloaded = extension != NULL;
+    if (extension) {
+        if (extension->unload) {
+            host->current = extension;
+            extension->unload(&host->api, extension->state);
+        }
+        close_handle(extension->handle);
+    } else {
+        extension = &host->extensions[host->extension_count++];
+        memset(extension, 0, sizeof(*extension));
+        memcpy(extension->name, build->name, sizeof(extension->name));
+    }
+
+    if (info->state_size > extension->state_size) {
+        // NOTE: Growing keeps what is there, an extension that adds fields at the end sees zeroes in them
+        extension->state = xrealloc(extension->state, info->state_size);
+        memset((char *)extension->state + extension->state_size, 0, info->state_size - extension->state_size);
+        extension->state_size = info->state_size;
+    }
+    extension->handle = build->handle;
+    extension->unload = unload;
+    extension->binding_count = 0;
+    extension->draw = NULL;
+    extension->palette_mask = 0;
+
+    host->current = extension;
+    undo_begin_group(&host->state->undo);
+    load(&host->api, extension->state, reloaded);
+    undo_end_group(&host->state->undo);
+    host->current = NULL;
+
+    char text[64];
+    snprintf(text, sizeof(text), "%s in %.1f ms", reloaded ? "reloaded" : "loaded", get_time_ms() - build->request_ms);
+    trace_log("Extension %s %s", build->name, text);
+    annotate_build(build, text);
+}
+
+bool extensions_poll() {
+    Extension_Builder *builder = &g_extensions.builder;
+    Extension_Build done[EXTENSION_MAX];
+    size_t done_count;
+    pthread_mutex_lock(&builder->mutex);
+    done_count = builder->done_count;
+    memcpy(done, builder->done, done_count * sizeof(Extension_Build));
+    builder->done_count = 0;
+    pthread_mutex_unlock(&builder->mutex);
+
+    for (size_t i = 0; i < done_count; i++) {
+        Extension_Build *build = &done[i];
+        if (build->ok) {
+            activate_build(build);
+        } else {
+            trace_log("Extension %s failed to build:\n%s", build->name, build->error);
+            annotate_build(build, build->error);
+        }
+    }
+    return done_count > 0;
+}
+
+bool extensions_handle_key(int key, int mods) {
+    Extension_Host *host = &g_extensions;
+    for (size_t i = host->extension_count; i-- > 0;) {
+        Extension *extension = &host->extensions[i];
+        for (size_t j = 0; j < extension->binding_count; j++) {
+            Extension_Binding *binding = &extension->bindings[j];
+            if (binding->key != key || binding->mods != mods) continue;
+
+            // One undo step per key, however many edits the extension makes
+            host->current = extension;
+            undo_begin_group(&host->state->undo);
+            binding->fn(&host->api, extension->state);
+            undo_end_group(&host->state->undo);
+            host->current = NULL;
+            return true;
+        }
+    }
+    return false;
+}
+
+void extensions_fill_snapshot(Render_Snapshot *snapshot, const Layout_Cache *layout) {
+    Extension_Host *host = &g_extensions;
+    if (host->extension_count == 0) return;
+
+    Text_Edit_Frame frame = {
+        .width = layout->width,
+        .height = layout->height,
+        .line_height = layout->line_height * snapshot->zoom,
+        .text_left = TEXT_MARGIN_LEFT,
+        .text_top = TEXT_MARGIN_TOP,
+        .first_line = host->state->scroll_line,
+        .cursor_row = -1,
+    };
+    if (snapshot->cursor != SIZE_MAX) {
+        frame.cursor_row = 0;
+        for (size_t i = 0; i < snapshot->cursor; i++) frame.cursor_row += snapshot->text[i] == '\n';
+    }
+
+    // Later extensions win on colors and draw on top
+    host->drawing = snapshot;
+    for (size_t i = 0; i < host->extension_count; i++) {
+        Extension *extension = &host->extensions[i];
+        for (int color = 0; color < SYNTAX_COLOR_COUNT; color++) {
+            if (extension->palette_mask & (1u << color)) {
+                glm_vec4_copy(extension->palette[color], snapshot->palette[color]);
+            }
+        }
+        snapshot->palette_mask |= extension->palette_mask;
+
+        if (extension->draw) {
+            host->current = extension;
+            extension->draw(&host->api, extension->state, &frame);
+            host->current = NULL;
+        }
+    }
+    host->drawing = NULL;
+}
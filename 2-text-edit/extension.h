@@ -0,0 +1,26 @@
+#ifndef EXTENSION_H
+#define EXTENSION_H
+
+#include "common.h"
+#include "editor.h"
+#include "layout.h"
+#include "view.h"
+
+enum { EXTENSION_MAX = 16, EXTENSION_MAX_BINDINGS = 64, EXTENSION_NAME_MAX = 64 };
+
+// The host side of extension_api.h. Builds happen on a worker thread that calls wake when one is ready,
+// everything else is for the editor thread, which is also where extension code runs.
+void extensions_init(Text_Edit_State *state, void (*wake)(void));
+void extensions_shutdown();
+
+// Queues a build of every .c file in dir
+void extensions_load_dir(const char *dir);
+// Queues a build of the buffer when it is an extension, i.e. it has an #include line for extension_api.h
+void extensions_on_save();
+// Swaps in finished builds. Returns true when something on screen may have changed.
+bool extensions_poll();
+
+bool extensions_handle_key(int key, int mods);
+void extensions_fill_snapshot(Render_Snapshot *snapshot, const Layout_Cache *layout);
+
+#endif
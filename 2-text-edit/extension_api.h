@@ -0,0 +1,90 @@
+#ifndef EXTENSION_API_H
+#define EXTENSION_API_H
+
+// The only header an extension includes. It depends on nothing else in the editor, so extensions
+// build on their own and keep working across editor rebuilds as long as the major version matches.
+//
+// An extension is one C file. Saving a buffer that includes this header builds it and swaps it in
+// place of the previous build of the same name, files in extensions/ are loaded at startup.
+// Everything runs on the editor thread, between commands, so the buffer never changes under a call.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bumped when anything below changes incompatibly. Additions only grow the api table.
+#define TEXT_EDIT_API_VERSION 1
+
+// Same values as GLFW. Keys are GLFW key codes, letters and digits are their uppercase ASCII.
+enum { TEXT_EDIT_MOD_SHIFT = 1, TEXT_EDIT_MOD_CONTROL = 2, TEXT_EDIT_MOD_ALT = 4 };
+enum { TEXT_EDIT_KEY_F4 = 293, TEXT_EDIT_KEY_F12 = 301 };
+
+typedef enum Text_Edit_Color {
+    TEXT_EDIT_COLOR_DEFAULT,
+    TEXT_EDIT_COLOR_KEYWORD,
+    TEXT_EDIT_COLOR_TYPE,
+    TEXT_EDIT_COLOR_NUMBER,
+    TEXT_EDIT_COLOR_STRING,
+    TEXT_EDIT_COLOR_COMMENT,
+    TEXT_EDIT_COLOR_PREPROC,
+    TEXT_EDIT_COLOR_PUNCT,
+    TEXT_EDIT_COLOR_COUNT
+} Text_Edit_Color;
+
+// What is on screen when a draw hook runs. Positions are window pixels.
+typedef struct Text_Edit_Frame {
+    int width, height;
+    float line_height; // Zoom included
+    float text_left;   // Where rows start
+    float text_top;    // Baseline of the first row
+    size_t first_line; // Buffer line of the first row
+    int cursor_row;    // Row on screen, -1 when the cursor is off screen
+} Text_Edit_Frame;
+
+typedef struct Text_Edit_Api Text_Edit_Api;
+
+// `state` is the extension's own block, see Text_Edit_Extension_Info
+typedef void (*Text_Edit_Key_Fn)(const Text_Edit_Api *api, void *state);
+typedef void (*Text_Edit_Draw_Fn)(const Text_Edit_Api *api, void *state, const Text_Edit_Frame *frame);
+
+struct Text_Edit_Api {
+    uint32_t version; // TEXT_EDIT_API_VERSION of the editor
+    uint32_t size;    // sizeof(Text_Edit_Api) of the editor, check it before using a newer entry
+
+    // Buffer. Offsets are bytes, text is UTF-8 and stays valid until the next edit.
+    const char *(*text)(void);
+    size_t (*text_size)(void);
+    size_t (*cursor)(void);
+    void (*set_cursor)(size_t pos);
+    void (*insert)(size_t pos, const char *bytes, size_t len); // Undoable, like typing
+    void (*remove)(size_t pos, size_t len);                    // Undoable
+    const char *(*file_name)(void);
+
+    // Registration, usually from load. Everything registered is dropped when the extension is reloaded.
+    // Keys the editor already uses are not passed on to extensions.
+    void (*bind_key)(int key, int mods, Text_Edit_Key_Fn fn);
+    void (*set_draw_hook)(Text_Edit_Draw_Fn fn);
+    void (*set_color)(Text_Edit_Color color, float r, float g, float b, float a);
+
+    // Only inside a draw hook. Drawn over the text each time the editor shows a change.
+    void (*draw_quad)(float x, float y, float w, float h, float r, float g, float b, float a);
+    void (*draw_text)(float x, float y, const char *text, float r, float g, float b, float a);
+
+    void (*log)(const char *format, ...);
+};
+
+// Every extension defines these three
+typedef struct Text_Edit_Extension_Info {
+    uint32_t api_version; // Set to TEXT_EDIT_API_VERSION
+    uint32_t state_size;  // Bytes the editor keeps across reloads, zeroed the first time
+} Text_Edit_Extension_Info;
+
+// NOTE: The state block outlives the code. Pointers into the extension's own code or static data,
+//       function pointers and string literals included, dangle after a reload. Keep plain data in it.
+extern const Text_Edit_Extension_Info text_edit_extension_info;
+// reloaded is true when state holds what the previous build left there
+void text_edit_extension_load(const Text_Edit_Api *api, void *state, bool reloaded);
+// Runs before the code is swapped out or the editor quits
+void text_edit_extension_unload(const Text_Edit_Api *api, void *state);
+
+#endif
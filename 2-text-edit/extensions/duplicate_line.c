@@ -0,0 +1,49 @@
+// Ctrl+D duplicates the cursor line, and the cursor line gets a faint highlight.
+// Edit and save this buffer to see it swapped in, the duplicate count survives the reload.
+#include "extension_api.h"
+
+typedef struct State {
+    uint32_t duplicated;
+} State;
+
+const Text_Edit_Extension_Info text_edit_extension_info = { TEXT_EDIT_API_VERSION, sizeof(State) };
+
+static void duplicate_line(const Text_Edit_Api *api, void *state) {
+    State *s = state;
+    const char *text = api->text();
+    size_t size = api->text_size();
+    size_t cursor = api->cursor();
+
+    size_t start = cursor;
+    while (start > 0 && text[start - 1] != '\n') start--;
+    size_t end = cursor;
+    while (end < size && text[end] != '\n') end++;
+
+    // The copy goes below, the cursor stays on the original line
+    size_t column = cursor - start;
+    api->insert(end, "\n", 1);
+    api->insert(end + 1, api->text() + start, end - start);
+    api->set_cursor(end + 1 + column);
+
+    s->duplicated++;
+    api->log("Duplicated %u lines so far", s->duplicated);
+}
+
+static void draw(const Text_Edit_Api *api, void *state, const Text_Edit_Frame *frame) {
+    (void)state;
+    if (frame->cursor_row < 0) return;
+    float top = frame->text_top + (frame->cursor_row - 0.75f) * frame->line_height;
+    api->draw_quad(0.0f, top, (float)frame->width, frame->line_height, 1.0f, 1.0f, 1.0f, 0.04f);
+}
+
+void text_edit_extension_load(const Text_Edit_Api *api, void *state, bool reloaded) {
+    (void)state;
+    (void)reloaded;
+    api->bind_key('D', TEXT_EDIT_MOD_CONTROL, duplicate_line);
+    api->set_draw_hook(draw);
+}
+
+void text_edit_extension_unload(const Text_Edit_Api *api, void *state) {
+    (void)api;
+    (void)state;
+}
@@ -0,0 +1,314 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "glad/glad.h"
+
+#include "latency.h"
+
+// Frame cost for late pacing is the worst of this many recent frames
+enum { PACING_COST_FRAMES = 32 };
+enum { PACING_IMMEDIATE_SNAPSHOT_WAIT_MS = 8 };
+
+typedef struct Latency_Frame {
+    uint64_t first_input, end_input; // Commands [first, end) shown for the first time by this frame
+    uint64_t swap_ns;
+    GLsync fence;
+    bool pending;
+} Latency_Frame;
+
+typedef struct Latency_State {
+    bool initialized;
+    bool gpu;
+    int64_t gpu_to_cpu_ns; // Added to GPU timestamps to put them on the CPU clock
+
+    uint64_t input_ns[LATENCY_INPUT_RING]; // By command index
+    uint64_t inputs_pushed;                // One past the newest stamped command
+    uint64_t inputs_shown;                 // Commands before this are matched to a frame already
+    uint64_t ready_first, ready_end;       // Inputs of the frame about to be swapped
+    uint64_t lost_inputs;                  // Stamps overwritten before their frame resolved
+
+    Latency_Frame frames[LATENCY_FRAMES_IN_FLIGHT];
+    uint32_t queries[LATENCY_FRAMES_IN_FLIGHT];
+    uint64_t frame_index;
+
+    Latency_Histogram to_swap; // Callback to the return of the swap that presents it
+    Latency_Histogram to_gpu;  // Callback to the GPU finishing that frame
+
+    Frame_Pacing pacing;
+    double period_ms;
+    double slack_ms;
+    double last_swap_ms;
+    double slot_begin_ms; // When input was taken for the frame being built
+    double cost_ms[PACING_COST_FRAMES];
+    uint32_t cost_index;
+} Latency_State;
+
+static Latency_State g_latency;
+
+static const char *g_pacing_names[FRAME_PACING_COUNT] = {
+    [FRAME_PACING_VSYNC]     = "vsync",
+    [FRAME_PACING_LATE]      = "late",
+    [FRAME_PACING_IMMEDIATE] = "immediate",
+};
+
+void latency_init(bool gpu, Frame_Pacing pacing, double refresh_hz, double slack_ms) {
+    memset(&g_latency, 0, sizeof(g_latency));
+    g_latency.initialized = true;
+    g_latency.gpu = gpu;
+    g_latency.pacing = pacing;
+    g_latency.period_ms = 1000.0 / (refresh_hz > 0.0 ? refresh_hz : 60.0);
+    g_latency.slack_ms = slack_ms;
+    g_latency.last_swap_ms = get_time_ms();
+
+    if (gpu) {
+        glGenQueries(LATENCY_FRAMES_IN_FLIGHT, g_latency.queries);
+        GLint64 gpu_now;
+        glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+        g_latency.gpu_to_cpu_ns = (int64_t)get_time_ns() - gpu_now;
+    }
+}
+
+void latency_input(uint64_t command_index) {
+    if (!g_latency.initialized) return;
+    g_latency.input_ns[command_index % LATENCY_INPUT_RING] = get_time_ns();
+    if (command_index + 1 > g_latency.inputs_pushed) g_latency.inputs_pushed = command_index + 1;
+}
+
+static void histogram_add(Latency_Histogram *histogram, double ms) {
+    int bucket = ms > LATENCY_FIRST_BUCKET_MS ? (int)floor(4.0 * log2(ms / LATENCY_FIRST_BUCKET_MS)) : 0;
+    if (bucket >= LATENCY_BUCKETS) bucket = LATENCY_BUCKETS - 1;
+    histogram->counts[bucket]++;
+    histogram->total++;
+    histogram->sum_ms += ms;
+    if (ms > histogram->max_ms) histogram->max_ms = ms;
+}
+
+static double bucket_upper_ms(int bucket) {
+    return LATENCY_FIRST_BUCKET_MS * pow(2.0, (bucket + 1) / 4.0);
+}
+
+// Upper bound of the bucket the percentile falls in
+double latency_histogram_percentile(const Latency_Histogram *histogram, double p) {
+    if (histogram->total == 0) return 0.0;
+    uint64_t rank = (uint64_t)ceil(p * histogram->total);
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        seen += histogram->counts[bucket];
+        if (seen >= rank) return fmin(bucket_upper_ms(bucket), histogram->max_ms);
+    }
+    return histogram->max_ms;
+}
+
+static void resolve_frame(Latency_Frame *frame, uint64_t gpu_done_ns) {
+    for (uint64_t input = frame->first_input; input < frame->end_input; input++) {
+        if (g_latency.inputs_pushed - input > LATENCY_INPUT_RING) {
+            g_latency.lost_inputs++;
+            continue;
+        }
+        uint64_t input_ns = g_latency.input_ns[input % LATENCY_INPUT_RING];
+        histogram_add(&g_latency.to_swap, (frame->swap_ns - input_ns) / 1e6);
+        if (gpu_done_ns) histogram_add(&g_latency.to_gpu, ((int64_t)gpu_done_ns - (int64_t)input_ns) / 1e6);
+    }
+    frame->pending = false;
+}
+
+// Returns false if the frame is still on the GPU and `wait` is false
+static bool resolve_gpu_frame(uint32_t slot, bool wait) {
+    Latency_Frame *frame = &g_latency.frames[slot];
+    if (!frame->pending) return true;
+
+    GLenum status = glClientWaitSync(frame->fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000000ull : 0);
+    if (status == GL_TIMEOUT_EXPIRED) return false;
+    glDeleteSync(frame->fence);
+    frame->fence = NULL;
+
+    // NOTE: The timestamp was queried right after the swap, so the fence passing means it is available
+    uint64_t gpu_done_ns = 0;
+    if (status != GL_WAIT_FAILED) {
+        GLuint64 value;
+        glGetQueryObjectui64v(g_latency.queries[slot], GL_QUERY_RESULT, &value);
+        gpu_done_ns = (uint64_t)((int64_t)value + g_latency.gpu_to_cpu_ns);
+    }
+    resolve_frame(frame, gpu_done_ns);
+    return true;
+}
+
+void latency_frame_ready(uint64_t applied_commands) {
+    if (!g_latency.initialized) return;
+
+    if (applied_commands > g_latency.inputs_pushed) applied_commands = g_latency.inputs_pushed;
+    g_latency.ready_first = g_latency.inputs_shown;
+    g_latency.ready_end = applied_commands > g_latency.inputs_shown ? applied_commands : g_latency.inputs_shown;
+    g_latency.inputs_shown = g_latency.ready_end;
+
+    double cost = get_time_ms() - g_latency.slot_begin_ms;
+    g_latency.cost_ms[g_latency.cost_index++ % PACING_COST_FRAMES] = cost;
+}
+
+void latency_frame_swapped() {
+    if (!g_latency.initialized) return;
+
+    uint64_t now_ns = get_time_ns();
+    g_latency.last_swap_ms = now_ns / 1e6;
+    if (g_latency.ready_first == g_latency.ready_end) return;
+
+    uint32_t slot = g_latency.frame_index++ % LATENCY_FRAMES_IN_FLIGHT;
+    Latency_Frame *frame = &g_latency.frames[slot];
+    if (g_latency.gpu) resolve_gpu_frame(slot, true);
+
+    frame->first_input = g_latency.ready_first;
+    frame->end_input = g_latency.ready_end;
+    frame->swap_ns = now_ns;
+    frame->pending = true;
+    if (g_latency.gpu) {
+        glQueryCounter(g_latency.queries[slot], GL_TIMESTAMP);
+        frame->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+    } else {
+        resolve_frame(frame, 0);
+    }
+}
+
+// Frames are resolved in swap order, so the first one still running ends the walk
+void latency_poll(bool wait) {
+    if (!g_latency.initialized || !g_latency.gpu) return;
+
+    uint64_t oldest = g_latency.frame_index > LATENCY_FRAMES_IN_FLIGHT ? g_latency.frame_index - LATENCY_FRAMES_IN_FLIGHT : 0;
+    for (uint64_t index = oldest; index < g_latency.frame_index; index++) {
+        if (!resolve_gpu_frame(index % LATENCY_FRAMES_IN_FLIGHT, wait)) break;
+    }
+}
+
+Frame_Pacing latency_pacing() {
+    return g_latency.pacing;
+}
+
+// Late pacing sleeps here until there is just enough time left before the next vblank
+// to build a frame at the worst recent cost plus slack
+void latency_begin_input_slot() {
+    if (g_latency.pacing == FRAME_PACING_LATE) {
+        double cost = 0.0;
+        for (int i = 0; i < PACING_COST_FRAMES; i++) cost = fmax(cost, g_latency.cost_ms[i]);
+        double wake_ms = g_latency.last_swap_ms + g_latency.period_ms - cost - g_latency.slack_ms;
+        double sleep_ms = wake_ms - get_time_ms();
+        if (sleep_ms > 0.0) {
+            // NOTE: A missed vblank only costs one frame of latency, so the cap stays well under a period
+            sleep_ms = fmin(sleep_ms, g_latency.period_ms);
+            struct timespec pause = { 0, (long)(sleep_ms * 1e6) };
+            nanosleep(&pause, NULL);
+        }
+    }
+    g_latency.slot_begin_ms = get_time_ms();
+}
+
+// How long the render thread may wait for the editor to apply what was just polled
+double latency_snapshot_wait_ms() {
+    switch (g_latency.pacing) {
+        case FRAME_PACING_LATE:      return g_latency.slack_ms * 0.5;
+        case FRAME_PACING_IMMEDIATE: return PACING_IMMEDIATE_SNAPSHOT_WAIT_MS;
+        default:                     return 0.0;
+    }
+}
+
+bool latency_parse_pacing(const char *name, Frame_Pacing *out) {
+    for (int i = 0; i < FRAME_PACING_COUNT; i++) {
+        if (strcmp(name, g_pacing_names[i]) == 0) {
+            *out = (Frame_Pacing)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void format_summary(const char *name, const Latency_Histogram *histogram, char *out, size_t out_size) {
+    if (histogram->total == 0) {
+        snprintf(out, out_size, "%s: no samples", name);
+        return;
+    }
+    snprintf(out, out_size, "%s: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f ms  (%llu)", name,
+             latency_histogram_percentile(histogram, 0.5),
+             latency_histogram_percentile(histogram, 0.9),
+             latency_histogram_percentile(histogram, 0.99),
+             histogram->max_ms,
+             (unsigned long long)histogram->total);
+}
+
+static void log_histogram(const char *name, const Latency_Histogram *histogram) {
+    char line[160];
+    format_summary(name, histogram, line, sizeof(line));
+    trace_log("%s", line);
+
+    uint64_t peak = 0;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        if (histogram->counts[bucket] > peak) peak = histogram->counts[bucket];
+    }
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        if (histogram->counts[bucket] == 0) continue;
+        char bar[41];
+        int len = (int)(40 * histogram->counts[bucket] / peak);
+        if (len < 1) len = 1;
+        memset(bar, '#', len);
+        bar[len] = '\0';
+        trace_log("  <= %7.2f ms %8llu %s", bucket_upper_ms(bucket), (unsigned long long)histogram->counts[bucket], bar);
+    }
+}
+
+void latency_log_report() {
+    if (!g_latency.initialized) return;
+    latency_poll(true);
+    trace_log("Input latency, %s pacing:", g_pacing_names[g_latency.pacing]);
+    log_histogram("input to swap", &g_latency.to_swap);
+    if (g_latency.gpu) log_histogram("input to gpu done", &g_latency.to_gpu);
+    if (g_latency.lost_inputs) trace_log("  %llu inputs not measured", (unsigned long long)g_latency.lost_inputs);
+}
+
+// Bottom right, under the profiler panel: the summaries and the histogram of the last stage that is measured
+void latency_draw_overlay(Font *font, int width, int height) {
+    if (!g_latency.initialized) return;
+
+    const Latency_Histogram *histogram = g_latency.gpu ? &g_latency.to_gpu : &g_latency.to_swap;
+    float text_scale = 0.5f;
+    float line_h = font->points_height * text_scale;
+    float bar_w = 7.0f;
+    float graph_h = 60.0f;
+    float panel_w = bar_w * LATENCY_BUCKETS + 20.0f;
+    float panel_h = graph_h + line_h * 3 + 30.0f;
+    float panel_x = width - panel_w - 10.0f;
+    float panel_y = height - panel_h - 10.0f;
+    float graph_x = panel_x + 10.0f;
+    float graph_bottom = panel_y + 10.0f + graph_h;
+
+    draw_quad((Rect){panel_x, panel_y, panel_w, panel_h}, (vec4){0.05f, 0.04f, 0.04f, 0.85f});
+
+    uint64_t peak = 1;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        if (histogram->counts[bucket] > peak) peak = histogram->counts[bucket];
+    }
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        float h = graph_h * histogram->counts[bucket] / peak;
+        draw_quad((Rect){graph_x + bucket * bar_w, graph_bottom - h, bar_w - 1.0f, h}, (vec4){0.9f, 0.85f, 0.4f, 0.9f});
+    }
+    // One frame at the measured refresh rate
+    float frame_x = graph_x + bar_w * (float)fmax(0.0, 4.0 * log2(g_latency.period_ms / LATENCY_FIRST_BUCKET_MS));
+    draw_quad((Rect){frame_x, graph_bottom - graph_h, 1.0f, graph_h}, (vec4){0.9f, 0.3f, 0.3f, 0.7f});
+
+    set_view_zoom(text_scale);
+    vec4 text_color = {0.86f, 0.86f, 0.86f, 0.95f};
+    char line[160];
+    float x = graph_x / text_scale;
+    float y = (graph_bottom + 10.0f + line_h) / text_scale;
+    snprintf(line, sizeof(line), "input latency, %s pacing", g_pacing_names[g_latency.pacing]);
+    draw_string(line, (vec2){x, y}, text_color, font, font->points_height);
+    y += font->points_height;
+    format_summary("to swap", &g_latency.to_swap, line, sizeof(line));
+    draw_string(line, (vec2){x, y}, text_color, font, font->points_height);
+    y += font->points_height;
+    if (g_latency.gpu) {
+        format_summary("to gpu ", &g_latency.to_gpu, line, sizeof(line));
+        draw_string(line, (vec2){x, y}, text_color, font, font->points_height);
+    }
+    set_view_zoom(1.0f);
+}
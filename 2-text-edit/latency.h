@@ -0,0 +1,47 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "common.h"
+#include "renderer.h"
+
+// Input stamps are kept this many commands back, frames stay in flight this many swaps before they are waited on
+enum { LATENCY_INPUT_RING = 4096, LATENCY_FRAMES_IN_FLIGHT = 8 };
+// Quarter octaves from LATENCY_FIRST_BUCKET_MS up, about 0.25 ms to 1 s
+enum { LATENCY_BUCKETS = 48 };
+#define LATENCY_FIRST_BUCKET_MS 0.25
+
+typedef enum Frame_Pacing {
+    FRAME_PACING_VSYNC,     // Draw, swap, then poll. Input waits for the next frame to be picked up.
+    FRAME_PACING_LATE,      // Sleep after the swap and poll input as late as the measured frame cost allows
+    FRAME_PACING_IMMEDIATE, // No vsync. Wait for input and present as soon as the editor has applied it.
+    FRAME_PACING_COUNT
+} Frame_Pacing;
+
+typedef struct Latency_Histogram {
+    uint64_t counts[LATENCY_BUCKETS];
+    uint64_t total;
+    double sum_ms;
+    double max_ms;
+} Latency_Histogram;
+
+// Every input is stamped in its GLFW callback and matched to the first frame whose snapshot has applied it.
+// That frame's swap and its GPU completion, seen through a fence, give two latencies per input.
+// Render thread only. Without GL (gpu false) only the swap side is measured.
+void latency_init(bool gpu, Frame_Pacing pacing, double refresh_hz, double slack_ms);
+void latency_input(uint64_t command_index);
+// Right before the swap, with the commands the drawn snapshot has applied
+void latency_frame_ready(uint64_t applied_commands);
+void latency_frame_swapped();
+void latency_poll(bool wait);
+
+// Pacing for the loop in main, see Frame_Pacing
+Frame_Pacing latency_pacing();
+void latency_begin_input_slot();
+double latency_snapshot_wait_ms();
+bool latency_parse_pacing(const char *name, Frame_Pacing *out);
+
+double latency_histogram_percentile(const Latency_Histogram *histogram, double p);
+void latency_log_report();
+void latency_draw_overlay(Font *font, int width, int height);
+
+#endif
@@ -0,0 +1,321 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "layout.h"
+
+#define LAYOUT_BUCKET_COUNT (2 * LAYOUT_CACHE_CAPACITY)
+
+void layout_init(Layout_Cache *layout, const Font *font, bool wrap) {
+    memset(layout, 0, sizeof(*layout));
+    layout->font = font;
+    layout->line_height = font->points_height;
+    layout->wrap = wrap;
+    layout->zoom = 1.0f;
+    for (uint32_t c = 0; c < 128; c++) {
+        layout->ascii_advance[c] = font_glyph_advance(font, c);
+    }
+    layout->buckets = xcalloc(LAYOUT_BUCKET_COUNT * sizeof(Line_Layout));
+    layout->arena.name = "layout";
+}
+
+// NOTE: Entries only ever go all at once, so their arrays come from an arena. After the first clear
+//       it holds a whole cache's worth and laying out new lines stops touching the heap.
+static void layout_clear(Layout_Cache *layout) {
+    memset(layout->buckets, 0, LAYOUT_BUCKET_COUNT * sizeof(Line_Layout));
+    arena_reset(&layout->arena);
+    layout->entry_count = 0;
+}
+
+void layout_free(Layout_Cache *layout) {
+    free(layout->buckets);
+    layout->buckets = NULL;
+    arena_free(&layout->arena);
+}
+
+void layout_resize(Layout_Cache *layout, int width, int height) {
+    layout->width = width;
+    layout->height = height;
+}
+
+// Zoom lives in the editor state and changes the wrap width along with the window size
+static void layout_sync(Layout_Cache *layout, Text_Edit_State *state) {
+    syntax_update(&state->syntax, state->text_buffer, state->used_size);
+    layout->zoom = state->zoom;
+    if (layout->wrap) {
+        float margin = TEXT_MARGIN_LEFT / layout->zoom;
+        layout->wrap_width = glm_max(layout->width / layout->zoom - 2.0f * margin, 1.0f);
+    } else {
+        layout->wrap_width = 0.0f;
+    }
+}
+
+static float layout_advance(const Layout_Cache *layout, uint32_t codepoint) {
+    if (codepoint < 128) return layout->ascii_advance[codepoint];
+    return font_glyph_advance(layout->font, codepoint);
+}
+
+static void layout_build_glyphs(Layout_Cache *layout, Line_Layout *line, const char *text, size_t len) {
+    size_t max_glyphs = len < LAYOUT_MAX_LINE_GLYPHS ? len : LAYOUT_MAX_LINE_GLYPHS;
+    line->offsets = arena_alloc(&layout->arena, (max_glyphs + 1) * sizeof(uint32_t));
+    line->x = arena_alloc(&layout->arena, (max_glyphs + 1) * sizeof(float));
+
+    // NOTE: The line isn't null terminated at len, but the buffer is at the end of the text,
+    //       so decoding can't run past it and a newline ends any broken sequence
+    float x = 0.0f;
+    uint32_t glyph = 0;
+    size_t pos = 0;
+    while (pos < len && glyph < max_glyphs) {
+        line->offsets[glyph] = (uint32_t)pos;
+        line->x[glyph] = x;
+        uint32_t codepoint;
+        pos += utf8_decode(text + pos, &codepoint);
+        x += layout_advance(layout, codepoint);
+        glyph++;
+    }
+    if (pos > len) pos = len;
+    line->offsets[glyph] = (uint32_t)pos;
+    line->x[glyph] = x;
+    line->glyph_count = glyph;
+    line->wrap_width = -1.0f;
+}
+
+// Last glyph boundary at or before x, searching [lo, hi]
+static uint32_t layout_boundary_before(const Line_Layout *line, uint32_t lo, uint32_t hi, float x) {
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo + 1) / 2;
+        if (line->x[mid] <= x) lo = mid;
+        else                   hi = mid - 1;
+    }
+    return lo;
+}
+
+static void layout_push_row(Layout_Cache *layout, Line_Layout *line, uint32_t start) {
+    if (line->row_count == line->row_cap) {
+        line->row_cap = line->row_cap ? line->row_cap * 2 : 4;
+        uint32_t *row_starts = arena_alloc(&layout->arena, line->row_cap * sizeof(uint32_t));
+        if (line->row_count) memcpy(row_starts, line->row_starts, line->row_count * sizeof(uint32_t));
+        line->row_starts = row_starts;
+    }
+    line->row_starts[line->row_count++] = start;
+}
+
+// Greedy: each row takes as many glyphs as fit, then backs up to just after a space if one is close.
+// Every row costs a binary search, not a walk over its glyphs.
+static void layout_break_rows(Layout_Cache *layout, Line_Layout *line, const char *text) {
+    line->row_count = 0;
+    layout_push_row(layout, line, 0);
+    line->wrap_width = layout->wrap_width;
+    if (layout->wrap_width <= 0.0f) return;
+
+    uint32_t start = 0;
+    for (;;) {
+        uint32_t end = layout_boundary_before(line, start, line->glyph_count, line->x[start] + layout->wrap_width);
+        if (end >= line->glyph_count) break;
+        if (end == start) end = start + 1; // Wider than the row, it gets one to itself
+
+        uint32_t brk = end;
+        for (uint32_t g = end; g > start + 1 && end - g < LAYOUT_WRAP_LOOKBACK; g--) {
+            char c = text[line->offsets[g - 1]];
+            if (c == ' ' || c == '\t') {
+                brk = g;
+                break;
+            }
+        }
+        layout_push_row(layout, line, brk);
+        start = brk;
+    }
+}
+
+static Line_Layout *layout_get(Layout_Cache *layout, Text_Edit_State *state, size_t line_index) {
+    const Syntax_State *syntax = &state->syntax;
+    uint32_t id = syntax_line_id(syntax, line_index);
+    size_t start = syntax_line_start(syntax, line_index);
+    const char *text = state->text_buffer + start;
+
+    size_t mask = LAYOUT_BUCKET_COUNT - 1;
+    size_t bucket = (id * 2654435761u) & mask;
+    while (layout->buckets[bucket].used && layout->buckets[bucket].line_id != id) bucket = (bucket + 1) & mask;
+
+    Line_Layout *line = &layout->buckets[bucket];
+    if (!line->used) {
+        if (layout->entry_count == LAYOUT_CACHE_CAPACITY) {
+            // NOTE: Entries for lines that were edited or scrolled past are never looked up again.
+            //       Starting over is simpler than tracking which ones those are.
+            layout_clear(layout);
+            return layout_get(layout, state, line_index);
+        }
+        size_t end = line_index + 1 < syntax->line_count ? syntax_line_start(syntax, line_index + 1) : state->used_size;
+        size_t len = end - start;
+        if (len > 0 && text[len - 1] == '\n') len--;
+
+        line->used = true;
+        line->line_id = id;
+        layout->entry_count++;
+        layout_build_glyphs(layout, line, text, len);
+    }
+    if (line->wrap_width != layout->wrap_width) {
+        layout_break_rows(layout, line, text);
+    }
+    return line;
+}
+
+Line_Layout *layout_line(Layout_Cache *layout, Text_Edit_State *state, size_t line) {
+    layout_sync(layout, state);
+    return layout_get(layout, state, line);
+}
+
+uint32_t layout_row_of_glyph(const Line_Layout *line, uint32_t glyph) {
+    uint32_t lo = 0, hi = line->row_count - 1;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo + 1) / 2;
+        if (line->row_starts[mid] <= glyph) lo = mid;
+        else                                hi = mid - 1;
+    }
+    return lo;
+}
+
+uint32_t layout_row_end(const Line_Layout *line, uint32_t row) {
+    return row + 1 < line->row_count ? line->row_starts[row + 1] : line->glyph_count;
+}
+
+// Without wrapping, glyphs past the right edge of the window can't show
+uint32_t layout_row_visible_end(const Layout_Cache *layout, const Line_Layout *line, uint32_t row) {
+    uint32_t start = line->row_starts[row];
+    uint32_t end = layout_row_end(line, row);
+    if (layout->wrap) return end;
+
+    float visible_w = (layout->width - TEXT_MARGIN_LEFT) / layout->zoom;
+    uint32_t last = layout_boundary_before(line, start, end, line->x[start] + visible_w);
+    return last < end ? last + 1 : end;
+}
+
+uint32_t layout_glyph_at_offset(const Line_Layout *line, size_t offset) {
+    uint32_t lo = 0, hi = line->glyph_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo + 1) / 2;
+        if (line->offsets[mid] <= offset) lo = mid;
+        else                              hi = mid - 1;
+    }
+    return lo;
+}
+
+// Nearest glyph boundary to x, measured from the row start. Past the end of a wrapped row the cursor
+// stays before its last glyph, the boundary after it is where the next row starts.
+uint32_t layout_glyph_at_x(const Line_Layout *line, uint32_t row, float x) {
+    uint32_t start = line->row_starts[row];
+    uint32_t end = layout_row_end(line, row);
+    if (row + 1 < line->row_count && end > start) end--;
+
+    float target = line->x[start] + x;
+    uint32_t glyph = layout_boundary_before(line, start, end, target);
+    if (glyph < end && target - line->x[glyph] > line->x[glyph + 1] - target) glyph++;
+    return glyph;
+}
+
+static size_t layout_visible_rows(const Layout_Cache *layout) {
+    float visible_h = layout->height / layout->zoom - TEXT_MARGIN_TOP / layout->zoom;
+    return visible_h > layout->line_height ? (size_t)(visible_h / layout->line_height) : 1;
+}
+
+// Scrolls by rows, so even a cursor deep inside a line taller than the window stays on screen
+void layout_update_scroll(Layout_Cache *layout, Text_Edit_State *state) {
+    layout_sync(layout, state);
+    Syntax_State *syntax = &state->syntax;
+    size_t visible_rows = layout_visible_rows(layout);
+
+    if (state->scroll_line >= syntax->line_count) state->scroll_line = syntax->line_count - 1;
+    uint32_t scroll_line_rows = layout_get(layout, state, state->scroll_line)->row_count;
+    if (state->scroll_row >= scroll_line_rows) state->scroll_row = scroll_line_rows - 1;
+
+    size_t line = syntax_find_line(syntax, state->text_buffer_cursor);
+    Line_Layout *cursor_layout = layout_get(layout, state, line);
+    uint32_t glyph = layout_glyph_at_offset(cursor_layout, state->text_buffer_cursor - syntax_line_start(syntax, line));
+    size_t row = layout_row_of_glyph(cursor_layout, glyph);
+
+    if (line < state->scroll_line || (line == state->scroll_line && row < state->scroll_row)) {
+        state->scroll_line = line;
+        state->scroll_row = row;
+        return;
+    }
+    // Every line takes at least a row, so lines this far up can't be on screen together with the cursor
+    if (line >= state->scroll_line + visible_rows) {
+        state->scroll_line = line - visible_rows + 1;
+        state->scroll_row = 0;
+    }
+
+    // Walk up from the cursor row to the highest row that still keeps it on screen
+    size_t rows_above = visible_rows - 1;
+    for (;;) {
+        if (line == state->scroll_line) {
+            if (state->scroll_row + rows_above < row) state->scroll_row = row - rows_above;
+            return;
+        }
+        if (row >= rows_above) {
+            state->scroll_line = line;
+            state->scroll_row = row - rows_above;
+            return;
+        }
+        rows_above -= row + 1;
+        line--;
+        row = layout_get(layout, state, line)->row_count - 1;
+    }
+}
+
+// x and y are window pixels
+size_t layout_hit_test(Layout_Cache *layout, Text_Edit_State *state, float x, float y) {
+    layout_sync(layout, state);
+    Syntax_State *syntax = &state->syntax;
+    float text_x = (x - TEXT_MARGIN_LEFT) / layout->zoom;
+    float text_y = (y - TEXT_MARGIN_TOP) / layout->zoom;
+
+    // NOTE: Text is drawn from its baseline, the first row sits above TEXT_MARGIN_TOP
+    float row_f = floorf(text_y / layout->line_height) + 1.0f;
+    size_t row = (row_f > 0.0f ? (size_t)row_f : 0) + state->scroll_row;
+    size_t line_index = state->scroll_line;
+    for (;;) {
+        Line_Layout *line = layout_get(layout, state, line_index);
+        if (row < line->row_count || line_index + 1 == syntax->line_count) {
+            if (row >= line->row_count) row = line->row_count - 1;
+            uint32_t glyph = layout_glyph_at_x(line, (uint32_t)row, text_x);
+            return syntax_line_start(syntax, line_index) + line->offsets[glyph];
+        }
+        row -= line->row_count;
+        line_index++;
+    }
+}
+
+// Moves a row up (direction < 0) or down. goal_x is the column to aim for, set from the cursor when negative,
+// so a run of vertical moves keeps its column across short rows.
+size_t layout_move_vertical(Layout_Cache *layout, Text_Edit_State *state, int direction, float *goal_x) {
+    layout_sync(layout, state);
+    Syntax_State *syntax = &state->syntax;
+    size_t cursor = state->text_buffer_cursor;
+    size_t line_index = syntax_find_line(syntax, cursor);
+
+    Line_Layout *line = layout_get(layout, state, line_index);
+    uint32_t glyph = layout_glyph_at_offset(line, cursor - syntax_line_start(syntax, line_index));
+    uint32_t row = layout_row_of_glyph(line, glyph);
+    if (*goal_x < 0.0f) *goal_x = line->x[glyph] - line->x[line->row_starts[row]];
+
+    size_t target_line = line_index;
+    uint32_t target_row = UINT32_MAX; // Last row of the target line
+    if (direction < 0 && row > 0) {
+        target_row = row - 1;
+    } else if (direction < 0) {
+        if (line_index == 0) return cursor;
+        target_line = line_index - 1;
+    } else if (row + 1 < line->row_count) {
+        target_row = row + 1;
+    } else {
+        if (line_index + 1 == syntax->line_count) return cursor;
+        target_line = line_index + 1;
+        target_row = 0;
+    }
+
+    // NOTE: May evict `line`, it isn't used past here
+    Line_Layout *target = layout_get(layout, state, target_line);
+    if (target_row == UINT32_MAX) target_row = target->row_count - 1;
+    uint32_t target_glyph = layout_glyph_at_x(target, target_row, *goal_x);
+    return syntax_line_start(syntax, target_line) + target->offsets[target_glyph];
+}
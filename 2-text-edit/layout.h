@@ -0,0 +1,63 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include "arena.h"
+#include "common.h"
+#include "editor.h"
+#include "renderer.h"
+
+// Text area inset, in screen pixels at any zoom
+enum { TEXT_MARGIN_LEFT = 20, TEXT_MARGIN_TOP = 50 };
+enum { LAYOUT_CACHE_CAPACITY = 4096, LAYOUT_MAX_LINE_GLYPHS = 1 << 20, LAYOUT_WRAP_LOOKBACK = 64 };
+
+// Glyph positions of one line, newline excluded. offsets and x both have glyph_count + 1 entries,
+// the last ones being the laid out length and the line width, so every lookup is a binary search.
+// Rows start at the glyph indices in row_starts, row_starts[0] is always 0.
+typedef struct Line_Layout {
+    bool used;
+    uint32_t line_id;
+    uint32_t glyph_count; // Lines past LAYOUT_MAX_LINE_GLYPHS are only laid out up to there
+    uint32_t *offsets;    // Byte offset of each glyph from the line start
+    float *x;             // Prefix sums of the advances
+
+    uint32_t *row_starts;
+    uint32_t row_count;
+    uint32_t row_cap;
+    float wrap_width;     // The rows were broken for this width, 0 when not wrapping
+} Line_Layout;
+
+// Line layouts keyed by Syntax_Line.id. Edits give the lines they touch new ids, so only those get laid out again,
+// and a resize only re-breaks rows. Whoever owns the editor state owns this, it never touches GL.
+typedef struct Layout_Cache {
+    const Font *font; // Only its metrics are read
+    float ascii_advance[128];
+    float line_height;
+    bool wrap;
+
+    int width, height; // Window size in pixels
+    float zoom;
+    float wrap_width;  // In zoomed units, 0 when not wrapping
+
+    Line_Layout *buckets; // Open addressing, twice LAYOUT_CACHE_CAPACITY. Cleared when full.
+    size_t entry_count;
+    Arena arena;          // Glyph and row arrays of the entries, reset along with them
+
+} Layout_Cache;
+
+void layout_init(Layout_Cache *layout, const Font *font, bool wrap);
+void layout_free(Layout_Cache *layout);
+void layout_resize(Layout_Cache *layout, int width, int height);
+
+// All of these bring the syntax lines up to date first, layout relies on their ids
+Line_Layout *layout_line(Layout_Cache *layout, Text_Edit_State *state, size_t line);
+void layout_update_scroll(Layout_Cache *layout, Text_Edit_State *state);
+size_t layout_hit_test(Layout_Cache *layout, Text_Edit_State *state, float x, float y);
+size_t layout_move_vertical(Layout_Cache *layout, Text_Edit_State *state, int direction, float *goal_x);
+
+uint32_t layout_row_of_glyph(const Line_Layout *line, uint32_t glyph);
+uint32_t layout_row_end(const Line_Layout *line, uint32_t row);
+uint32_t layout_row_visible_end(const Layout_Cache *layout, const Line_Layout *line, uint32_t row);
+uint32_t layout_glyph_at_offset(const Line_Layout *line, size_t offset);
+uint32_t layout_glyph_at_x(const Line_Layout *line, uint32_t row, float x);
+
+#endif
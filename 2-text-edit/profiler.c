@@ -0,0 +1,397 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "glad/glad.h"
+
+#include "arena.h"
+#include "profiler.h"
+
+// Timestamp queries of a frame stay in flight this many frames before they are waited on
+enum { PROFILE_QUERY_SETS = 4, PROFILE_QUERIES_PER_SET = 2 + PROFILE_MAX_EVENTS * 2 };
+enum { PROFILE_MAX_DEPTH = 16, OVERLAY_GRAPH_FRAMES = 120 };
+
+typedef struct Profile_Query_Set {
+    uint32_t queries[PROFILE_QUERIES_PER_SET]; // 0 and 1 bracket the whole frame
+    uint32_t next_query;
+    uint64_t frame_index;
+    bool pending;
+} Profile_Query_Set;
+
+typedef struct Profiler {
+    bool initialized;
+    bool gpu_timers;
+    bool overlay_visible;
+    int64_t gpu_to_cpu_ns; // Added to GPU timestamps to put them on the CPU clock
+
+    Profile_Frame *frames; // Ring of PROFILE_HISTORY_FRAMES, indexed by frame index
+    uint64_t frame_index;  // The frame being recorded
+    bool in_frame;
+
+    int32_t stack[PROFILE_MAX_DEPTH]; // Open event indices, -1 for events that didn't fit
+    uint32_t depth;
+
+    Profile_Query_Set query_sets[PROFILE_QUERY_SETS];
+} Profiler;
+
+static Profiler g_profiler;
+
+static const char *g_zone_names[PROFILE_ZONE_COUNT] = {
+    [PROFILE_ZONE_INPUT]      = "input",
+    [PROFILE_ZONE_IO]         = "io",
+    [PROFILE_ZONE_SNAPSHOT]   = "snapshot",
+    [PROFILE_ZONE_BACKGROUND] = "background",
+    [PROFILE_ZONE_TEXT]       = "text",
+    [PROFILE_ZONE_COMPOSITE]  = "composite",
+    [PROFILE_ZONE_UI]         = "ui",
+    [PROFILE_ZONE_OVERLAY]    = "overlay",
+    [PROFILE_ZONE_SWAP]       = "swap",
+};
+
+// Draw passes get a timestamp pair around them as well
+static const bool g_zone_on_gpu[PROFILE_ZONE_COUNT] = {
+    [PROFILE_ZONE_BACKGROUND] = true,
+    [PROFILE_ZONE_TEXT]       = true,
+    [PROFILE_ZONE_COMPOSITE]  = true,
+    [PROFILE_ZONE_UI]         = true,
+    [PROFILE_ZONE_OVERLAY]    = true,
+};
+
+static vec4 g_zone_colors[PROFILE_ZONE_COUNT] = {
+    [PROFILE_ZONE_INPUT]      = {0.86f, 0.62f, 0.42f, 0.9f},
+    [PROFILE_ZONE_IO]         = {0.6f, 0.78f, 0.5f, 0.9f},
+    [PROFILE_ZONE_SNAPSHOT]   = {0.82f, 0.56f, 0.76f, 0.9f},
+    [PROFILE_ZONE_BACKGROUND] = {0.5f, 0.5f, 0.46f, 0.9f},
+    [PROFILE_ZONE_TEXT]       = {0.52f, 0.72f, 0.86f, 0.9f},
+    [PROFILE_ZONE_COMPOSITE]  = {0.42f, 0.62f, 0.62f, 0.9f},
+    [PROFILE_ZONE_UI]         = {0.74f, 0.6f, 0.86f, 0.9f},
+    [PROFILE_ZONE_OVERLAY]    = {0.4f, 0.4f, 0.4f, 0.9f},
+    [PROFILE_ZONE_SWAP]       = {0.9f, 0.85f, 0.4f, 0.9f},
+};
+
+void profiler_init(bool gpu_timers) {
+    memset(&g_profiler, 0, sizeof(g_profiler));
+    g_profiler.initialized = true;
+    g_profiler.gpu_timers = gpu_timers;
+    g_profiler.frames = arena_alloc_zero(&g_general_arena, PROFILE_HISTORY_FRAMES * sizeof(Profile_Frame));
+
+    if (gpu_timers) {
+        for (int i = 0; i < PROFILE_QUERY_SETS; i++) {
+            glGenQueries(PROFILE_QUERIES_PER_SET, g_profiler.query_sets[i].queries);
+        }
+
+        GLint64 gpu_now;
+        glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+        g_profiler.gpu_to_cpu_ns = (int64_t)get_time_ns() - gpu_now;
+    }
+}
+
+static uint64_t gpu_query_ns(uint32_t query) {
+    GLuint64 value;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &value);
+    return (uint64_t)((int64_t)value + g_profiler.gpu_to_cpu_ns);
+}
+
+// Returns false if the results are not in yet and `wait` is false
+static bool resolve_query_set(Profile_Query_Set *set, bool wait) {
+    if (!set->pending) return true;
+
+    if (!wait) {
+        // NOTE: The frame-end query is issued last, so once it is available all of them are
+        GLint available = 0;
+        glGetQueryObjectiv(set->queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) return false;
+    }
+
+    Profile_Frame *frame = &g_profiler.frames[set->frame_index % PROFILE_HISTORY_FRAMES];
+    if (frame->index == set->frame_index) {
+        frame->gpu_begin_ns = gpu_query_ns(set->queries[0]);
+        frame->gpu_end_ns = gpu_query_ns(set->queries[1]);
+        for (uint32_t i = 0; i < frame->event_count; i++) {
+            Profile_Event *event = &frame->events[i];
+            if (event->gpu_query < 0) continue;
+            event->gpu_begin_ns = gpu_query_ns(set->queries[event->gpu_query]);
+            event->gpu_end_ns = gpu_query_ns(set->queries[event->gpu_query + 1]);
+        }
+        frame->gpu_resolved = true;
+    }
+    set->pending = false;
+    return true;
+}
+
+void profiler_begin_frame() {
+    if (!g_profiler.initialized) return;
+
+    Profile_Frame *frame = &g_profiler.frames[g_profiler.frame_index % PROFILE_HISTORY_FRAMES];
+    memset(frame, 0, offsetof(Profile_Frame, events));
+    frame->index = g_profiler.frame_index;
+    frame->cpu_begin_ns = get_time_ns();
+
+    if (g_profiler.gpu_timers) {
+        Profile_Query_Set *set = &g_profiler.query_sets[g_profiler.frame_index % PROFILE_QUERY_SETS];
+        resolve_query_set(set, true);
+        set->frame_index = g_profiler.frame_index;
+        set->next_query = 2;
+        set->pending = true;
+        glQueryCounter(set->queries[0], GL_TIMESTAMP);
+    }
+
+    g_profiler.depth = 0;
+    g_profiler.in_frame = true;
+}
+
+void profiler_end_frame(Render_Stats stats) {
+    if (!g_profiler.in_frame) return;
+    assert(g_profiler.depth == 0);
+
+    Profile_Frame *frame = &g_profiler.frames[g_profiler.frame_index % PROFILE_HISTORY_FRAMES];
+    frame->cpu_end_ns = get_time_ns();
+    frame->stats = stats;
+
+    if (g_profiler.gpu_timers) {
+        glQueryCounter(g_profiler.query_sets[g_profiler.frame_index % PROFILE_QUERY_SETS].queries[1], GL_TIMESTAMP);
+    }
+
+    g_profiler.in_frame = false;
+    g_profiler.frame_index++;
+
+    // Oldest first, and stop at the first one that's not done since later frames can't be either
+    if (g_profiler.gpu_timers) {
+        for (int i = 0; i < PROFILE_QUERY_SETS; i++) {
+            Profile_Query_Set *set = &g_profiler.query_sets[(g_profiler.frame_index + i) % PROFILE_QUERY_SETS];
+            if (!resolve_query_set(set, false)) break;
+        }
+    }
+}
+
+void profile_begin(Profile_Zone zone) {
+    if (!g_profiler.in_frame) return;
+    if (g_profiler.depth >= PROFILE_MAX_DEPTH) exit_with_error("Profile zones nested too deep");
+
+    Profile_Frame *frame = &g_profiler.frames[g_profiler.frame_index % PROFILE_HISTORY_FRAMES];
+    if (frame->event_count >= PROFILE_MAX_EVENTS) {
+        g_profiler.stack[g_profiler.depth++] = -1;
+        return;
+    }
+
+    int32_t event_index = (int32_t)frame->event_count++;
+    Profile_Event *event = &frame->events[event_index];
+    event->zone = zone;
+    event->depth = g_profiler.depth;
+    event->gpu_query = -1;
+    event->gpu_begin_ns = event->gpu_end_ns = 0;
+    g_profiler.stack[g_profiler.depth++] = event_index;
+
+    if (g_profiler.gpu_timers && g_zone_on_gpu[zone]) {
+        Profile_Query_Set *set = &g_profiler.query_sets[g_profiler.frame_index % PROFILE_QUERY_SETS];
+        event->gpu_query = (int32_t)set->next_query;
+        set->next_query += 2;
+        glQueryCounter(set->queries[event->gpu_query], GL_TIMESTAMP);
+    }
+
+    event->cpu_begin_ns = get_time_ns();
+}
+
+void profile_end(Profile_Zone zone) {
+    if (!g_profiler.in_frame) return;
+    assert(g_profiler.depth > 0);
+
+    int32_t event_index = g_profiler.stack[--g_profiler.depth];
+    if (event_index < 0) return;
+
+    Profile_Frame *frame = &g_profiler.frames[g_profiler.frame_index % PROFILE_HISTORY_FRAMES];
+    Profile_Event *event = &frame->events[event_index];
+    assert(event->zone == zone);
+    (void)zone;
+    event->cpu_end_ns = get_time_ns();
+
+    if (event->gpu_query >= 0) {
+        Profile_Query_Set *set = &g_profiler.query_sets[g_profiler.frame_index % PROFILE_QUERY_SETS];
+        glQueryCounter(set->queries[event->gpu_query + 1], GL_TIMESTAMP);
+    }
+}
+
+void profiler_toggle_overlay() {
+    g_profiler.overlay_visible = !g_profiler.overlay_visible;
+}
+
+bool profiler_overlay_visible() {
+    return g_profiler.overlay_visible;
+}
+
+// Completed frames still in the ring, oldest first
+static uint64_t first_recorded_frame() {
+    return g_profiler.frame_index > PROFILE_HISTORY_FRAMES ? g_profiler.frame_index - PROFILE_HISTORY_FRAMES : 0;
+}
+
+static double ns_to_ms(uint64_t ns) {
+    return ns / 1000000.0;
+}
+
+void profiler_draw_overlay(Font *font, int width, int height) {
+    (void)height;
+    if (!g_profiler.initialized || g_profiler.frame_index == 0) return;
+
+    float bar_w = 3.0f;
+    float graph_w = bar_w * OVERLAY_GRAPH_FRAMES;
+    float graph_h = 100.0f;
+    float graph_ms = 33.3f; // Full graph height
+    float text_scale = 0.5f;
+    float line_h = font->points_height * text_scale;
+    float panel_w = graph_w + 20.0f;
+    float panel_h = graph_h + line_h * (PROFILE_ZONE_COUNT + 4) + 30.0f;
+    float panel_x = width - panel_w - 10.0f;
+    float panel_y = 10.0f;
+    float graph_x = panel_x + 10.0f;
+    float graph_bottom = panel_y + 10.0f + graph_h;
+    float px_per_ms = graph_h / graph_ms;
+
+    draw_quad((Rect){panel_x, panel_y, panel_w, panel_h}, (vec4){0.05f, 0.04f, 0.04f, 0.85f});
+
+    // Stacked CPU zones per frame, with a tick for the GPU frame time once it is known
+    uint64_t first = first_recorded_frame();
+    uint64_t graph_first = g_profiler.frame_index > OVERLAY_GRAPH_FRAMES ? g_profiler.frame_index - OVERLAY_GRAPH_FRAMES : 0;
+    if (graph_first < first) graph_first = first;
+    for (uint64_t index = graph_first; index < g_profiler.frame_index; index++) {
+        const Profile_Frame *frame = &g_profiler.frames[index % PROFILE_HISTORY_FRAMES];
+        float x = graph_x + graph_w - (float)(g_profiler.frame_index - index) * bar_w;
+
+        float total_h = fminf((float)ns_to_ms(frame->cpu_end_ns - frame->cpu_begin_ns) * px_per_ms, graph_h);
+        draw_quad((Rect){x, graph_bottom - total_h, bar_w - 1.0f, total_h}, (vec4){0.3f, 0.3f, 0.3f, 0.9f});
+
+        float y = graph_bottom;
+        for (uint32_t i = 0; i < frame->event_count; i++) {
+            const Profile_Event *event = &frame->events[i];
+            if (event->depth != 0) continue;
+            float h = (float)ns_to_ms(event->cpu_end_ns - event->cpu_begin_ns) * px_per_ms;
+            if (h < 0.5f) continue;
+            if (y - h < graph_bottom - graph_h) h = y - (graph_bottom - graph_h);
+            y -= h;
+            draw_quad((Rect){x, y, bar_w - 1.0f, h}, g_zone_colors[event->zone]);
+        }
+
+        if (frame->gpu_resolved) {
+            float gpu_h = fminf((float)ns_to_ms(frame->gpu_end_ns - frame->gpu_begin_ns) * px_per_ms, graph_h);
+            draw_quad((Rect){x, graph_bottom - gpu_h - 1.0f, bar_w - 1.0f, 2.0f}, (vec4){1.0f, 1.0f, 1.0f, 0.9f});
+        }
+    }
+
+    // 60 Hz budget
+    draw_quad((Rect){graph_x, graph_bottom - 16.7f * px_per_ms, graph_w, 1.0f}, (vec4){0.9f, 0.3f, 0.3f, 0.7f});
+
+    // Averages over the whole history
+    double cpu_sum[PROFILE_ZONE_COUNT] = {0}, gpu_sum[PROFILE_ZONE_COUNT] = {0};
+    double frame_sum = 0.0, frame_max = 0.0, gpu_frame_sum = 0.0;
+    size_t frame_count = 0, gpu_frame_count = 0;
+    for (uint64_t index = first; index < g_profiler.frame_index; index++) {
+        const Profile_Frame *frame = &g_profiler.frames[index % PROFILE_HISTORY_FRAMES];
+        double frame_ms = ns_to_ms(frame->cpu_end_ns - frame->cpu_begin_ns);
+        frame_sum += frame_ms;
+        if (frame_ms > frame_max) frame_max = frame_ms;
+        frame_count++;
+        for (uint32_t i = 0; i < frame->event_count; i++) {
+            const Profile_Event *event = &frame->events[i];
+            cpu_sum[event->zone] += ns_to_ms(event->cpu_end_ns - event->cpu_begin_ns);
+            if (frame->gpu_resolved && event->gpu_query >= 0) {
+                gpu_sum[event->zone] += ns_to_ms(event->gpu_end_ns - event->gpu_begin_ns);
+            }
+        }
+        if (frame->gpu_resolved) {
+            gpu_frame_sum += ns_to_ms(frame->gpu_end_ns - frame->gpu_begin_ns);
+            gpu_frame_count++;
+        }
+    }
+
+    const Profile_Frame *last = &g_profiler.frames[(g_profiler.frame_index - 1) % PROFILE_HISTORY_FRAMES];
+    float text_y = graph_bottom + 10.0f + line_h;
+    for (int zone = 0; zone < PROFILE_ZONE_COUNT; zone++) {
+        draw_quad((Rect){graph_x, text_y + zone * line_h - line_h * 0.6f, 8.0f, 8.0f}, g_zone_colors[zone]);
+    }
+
+    // NOTE: The editor font is large, so the text is drawn at half scale through the projection
+    set_view_zoom(text_scale);
+    vec4 text_color = {0.86f, 0.86f, 0.86f, 0.95f};
+    char line[128];
+    float x = (graph_x + 14.0f) / text_scale;
+    float y = text_y / text_scale;
+    for (int zone = 0; zone < PROFILE_ZONE_COUNT; zone++, y += font->points_height) {
+        if (g_zone_on_gpu[zone] && gpu_frame_count) {
+            snprintf(line, sizeof(line), "%-10s cpu %6.2f  gpu %6.2f ms", g_zone_names[zone],
+                     cpu_sum[zone] / frame_count, gpu_sum[zone] / gpu_frame_count);
+        } else {
+            snprintf(line, sizeof(line), "%-10s cpu %6.2f ms", g_zone_names[zone], cpu_sum[zone] / frame_count);
+        }
+        draw_string(line, (vec2){x, y}, text_color, font, font->points_height);
+    }
+
+    x = graph_x / text_scale;
+    snprintf(line, sizeof(line), "frame cpu %.2f avg %.2f max ms", frame_sum / frame_count, frame_max);
+    draw_string(line, (vec2){x, y}, text_color, font, font->points_height);
+    y += font->points_height;
+    if (gpu_frame_count) {
+        snprintf(line, sizeof(line), "frame gpu %.2f avg ms", gpu_frame_sum / gpu_frame_count);
+    } else {
+        snprintf(line, sizeof(line), "frame gpu n/a");
+    }
+    draw_string(line, (vec2){x, y}, text_color, font, font->points_height);
+    y += font->points_height;
+    snprintf(line, sizeof(line), "draws %llu  upload %.1f KB",
+             (unsigned long long)last->stats.draw_calls, last->stats.upload_bytes / 1024.0);
+    draw_string(line, (vec2){x, y}, text_color, font, font->points_height);
+    y += font->points_height;
+    snprintf(line, sizeof(line), "heap allocs %llu  frame arena %.1f KB",
+             (unsigned long long)last->stats.heap_allocations, last->stats.frame_arena_bytes / 1024.0);
+    draw_string(line, (vec2){x, y}, text_color, font, font->points_height);
+    set_view_zoom(1.0f);
+}
+
+static void write_trace_event(FILE *file, bool *first_event, const char *name, int tid, uint64_t begin_ns,
+                              uint64_t end_ns, uint64_t base_ns) {
+    fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+            *first_event ? "" : ",", name, tid, (begin_ns - base_ns) / 1000.0, (end_ns - begin_ns) / 1000.0);
+    *first_event = false;
+}
+
+// The ring's contents in the Trace Event Format, for chrome://tracing or Perfetto. GPU passes get their own track.
+bool profiler_write_chrome_trace(const char *file_name) {
+    if (!g_profiler.initialized || g_profiler.frame_index == 0) return false;
+
+    FILE *file = fopen(file_name, "w");
+    if (!file) return false;
+
+    uint64_t first = first_recorded_frame();
+    uint64_t base_ns = g_profiler.frames[first % PROFILE_HISTORY_FRAMES].cpu_begin_ns;
+    bool first_event = true;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    fprintf(file, "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},");
+    fprintf(file, "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}},");
+    for (uint64_t index = first; index < g_profiler.frame_index; index++) {
+        const Profile_Frame *frame = &g_profiler.frames[index % PROFILE_HISTORY_FRAMES];
+        // NOTE: GPU work can land before the base when the clocks disagree slightly, skip it rather than wrap
+        write_trace_event(file, &first_event, "frame", 1, frame->cpu_begin_ns, frame->cpu_end_ns, base_ns);
+        if (frame->gpu_resolved && frame->gpu_begin_ns >= base_ns) {
+            write_trace_event(file, &first_event, "frame", 2, frame->gpu_begin_ns, frame->gpu_end_ns, base_ns);
+        }
+
+        for (uint32_t i = 0; i < frame->event_count; i++) {
+            const Profile_Event *event = &frame->events[i];
+            write_trace_event(file, &first_event, g_zone_names[event->zone], 1,
+                              event->cpu_begin_ns, event->cpu_end_ns, base_ns);
+            if (frame->gpu_resolved && event->gpu_query >= 0 && event->gpu_begin_ns >= base_ns) {
+                write_trace_event(file, &first_event, g_zone_names[event->zone], 2,
+                                  event->gpu_begin_ns, event->gpu_end_ns, base_ns);
+            }
+        }
+
+        fprintf(file, ",\n{\"name\":\"render\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,"
+                      "\"args\":{\"draw_calls\":%llu,\"upload_kb\":%.2f}}",
+                (frame->cpu_begin_ns - base_ns) / 1000.0,
+                (unsigned long long)frame->stats.draw_calls, frame->stats.upload_bytes / 1024.0);
+    }
+    fprintf(file, "\n]}\n");
+
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
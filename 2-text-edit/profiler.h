@@ -0,0 +1,55 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "common.h"
+#include "renderer.h"
+
+enum { PROFILE_HISTORY_FRAMES = 240, PROFILE_MAX_EVENTS = 32 };
+
+typedef enum Profile_Zone {
+    PROFILE_ZONE_INPUT,      // Polling events, which runs the key and char callbacks
+    PROFILE_ZONE_IO,         // Async image uploads
+    PROFILE_ZONE_SNAPSHOT,   // Getting the frame's render snapshot, built inline only by the bench
+    PROFILE_ZONE_BACKGROUND, // Clear and background image
+    PROFILE_ZONE_TEXT,       // Text geometry and its draws
+    PROFILE_ZONE_COMPOSITE,  // The cached text layer and the cursor on top of it
+    PROFILE_ZONE_UI,         // Search bar and notifications
+    PROFILE_ZONE_OVERLAY,
+    PROFILE_ZONE_SWAP,
+    PROFILE_ZONE_COUNT
+} Profile_Zone;
+
+typedef struct Profile_Event {
+    Profile_Zone zone;
+    uint32_t depth;
+    int32_t gpu_query; // First of a timestamp pair in the frame's query set, -1 if CPU only
+    uint64_t cpu_begin_ns, cpu_end_ns;
+    uint64_t gpu_begin_ns, gpu_end_ns; // On the CPU clock, 0 until the queries resolve
+} Profile_Event;
+
+typedef struct Profile_Frame {
+    uint64_t index;
+    uint64_t cpu_begin_ns, cpu_end_ns;
+    uint64_t gpu_begin_ns, gpu_end_ns;
+    bool gpu_resolved;
+    Render_Stats stats;
+
+    Profile_Event events[PROFILE_MAX_EVENTS];
+    uint32_t event_count;
+} Profile_Frame;
+
+// GPU timestamps are read a few frames late, so asking never stalls the pipeline.
+// Without GPU timers (null backend, or no GL) only CPU zones are recorded.
+// Render thread only, the editor thread's work shows up as how fresh its snapshots are.
+void profiler_init(bool gpu_timers);
+void profiler_begin_frame();
+void profiler_end_frame(Render_Stats stats);
+void profile_begin(Profile_Zone zone);
+void profile_end(Profile_Zone zone);
+
+void profiler_toggle_overlay();
+bool profiler_overlay_visible();
+void profiler_draw_overlay(Font *font, int width, int height);
+bool profiler_write_chrome_trace(const char *file_name);
+
+#endif
@@ -0,0 +1,1399 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "glad/glad.h"
+
+#include "arena.h"
+#include "renderer.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb/stb_image.h"
+#define STB_TRUETYPE_IMPLEMENTATION
+#include "stb/stb_truetype.h"
+
+enum { MAX_VERT = 1024, MAX_IDX = 4096 };
+enum { SDF_PADDING = 4, SDF_ON_EDGE_VALUE = 128 };
+enum { GRID_PALETTE_MAX = 16, GRID_GLYPH_BINDING = 0 };
+enum { ATLAS_CACHE_MAGIC = 0x53544C41, ATLAS_CACHE_VERSION = 1 }; // "ALTS"
+
+typedef struct Gl_State {
+    uint32_t vbo;
+    uint32_t ebo;
+    uint32_t vao;
+    uint32_t shader;
+    uint32_t sdf_shader;
+    uint32_t grid_shader;
+    uint32_t grid_vao; // Empty, the grid quad comes from gl_VertexID
+    Texture empty_texture;
+
+    Render_Backend backend;
+    Render_Stats stats;
+    uint64_t heap_allocations_taken; // This thread's count at the last renderer_take_stats
+    uint32_t next_null_texture_id; // Textures still get distinct nonzero ids without GL
+    int viewport_w, viewport_h;
+    float zoom;
+    int target_fbo; // Where drawing goes outside of layers, not always 0 (the bench draws offscreen)
+} Gl_State;
+
+typedef struct Atlas_Cache_Header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t ttf_hash;
+    float points_height;
+    int32_t atlas_dim;
+    int32_t sdf;
+    int32_t cell_w, cell_h;
+    uint32_t slot_size;
+    uint32_t used_slot_count;
+    int32_t lru_head, lru_tail;
+} Atlas_Cache_Header;
+
+static Gl_State g_gl_state;
+static char gl_error_buffer[ONE_MB];
+
+static uint32_t build_shader_from_src(const char *src, GLenum shader_type);
+static uint32_t link_vert_frag_shaders(uint32_t vert, uint32_t frag);
+static uint32_t build_default_shaders();
+static uint32_t build_sdf_shaders();
+static uint32_t build_grid_shaders();
+static void initialize_gl_state();
+
+static uint32_t build_shader_from_src(const char *src, GLenum shader_type) {
+    uint32_t id = glCreateShader(shader_type);
+    glShaderSource(id, 1, &src, NULL);
+    glCompileShader(id);
+
+    int success;
+    glGetShaderiv(id, GL_COMPILE_STATUS, &success);
+
+    if (!success) {
+        glGetShaderInfoLog(id, ONE_MB, NULL, gl_error_buffer);
+        exit_with_error("Failed to compile shader (type 0x%04X). Error:\n  %s\nSource:\n%s\n", shader_type, gl_error_buffer, src);
+    }
+
+    return id;
+}
+
+static uint32_t link_vert_frag_shaders(uint32_t vert, uint32_t frag) {
+    uint32_t id = glCreateProgram();
+    glAttachShader(id, vert);
+    glAttachShader(id, frag);
+    glLinkProgram(id);
+
+    int success;
+    glGetProgramiv(id, GL_LINK_STATUS, &success);
+
+    if (!success) {
+        glGetProgramInfoLog(id, ONE_MB, NULL, gl_error_buffer);
+        exit_with_error("Failed to compile program. Error:\n  %s", gl_error_buffer);
+    }
+
+    return id;
+}
+
+static const char *default_vert_shader_source =
+    "#version 430 core\n"
+    "layout (location = 0) in vec2 aPos;\n"
+    "layout (location = 1) in vec2 aTexCoord;\n"
+    "layout (location = 2) in vec4 aColor;\n"
+    "uniform mat4 projection;\n"
+    "out vec2 TexCoord;\n"
+    "out vec4 Color;\n"
+    "void main() {\n"
+    "    gl_Position = projection * vec4(aPos, 0.0, 1.0);\n"
+    "    TexCoord = aTexCoord;\n"
+    "    Color = aColor;\n"
+    "}";
+
+static uint32_t build_default_shaders() {
+    uint32_t vert_shader = build_shader_from_src(default_vert_shader_source, GL_VERTEX_SHADER);
+
+    static const char *frag_shader_source =
+        "#version 430 core\n"
+        "out vec4 FragColor;\n"
+        "in vec2 TexCoord;\n"
+        "in vec4 Color;\n"
+        "uniform sampler2D texture1;\n"
+        "void main() {\n"
+        "    FragColor = Color * texture(texture1, TexCoord);\n"
+        "}";
+    uint32_t frag_shader = build_shader_from_src(frag_shader_source, GL_FRAGMENT_SHADER);
+
+    uint32_t shader_program = link_vert_frag_shaders(vert_shader, frag_shader);
+
+    glDeleteShader(vert_shader);
+    glDeleteShader(frag_shader);
+
+    return shader_program;
+}
+
+static uint32_t build_sdf_shaders() {
+    uint32_t vert_shader = build_shader_from_src(default_vert_shader_source, GL_VERTEX_SHADER);
+
+    // NOTE: The distance field lives in alpha (see the atlas swizzle). The smoothing width comes from
+    //       the screen-space derivative, so edges stay one pixel wide at any zoom.
+    static const char *frag_shader_source =
+        "#version 430 core\n"
+        "out vec4 FragColor;\n"
+        "in vec2 TexCoord;\n"
+        "in vec4 Color;\n"
+        "uniform sampler2D texture1;\n"
+        "uniform float on_edge;\n"
+        "void main() {\n"
+        "    float dist = texture(texture1, TexCoord).a;\n"
+        "    float smoothing = max(fwidth(dist) * 0.5, 1.0 / 255.0);\n"
+        "    float coverage = smoothstep(on_edge - smoothing, on_edge + smoothing, dist);\n"
+        "    FragColor = vec4(Color.rgb, Color.a * coverage);\n"
+        "}";
+    uint32_t frag_shader = build_shader_from_src(frag_shader_source, GL_FRAGMENT_SHADER);
+
+    uint32_t shader_program = link_vert_frag_shaders(vert_shader, frag_shader);
+
+    glDeleteShader(vert_shader);
+    glDeleteShader(frag_shader);
+
+    glUseProgram(shader_program);
+    glUniform1f(glGetUniformLocation(shader_program, "on_edge"), SDF_ON_EDGE_VALUE / 255.0f);
+    glUseProgram(0);
+
+    return shader_program;
+}
+
+static uint32_t build_grid_shaders() {
+    // NOTE: Covers the whole grid with one quad. Positions stay in text space, so zoom is just the projection.
+    static const char *vert_shader_source =
+        "#version 430 core\n"
+        "uniform mat4 projection;\n"
+        "uniform vec2 origin;\n"
+        "uniform vec2 grid_extent;\n"
+        "out vec2 GridPos;\n"
+        "void main() {\n"
+        "    GridPos = vec2(gl_VertexID & 1, gl_VertexID >> 1) * grid_extent;\n"
+        "    gl_Position = projection * vec4(origin + GridPos, 0.0, 1.0);\n"
+        "}";
+    uint32_t vert_shader = build_shader_from_src(vert_shader_source, GL_VERTEX_SHADER);
+
+    // Each fragment finds its cell, then the glyph's box in that cell from the metrics table,
+    // and samples the atlas directly. Blanks, highlights and the cursor are cell flags.
+    static const char *frag_shader_source =
+        "#version 430 core\n"
+        "layout(std430, binding = 0) readonly buffer Glyph_Boxes { vec4 glyph_boxes[]; };\n"
+        "out vec4 FragColor;\n"
+        "in vec2 GridPos;\n"
+        "uniform usampler2D cells;\n"
+        "uniform sampler2D atlas;\n"
+        "uniform vec2 cell_size;\n"
+        "uniform float ascent;\n"
+        "uniform ivec3 atlas_layout;\n" // Slot columns, slot width, slot height
+        "uniform float atlas_dim;\n"
+        "uniform vec4 palette[16];\n"
+        "uniform vec4 highlight_color;\n"
+        "uniform bool sdf;\n"
+        "uniform float on_edge;\n"
+        "void main() {\n"
+        "    ivec2 cell_index = ivec2(floor(GridPos / cell_size));\n"
+        "    uvec4 cell = texelFetch(cells, cell_index, 0);\n"
+        "    uint glyph = cell.r | (cell.g << 8);\n"
+        "    bool blank = glyph == 0xFFFFu;\n"
+        "    int slot = blank ? 0 : int(glyph);\n"
+        "    vec4 foreground = palette[cell.b];\n"
+        "    vec4 background = vec4(0.0);\n"
+        "    if ((cell.a & 2u) != 0u) {\n"
+        "        background = palette[0];\n"
+        "        foreground = vec4(1.0 - palette[0].rgb, palette[0].a);\n"
+        "    } else if ((cell.a & 1u) != 0u) {\n"
+        "        background = highlight_color;\n"
+        "    }\n"
+        "    vec4 box = glyph_boxes[slot];\n"
+        "    vec2 p = GridPos - vec2(cell_index) * cell_size - vec2(box.x, ascent + box.y);\n"
+        "    bool inside = !blank && all(greaterThanEqual(p, vec2(0.0))) && all(lessThan(p, box.zw));\n"
+        "    vec2 slot_origin = vec2((slot % atlas_layout.x) * atlas_layout.y, (slot / atlas_layout.x) * atlas_layout.z);\n"
+        "    float value = texture(atlas, (slot_origin + clamp(p, vec2(0.0), box.zw)) / atlas_dim).a;\n"
+        "    float smoothing = max(fwidth(value) * 0.5, 1.0 / 255.0);\n"
+        "    if (sdf) value = smoothstep(on_edge - smoothing, on_edge + smoothing, value);\n"
+        "    float glyph_alpha = inside ? foreground.a * value : 0.0;\n"
+        "    float alpha = glyph_alpha + background.a * (1.0 - glyph_alpha);\n"
+        "    if (alpha <= 0.0) discard;\n"
+        "    FragColor = vec4((foreground.rgb * glyph_alpha + background.rgb * background.a * (1.0 - glyph_alpha)) / alpha, alpha);\n"
+        "}";
+    uint32_t frag_shader = build_shader_from_src(frag_shader_source, GL_FRAGMENT_SHADER);
+
+    uint32_t shader_program = link_vert_frag_shaders(vert_shader, frag_shader);
+
+    glDeleteShader(vert_shader);
+    glDeleteShader(frag_shader);
+
+    glUseProgram(shader_program);
+    glUniform1i(glGetUniformLocation(shader_program, "cells"), 0);
+    glUniform1i(glGetUniformLocation(shader_program, "atlas"), 1);
+    glUniform1f(glGetUniformLocation(shader_program, "on_edge"), SDF_ON_EDGE_VALUE / 255.0f);
+    glUseProgram(0);
+
+    return shader_program;
+}
+
+static void initialize_gl_state() {
+    Gl_State gl_state = g_gl_state;
+
+    glGenVertexArrays(1, &gl_state.vao);
+    glGenBuffers(1, &gl_state.vbo);
+    glGenBuffers(1, &gl_state.ebo);
+
+    glBindVertexArray(gl_state.vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, gl_state.vbo);
+
+    size_t total_size = MAX_VERT * (2 + 2 + 4) * sizeof(float);
+    glBufferData(GL_ARRAY_BUFFER, total_size, NULL, GL_STREAM_DRAW);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gl_state.ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, MAX_IDX * sizeof(uint32_t), NULL, GL_STREAM_DRAW);
+
+    // Positions -- vec2
+    size_t stride = 2 * sizeof(float);
+    size_t offset = 0;
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride, (void *)offset);
+    glEnableVertexAttribArray(0);
+
+    // TexCoords -- vec2
+    offset += stride * MAX_VERT;
+    stride = 2 * sizeof(float);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void *)offset);
+    glEnableVertexAttribArray(1);
+
+    // Color -- vec4
+    offset += stride * MAX_VERT;
+    stride = 4 * sizeof(float);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, stride, (void *)offset);
+    glEnableVertexAttribArray(2);
+
+    offset += stride * MAX_VERT;
+    assert(offset == total_size);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    gl_state.shader = build_default_shaders();
+    gl_state.sdf_shader = build_sdf_shaders();
+    gl_state.grid_shader = build_grid_shaders();
+    glGenVertexArrays(1, &gl_state.grid_vao);
+
+    g_gl_state = gl_state;
+    g_gl_state.empty_texture = load_empty_texture();
+}
+
+void renderer_init(Render_Backend backend, int width, int height) {
+    memset(&g_gl_state, 0, sizeof(g_gl_state));
+    g_gl_state.backend = backend;
+
+    if (backend == RENDER_BACKEND_NULL) {
+        g_gl_state.empty_texture = load_empty_texture();
+    } else {
+        initialize_gl_state();
+
+        glEnable(GL_BLEND);
+        // NOTE: Alpha accumulates as "over" too, so layers stay opaque and composite without blending
+        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        glClearColor(0.09f, 0.07f, 0.07f, 1.0f);
+    }
+
+    renderer_resize(width, height);
+}
+
+void renderer_resize(int width, int height) {
+    g_gl_state.viewport_w = width;
+    g_gl_state.viewport_h = height;
+    if (g_gl_state.backend == RENDER_BACKEND_GL) glViewport(0, 0, width, height);
+    set_ortho_projection(width, height);
+}
+
+void renderer_begin_frame() {
+    if (g_gl_state.backend == RENDER_BACKEND_GL) glClear(GL_COLOR_BUFFER_BIT);
+}
+
+// Counters since the previous call
+Render_Stats renderer_take_stats() {
+    Render_Stats stats = g_gl_state.stats;
+    uint64_t heap_allocations = heap_allocation_count();
+    stats.heap_allocations = heap_allocations - g_gl_state.heap_allocations_taken;
+    stats.frame_arena_bytes = g_frame_arena.used;
+    g_gl_state.heap_allocations_taken = heap_allocations;
+    memset(&g_gl_state.stats, 0, sizeof(g_gl_state.stats));
+    return stats;
+}
+
+static uint32_t null_texture_id() {
+    return ++g_gl_state.next_null_texture_id;
+}
+
+static void upload_projection(mat4 projection) {
+    g_gl_state.stats.upload_bytes += 2 * sizeof(mat4);
+    if (g_gl_state.backend == RENDER_BACKEND_NULL) return;
+
+    uint32_t shaders[] = { g_gl_state.shader, g_gl_state.sdf_shader, g_gl_state.grid_shader };
+    for (size_t i = 0; i < sizeof(shaders) / sizeof(shaders[0]); i++) {
+        glUseProgram(shaders[i]);
+        glUniformMatrix4fv(glGetUniformLocation(shaders[i], "projection"), 1, GL_FALSE, (float *)projection);
+    }
+    glUseProgram(0);
+}
+
+void set_ortho_projection(int width, int height) {
+    g_gl_state.zoom = 1.0f;
+    mat4 projection;
+    glm_ortho(0.0f, width, height, 0.0f, -1.0f, 1.0f, projection);
+    upload_projection(projection);
+}
+
+void set_view_zoom(float zoom) {
+    g_gl_state.zoom = zoom;
+    mat4 projection;
+    glm_ortho(0.0f, g_gl_state.viewport_w, g_gl_state.viewport_h, 0.0f, -1.0f, 1.0f, projection);
+    glm_scale(projection, (vec3){zoom, zoom, 1.0f});
+    upload_projection(projection);
+}
+
+Texture load_texture(const char *file) {
+    stbi_set_flip_vertically_on_load(false);
+    int width, height, channel_count;
+    uint8_t *image_data = stbi_load(file, &width, &height, &channel_count, STBI_rgb_alpha);
+    if (image_data == NULL) {
+        exit_with_error("Failed to load image at %s", file);
+    }
+
+    Texture texture = upload_texture_rgba(image_data, width, height);
+    stbi_image_free(image_data);
+
+    return texture;
+}
+
+Texture upload_texture_rgba(const uint8_t *pixels, int width, int height) {
+    Texture texture = {0};
+    texture.w = (float)width;
+    texture.h = (float)height;
+
+    g_gl_state.stats.upload_bytes += (uint64_t)width * height * 4;
+    if (g_gl_state.backend == RENDER_BACKEND_NULL) {
+        texture.id = null_texture_id();
+        return texture;
+    }
+
+    glGenTextures(1, &texture.id);
+    glBindTexture(GL_TEXTURE_2D, texture.id);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return texture;
+}
+
+static void *decode_image_proc(void *arg) {
+    Async_Image *image = arg;
+    int channel_count;
+    image->pixels = stbi_load(image->file_name, &image->w, &image->h, &channel_count, STBI_rgb_alpha);
+    atomic_store_explicit(&image->decoded, true, memory_order_release);
+    return NULL;
+}
+
+void load_image_async(Async_Image *image, const char *file) {
+    image->file_name = file;
+    image->pixels = NULL;
+    atomic_init(&image->decoded, false);
+
+    // NOTE: stb_image keeps this flag in a global, so set it before the worker starts reading it
+    stbi_set_flip_vertically_on_load(false);
+    if (pthread_create(&image->thread, NULL, decode_image_proc, image) != 0) {
+        exit_with_error("Failed to start image decoding thread for %s", file);
+    }
+}
+
+// Returns true once, on the call that uploads the texture
+bool poll_async_texture(Async_Image *image, Texture *out_texture) {
+    if (image->file_name == NULL || !atomic_load_explicit(&image->decoded, memory_order_acquire)) {
+        return false;
+    }
+
+    pthread_join(image->thread, NULL);
+    const char *file_name = image->file_name;
+    image->file_name = NULL;
+
+    if (image->pixels == NULL) {
+        trace_log("Failed to load image at %s: %s", file_name, stbi_failure_reason());
+        return false;
+    }
+
+    *out_texture = upload_texture_rgba(image->pixels, image->w, image->h);
+    stbi_image_free(image->pixels);
+    image->pixels = NULL;
+
+    return true;
+}
+
+Texture load_empty_texture() {
+    Texture texture = {0};
+    texture.w = texture.h = 1;
+
+    g_gl_state.stats.upload_bytes += 4;
+    if (g_gl_state.backend == RENDER_BACKEND_NULL) {
+        texture.id = null_texture_id();
+        return texture;
+    }
+
+    glGenTextures(1, &texture.id);
+    glBindTexture(GL_TEXTURE_2D, texture.id);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    uint32_t white = -1;
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, &white);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return texture;
+}
+
+void draw_texture(Rect dest, Texture texture, Rect src, vec4 color) {
+    draw_texture_with_shader(dest, texture, src, color, g_gl_state.shader);
+}
+
+void draw_texture_with_shader(Rect dest, Texture texture, Rect src, vec4 color, uint32_t shader) {
+    // Positions, tex coords, colors and indices for one quad
+    g_gl_state.stats.draw_calls++;
+    g_gl_state.stats.upload_bytes += 4 * (2 + 2 + 4) * sizeof(float) + 6 * sizeof(uint32_t);
+    if (g_gl_state.backend == RENDER_BACKEND_NULL) return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, g_gl_state.vbo);
+
+    size_t total_size = MAX_VERT * (2 + 2 + 4) * sizeof(float);
+    size_t vert_to_sub_count = 4;
+    size_t idx_to_sub_count = 6;
+    assert(vert_to_sub_count < MAX_VERT);
+    assert(idx_to_sub_count < MAX_IDX);
+    size_t stride, offset;
+
+    // Positions -- vec2
+    offset = 0;
+    stride = 2 * sizeof(float);
+    float positions[] = {
+        dest.x, dest.y,
+        dest.x + dest.w, dest.y,
+        dest.x, dest.y + dest.h,
+        dest.x + dest.w, dest.y + dest.h
+    };
+    assert(sizeof(positions) == stride * vert_to_sub_count);
+    glBufferSubData(GL_ARRAY_BUFFER, offset, sizeof(positions), positions);
+
+    // TexCoords -- vec2
+    offset += stride * MAX_VERT;
+    stride = 2 * sizeof(float);
+    Rect src_norm = (Rect){src.x / texture.w, src.y / texture.h, src.w / texture.w, src.h / texture.h};
+    float tex_coords[] = {
+        src_norm.x, src_norm.y,
+        src_norm.x + src_norm.w, src_norm.y,
+        src_norm.x, src_norm.y + src_norm.h,
+        src_norm.x + src_norm.w, src_norm.y + src_norm.h
+    };
+    assert(sizeof(tex_coords) == stride * vert_to_sub_count);
+    glBufferSubData(GL_ARRAY_BUFFER, offset, sizeof(tex_coords), tex_coords);
+
+    // Color -- vec4
+    offset += stride * MAX_VERT;
+    stride = 4 * sizeof(float);
+    float colors[16];
+    for (int i = 0; i < 4; i++) memcpy(colors + i * 4, color, 4 * sizeof(float));
+    assert(sizeof(colors) == stride * vert_to_sub_count);
+    glBufferSubData(GL_ARRAY_BUFFER, offset, sizeof(colors), colors);
+
+    offset += stride * MAX_VERT;
+    assert(offset == total_size);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_gl_state.ebo);
+
+    uint32_t indices[] = {
+        2, 1, 0,
+        2, 3, 1
+    };
+    assert(sizeof(indices) / sizeof(indices[0]) == idx_to_sub_count);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(indices), indices);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    glUseProgram(shader);
+    glBindVertexArray(g_gl_state.vao);
+    glBindTexture(GL_TEXTURE_2D, texture.id);
+
+    glDrawElements(GL_TRIANGLES, idx_to_sub_count, GL_UNSIGNED_INT, 0);
+
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+}
+
+void draw_texture_scaled(vec2 pos, Texture texture, float scale) {
+    vec2 size = {texture.w, texture.h};
+    glm_vec2_scale(size, scale, size);
+    draw_texture((Rect){pos[0], pos[1], size[0], size[1]},
+                 texture,
+                 (Rect){0.0f, 0.0f, texture.w, texture.h},
+                 (vec4){1.0f, 1.0f, 1.0f, 1.0f});
+}
+
+void draw_texture_scaled_tinted(vec2 pos, Texture texture, float scale, vec4 color) {
+    vec2 size = {texture.w, texture.h};
+    glm_vec2_scale(size, scale, size);
+    draw_texture((Rect){pos[0], pos[1], size[0], size[1]},
+                 texture,
+                 (Rect){0.0f, 0.0f, texture.w, texture.h},
+                 color);
+}
+
+void draw_quad(Rect quad, vec4 color) {
+    draw_texture(quad, g_gl_state.empty_texture, (Rect){0}, color);
+}
+
+void layer_resize(Render_Layer *layer, int width, int height) {
+    layer->valid = false;
+    if (layer->tex.w == width && layer->tex.h == height && layer->tex.id) return;
+    layer_free(layer);
+    layer->tex.w = (float)width;
+    layer->tex.h = (float)height;
+    if (g_gl_state.backend == RENDER_BACKEND_NULL) {
+        layer->tex.id = null_texture_id();
+        return;
+    }
+
+    glGenTextures(1, &layer->tex.id);
+    glBindTexture(GL_TEXTURE_2D, layer->tex.id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &g_gl_state.target_fbo);
+    glGenFramebuffers(1, &layer->fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, layer->fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, layer->tex.id, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        exit_with_error("Layer framebuffer %dx%d is incomplete", width, height);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, g_gl_state.target_fbo);
+}
+
+void layer_free(Render_Layer *layer) {
+    if (g_gl_state.backend == RENDER_BACKEND_GL && layer->tex.id) {
+        glDeleteFramebuffers(1, &layer->fbo);
+        glDeleteTextures(1, &layer->tex.id);
+    }
+    memset(layer, 0, sizeof(*layer));
+}
+
+void layer_begin(Render_Layer *layer, Rect damage) {
+    if (g_gl_state.backend == RENDER_BACKEND_NULL) return;
+
+    // NOTE: The projection is y down, so the scissor, which is y up, is flipped
+    int x0 = (int)floorf(damage.x), y0 = (int)floorf(damage.y);
+    int x1 = (int)ceilf(damage.x + damage.w), y1 = (int)ceilf(damage.y + damage.h);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &g_gl_state.target_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, layer->fbo);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(x0, (int)layer->tex.h - y1, x1 - x0, y1 - y0);
+    glClear(GL_COLOR_BUFFER_BIT);
+}
+
+void layer_end() {
+    if (g_gl_state.backend == RENDER_BACKEND_NULL) return;
+    glDisable(GL_SCISSOR_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, g_gl_state.target_fbo);
+}
+
+// Rendering into the layer put the window's top row at the top of the texture, hence the flipped source
+void draw_layer(const Render_Layer *layer) {
+    Rect dest = {0.0f, 0.0f, layer->tex.w, layer->tex.h};
+    Rect src = {0.0f, layer->tex.h, layer->tex.w, -layer->tex.h};
+    if (g_gl_state.backend == RENDER_BACKEND_GL) glDisable(GL_BLEND);
+    draw_texture(dest, layer->tex, src, (vec4){1.0f, 1.0f, 1.0f, 1.0f});
+    if (g_gl_state.backend == RENDER_BACKEND_GL) glEnable(GL_BLEND);
+}
+
+Font load_font(const char *file_name, float points_height, int atlas_dim, bool sdf) {
+    Font font = {0};
+
+    FILE *font_file = fopen(file_name, "rb");
+    if (!font_file) exit_with_error("Failed to load font at %s", file_name);
+
+    fseek(font_file, 0, SEEK_END);
+    size_t font_size = ftell(font_file);
+    rewind(font_file);
+
+    // NOTE: stbtt_fontinfo points into these bytes, so they live as long as the font, which is the process
+    font.ttf_bytes = arena_alloc(&g_general_arena, font_size);
+    fread(font.ttf_bytes, 1, font_size, font_file);
+    fclose(font_file);
+    font.ttf_hash = hash_bytes(font.ttf_bytes, font_size);
+
+    if (!stbtt_InitFont(&font.info, font.ttf_bytes, stbtt_GetFontOffsetForIndex(font.ttf_bytes, 0))) {
+        exit_with_error("Failed to parse font at %s", file_name);
+    }
+
+    font.points_height = points_height;
+    font.scale = stbtt_ScaleForPixelHeight(&font.info, points_height);
+    font.sdf = sdf;
+
+    int bbox_x0, bbox_y0, bbox_x1, bbox_y1;
+    stbtt_GetFontBoundingBox(&font.info, &bbox_x0, &bbox_y0, &bbox_x1, &bbox_y1);
+
+    // 1px gutter so linear filtering never samples a neighboring cell
+    int sdf_border = sdf ? 2 * SDF_PADDING : 0;
+    font.cell_w = (int)ceilf((bbox_x1 - bbox_x0) * font.scale) + sdf_border + 1;
+    font.cell_h = (int)ceilf((bbox_y1 - bbox_y0) * font.scale) + sdf_border + 1;
+    font.cols = atlas_dim / font.cell_w;
+    int rows = atlas_dim / font.cell_h;
+    if (font.cols <= 0 || rows <= 0) {
+        exit_with_error("Font atlas %dx%d is too small for %.1fpt glyphs", atlas_dim, atlas_dim, points_height);
+    }
+
+    font.slot_count = (size_t)font.cols * rows;
+    font.slots = arena_alloc_zero(&g_general_arena, font.slot_count * sizeof(Glyph_Slot));
+    font.lru_head = font.lru_tail = -1;
+
+    font.slot_map_cap = 1;
+    while (font.slot_map_cap < font.slot_count * 2) font.slot_map_cap *= 2;
+    font.slot_map = arena_alloc_zero(&g_general_arena, font.slot_map_cap * sizeof(uint32_t));
+
+    font.cell_bytes = arena_alloc(&g_general_arena, font.cell_w * font.cell_h);
+
+    font.atlas_dim = atlas_dim;
+    font.tex.w = atlas_dim;
+    font.tex.h = atlas_dim;
+
+    // Glyphs rasterized in a previous session, so the first frame doesn't rasterize them again
+    uint8_t *cached_atlas_bytes = xmalloc((size_t)atlas_dim * atlas_dim);
+    if (!font_load_atlas_cache(&font, cached_atlas_bytes)) {
+        free(cached_atlas_bytes);
+        cached_atlas_bytes = NULL;
+    }
+
+    if (cached_atlas_bytes) g_gl_state.stats.upload_bytes += (size_t)atlas_dim * atlas_dim;
+    if (g_gl_state.backend == RENDER_BACKEND_NULL) {
+        font.tex.id = null_texture_id();
+    } else {
+        glGenTextures(1, &font.tex.id);
+        glBindTexture(GL_TEXTURE_2D, font.tex.id);
+
+        // NOTE: Distance fields need bilinear interpolation to reconstruct the edge
+        GLint filter = sdf ? GL_LINEAR : GL_NEAREST;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+
+        // Single channel storage, sampled as (1, 1, 1, coverage) so the default shader needs no changes
+        GLint swizzle[] = { GL_ONE, GL_ONE, GL_ONE, GL_RED };
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+
+        // NOTE: Without a cache this is storage only. Every cell is fully overwritten when a glyph is rasterized into it.
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, atlas_dim, atlas_dim, 0, GL_RED, GL_UNSIGNED_BYTE, cached_atlas_bytes);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    free(cached_atlas_bytes);
+
+    trace_log("Font %s: %.1fpt%s, %zu glyph slots of %dx%d in a %dx%d atlas, %zu cached",
+              file_name, points_height, sdf ? " (SDF)" : "", font.slot_count, font.cell_w, font.cell_h, atlas_dim, atlas_dim,
+              font.used_slot_count);
+
+    return font;
+}
+
+static inline size_t font_hash_codepoint(uint32_t codepoint) {
+    return (size_t)(codepoint * 2654435761u);
+}
+
+static int32_t font_find_slot(Font *font, uint32_t codepoint) {
+    size_t mask = font->slot_map_cap - 1;
+    for (size_t i = font_hash_codepoint(codepoint) & mask;; i = (i + 1) & mask) {
+        uint32_t entry = font->slot_map[i];
+        if (entry == 0) return -1;
+        if (font->slots[entry - 1].codepoint == codepoint) return (int32_t)entry - 1;
+    }
+}
+
+static void font_map_slot(Font *font, int32_t slot_index) {
+    size_t mask = font->slot_map_cap - 1;
+    size_t i = font_hash_codepoint(font->slots[slot_index].codepoint) & mask;
+    while (font->slot_map[i] != 0) i = (i + 1) & mask;
+    font->slot_map[i] = (uint32_t)slot_index + 1;
+}
+
+// Backward-shift deletion, so lookups never need tombstones
+static void font_unmap_slot(Font *font, int32_t slot_index) {
+    size_t mask = font->slot_map_cap - 1;
+    size_t i = font_hash_codepoint(font->slots[slot_index].codepoint) & mask;
+    while (font->slot_map[i] != (uint32_t)slot_index + 1) i = (i + 1) & mask;
+    font->slot_map[i] = 0;
+
+    for (size_t j = (i + 1) & mask; font->slot_map[j] != 0; j = (j + 1) & mask) {
+        size_t home = font_hash_codepoint(font->slots[font->slot_map[j] - 1].codepoint) & mask;
+        bool home_in_gap = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+        if (!home_in_gap) {
+            font->slot_map[i] = font->slot_map[j];
+            font->slot_map[j] = 0;
+            i = j;
+        }
+    }
+}
+
+static void font_lru_unlink(Font *font, int32_t slot_index) {
+    Glyph_Slot *slot = &font->slots[slot_index];
+    if (slot->lru_prev >= 0) font->slots[slot->lru_prev].lru_next = slot->lru_next;
+    else                     font->lru_head = slot->lru_next;
+    if (slot->lru_next >= 0) font->slots[slot->lru_next].lru_prev = slot->lru_prev;
+    else                     font->lru_tail = slot->lru_prev;
+}
+
+static void font_lru_push_front(Font *font, int32_t slot_index) {
+    Glyph_Slot *slot = &font->slots[slot_index];
+    slot->lru_prev = -1;
+    slot->lru_next = font->lru_head;
+    if (font->lru_head >= 0) font->slots[font->lru_head].lru_prev = slot_index;
+    font->lru_head = slot_index;
+    if (font->lru_tail < 0) font->lru_tail = slot_index;
+}
+
+static void font_rasterize_into_slot(Font *font, int32_t slot_index, uint32_t codepoint) {
+    Glyph_Slot *slot = &font->slots[slot_index];
+    slot->codepoint = codepoint;
+
+    int advance, lsb;
+    stbtt_GetCodepointHMetrics(&font->info, codepoint, &advance, &lsb);
+    slot->xadvance = roundf(advance * font->scale);
+
+    // NOTE: Upload the whole cell so nothing of the evicted glyph is left behind
+    size_t cell_pixels = font->cell_w * font->cell_h;
+    memset(font->cell_bytes, 0, cell_pixels);
+
+    int x0 = 0, y0 = 0, w = 0, h = 0;
+    if (font->sdf) {
+        int sdf_w = 0;
+        uint8_t *sdf_bytes = stbtt_GetCodepointSDF(&font->info, font->scale, codepoint, SDF_PADDING,
+                                                   SDF_ON_EDGE_VALUE, (float)SDF_ON_EDGE_VALUE / SDF_PADDING,
+                                                   &sdf_w, &h, &x0, &y0);
+        w = sdf_w;
+        if (w > font->cell_w) w = font->cell_w;
+        if (h > font->cell_h) h = font->cell_h;
+        if (sdf_bytes) {
+            for (int row = 0; row < h; row++) {
+                memcpy(font->cell_bytes + row * font->cell_w, sdf_bytes + row * sdf_w, w);
+            }
+            stbtt_FreeSDF(sdf_bytes, NULL);
+        } else {
+            w = h = 0; // Empty glyph, e.g. space
+        }
+    } else {
+        int x1, y1;
+        stbtt_GetCodepointBitmapBox(&font->info, codepoint, font->scale, font->scale, &x0, &y0, &x1, &y1);
+        w = x1 - x0;
+        h = y1 - y0;
+        if (w > font->cell_w) w = font->cell_w;
+        if (h > font->cell_h) h = font->cell_h;
+        if (w > 0 && h > 0) {
+            stbtt_MakeCodepointBitmap(&font->info, font->cell_bytes, w, h, font->cell_w, font->scale, font->scale, codepoint);
+        }
+    }
+
+    slot->xoff = (float)x0;
+    slot->yoff = (float)y0;
+    slot->w = (float)w;
+    slot->h = (float)h;
+    font->glyph_generation++;
+
+    g_gl_state.stats.upload_bytes += cell_pixels;
+    if (g_gl_state.backend == RENDER_BACKEND_NULL) return;
+
+    int cell_x = (slot_index % font->cols) * font->cell_w;
+    int cell_y = (slot_index / font->cols) * font->cell_h;
+    glBindTexture(GL_TEXTURE_2D, font->tex.id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // Cell rows are tightly packed single bytes
+    glTexSubImage2D(GL_TEXTURE_2D, 0, cell_x, cell_y, font->cell_w, font->cell_h, GL_RED, GL_UNSIGNED_BYTE, font->cell_bytes);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+Glyph_Slot *font_get_glyph(Font *font, uint32_t codepoint) {
+    int32_t slot_index = font_find_slot(font, codepoint);
+
+    if (slot_index >= 0) {
+        if (font->lru_head != slot_index) {
+            font_lru_unlink(font, slot_index);
+            font_lru_push_front(font, slot_index);
+        }
+        return &font->slots[slot_index];
+    }
+
+    if (font->used_slot_count < font->slot_count) {
+        slot_index = (int32_t)font->used_slot_count++;
+    } else {
+        // NOTE: Safe to overwrite even if the evicted glyph was drawn earlier this frame,
+        //       the draw was already issued and GL executes commands in order.
+        slot_index = font->lru_tail;
+        font_lru_unlink(font, slot_index);
+        font_unmap_slot(font, slot_index);
+        font->eviction_count++;
+    }
+
+    font_rasterize_into_slot(font, slot_index, codepoint);
+    font_map_slot(font, slot_index);
+    font_lru_push_front(font, slot_index);
+
+    return &font->slots[slot_index];
+}
+
+// Only checks a few glyphs of very different widths, enough to tell code fonts from proportional ones
+bool font_is_monospaced(const Font *font) {
+    static const uint32_t probes[] = { 'i', 'M', 'W', '.', ' ', '0' };
+    int first_advance = 0;
+    for (size_t i = 0; i < sizeof(probes) / sizeof(probes[0]); i++) {
+        int advance, lsb;
+        stbtt_GetCodepointHMetrics(&font->info, probes[i], &advance, &lsb);
+        if (i == 0) first_advance = advance;
+        else if (advance != first_advance) return false;
+    }
+    return true;
+}
+
+// Same advance the text draw paths use, tabs and control characters included.
+// Only reads the font's metrics, so unlike font_get_glyph it is safe off the render thread.
+float font_glyph_advance(const Font *font, uint32_t codepoint) {
+    if (codepoint == '\t') return font_glyph_advance(font, ' ') * TAB_WIDTH;
+    if (codepoint < 0x20 || codepoint == 0x7F) codepoint = UTF8_REPLACEMENT_CHAR;
+    int advance, lsb;
+    stbtt_GetCodepointHMetrics(&font->info, codepoint, &advance, &lsb);
+    return roundf(advance * font->scale);
+}
+
+void font_atlas_cache_path(const Font *font, char *out, size_t out_size) {
+    snprintf(out, out_size, "temp/atlas_%016llx_%g_%d%s.bin",
+             (unsigned long long)font->ttf_hash, font->points_height, font->atlas_dim, font->sdf ? "_sdf" : "");
+}
+
+static Atlas_Cache_Header font_atlas_cache_header(const Font *font) {
+    Atlas_Cache_Header header = {0};
+    header.magic = ATLAS_CACHE_MAGIC;
+    header.version = ATLAS_CACHE_VERSION;
+    header.ttf_hash = font->ttf_hash;
+    header.points_height = font->points_height;
+    header.atlas_dim = font->atlas_dim;
+    header.sdf = font->sdf;
+    header.cell_w = font->cell_w;
+    header.cell_h = font->cell_h;
+    header.slot_size = sizeof(Glyph_Slot);
+    header.used_slot_count = (uint32_t)font->used_slot_count;
+    header.lru_head = font->lru_head;
+    header.lru_tail = font->lru_tail;
+    return header;
+}
+
+// The links come from the file, so they are checked before anything follows them: every index
+// is a used slot and one chain runs from head to tail through all of them
+static bool font_atlas_cache_lru_is_valid(const Glyph_Slot *slots, uint32_t used_slot_count, int32_t head, int32_t tail) {
+    int32_t used = (int32_t)used_slot_count;
+    int32_t prev = -1, index = head;
+    for (int32_t count = 0; count < used; count++) {
+        if (index < 0 || index >= used) return false;
+        if (slots[index].lru_prev != prev) return false;
+        prev = index;
+        index = slots[index].lru_next;
+    }
+    return index == -1 && prev == tail;
+}
+
+// A missing, stale or damaged cache is not an error, the atlas just starts empty and is written again on exit
+bool font_load_atlas_cache(Font *font, uint8_t *out_atlas_bytes) {
+    char path[256];
+    font_atlas_cache_path(font, path, sizeof(path));
+
+    FILE *file = fopen(path, "rb");
+    if (!file) return false;
+
+    Atlas_Cache_Header expected = font_atlas_cache_header(font);
+    Atlas_Cache_Header header;
+    size_t atlas_size = (size_t)font->atlas_dim * font->atlas_dim;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+              header.magic == expected.magic &&
+              header.version == expected.version &&
+              header.ttf_hash == expected.ttf_hash &&
+              header.points_height == expected.points_height &&
+              header.atlas_dim == expected.atlas_dim &&
+              header.sdf == expected.sdf &&
+              header.cell_w == expected.cell_w &&
+              header.cell_h == expected.cell_h &&
+              header.slot_size == expected.slot_size &&
+              header.used_slot_count <= font->slot_count &&
+              fread(font->slots, sizeof(Glyph_Slot), header.used_slot_count, file) == header.used_slot_count &&
+              font_atlas_cache_lru_is_valid(font->slots, header.used_slot_count, header.lru_head, header.lru_tail) &&
+              fread(out_atlas_bytes, 1, atlas_size, file) == atlas_size;
+    fclose(file);
+
+    if (!ok) {
+        trace_log("Ignoring stale or damaged font atlas cache %s", path);
+        memset(font->slots, 0, font->slot_count * sizeof(Glyph_Slot));
+        return false;
+    }
+
+    font->used_slot_count = header.used_slot_count;
+    font->lru_head = header.lru_head;
+    font->lru_tail = header.lru_tail;
+    for (size_t i = 0; i < font->used_slot_count; i++) {
+        font_map_slot(font, (int32_t)i);
+    }
+
+    return true;
+}
+
+void font_save_atlas_cache(Font *font) {
+    // NOTE: The atlas only exists on the GPU, so there is nothing to read back without GL
+    if (font->used_slot_count == 0 || g_gl_state.backend == RENDER_BACKEND_NULL) return;
+
+    char path[256];
+    font_atlas_cache_path(font, path, sizeof(path));
+
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        trace_log("Not able to write font atlas cache: %s", path);
+        return;
+    }
+
+    size_t atlas_size = (size_t)font->atlas_dim * font->atlas_dim;
+    uint8_t *atlas_bytes = xmalloc(atlas_size);
+    glBindTexture(GL_TEXTURE_2D, font->tex.id);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_UNSIGNED_BYTE, atlas_bytes);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    Atlas_Cache_Header header = font_atlas_cache_header(font);
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(font->slots, sizeof(Glyph_Slot), font->used_slot_count, file);
+    fwrite(atlas_bytes, 1, atlas_size, file);
+    fclose(file);
+    free(atlas_bytes);
+
+    trace_log("Wrote font atlas cache with %zu glyphs to %s", font->used_slot_count, path);
+}
+
+// Returns the horizontal advance
+float draw_glyph(Font *font, uint32_t codepoint, float x, float y, vec4 color) {
+    Glyph_Slot *glyph = font_get_glyph(font, codepoint);
+    int32_t slot_index = (int32_t)(glyph - font->slots);
+
+    if (glyph->w > 0 && glyph->h > 0) {
+        Rect dest = {
+            x + glyph->xoff,
+            y + glyph->yoff,
+            glyph->w,
+            glyph->h
+        };
+
+        Rect src = {
+            (float)((slot_index % font->cols) * font->cell_w),
+            (float)((slot_index / font->cols) * font->cell_h),
+            glyph->w,
+            glyph->h
+        };
+
+        draw_texture_with_shader(dest, font->tex, src, color, font->sdf ? g_gl_state.sdf_shader : g_gl_state.shader);
+    }
+
+    return glyph->xadvance;
+}
+
+void draw_string(const char *str, vec2 pos, vec4 color, Font *font, float line_height) {
+    float x = pos[0];
+    float y = pos[1];
+
+    for (const char *cur = str; *cur != '\0';) {
+        uint32_t codepoint;
+        cur += utf8_decode(cur, &codepoint);
+
+        if (codepoint == '\n') {
+            x = pos[0];
+            y += line_height;
+        } else if (codepoint == '\t') {
+            x += font_get_glyph(font, ' ')->xadvance * TAB_WIDTH;
+        } else {
+            if (codepoint < 0x20 || codepoint == 0x7F) codepoint = UTF8_REPLACEMENT_CHAR;
+            x += draw_glyph(font, codepoint, x, y, color);
+        }
+    }
+}
+
+bool cursor_blink_visible(size_t cursor) {
+    // HACKY
+    static int frame_counter = 0;
+    static size_t prev_cursor = 0;
+    frame_counter++;
+    if (frame_counter >= 60) frame_counter = 0;
+
+    if (cursor != prev_cursor) {
+        frame_counter = 0;
+        prev_cursor = cursor;
+    }
+    return !((frame_counter / 30) % 2);
+}
+
+void draw_string_with_cursor(const char *str, const uint8_t *color_classes, vec4 *palette, size_t cursor,
+                             const Text_Range *highlights, size_t highlight_count, vec4 highlight_color,
+                             vec2 pos, float min_y, float max_y, Font *font, float line_height) {
+    float x = pos[0];
+    float y = pos[1];
+
+    bool drew_cursor = false;
+    bool will_draw_cursor = cursor != SIZE_MAX;
+    float *cursor_color = palette[0];
+    size_t highlight_index = 0;
+    for (const char *cur = str; *cur != '\0';) {
+        size_t current_index = cur - str;
+        uint32_t codepoint;
+        cur += utf8_decode(cur, &codepoint);
+
+        float *color = palette[color_classes[current_index]];
+
+        while (highlight_index < highlight_count && highlights[highlight_index].end <= current_index) highlight_index++;
+        bool highlighted = highlight_index < highlight_count && highlights[highlight_index].start <= current_index;
+
+        bool at_cursor = will_draw_cursor && current_index == cursor;
+        // NOTE: Skipped rows are still walked, x only resets at their newline
+        bool row_visible = y >= min_y;
+
+        if (codepoint == '\n') {
+            if (at_cursor) {
+                Rect block_cursor = {
+                    x,
+                    y - line_height,
+                    (float)10.0f,
+                    line_height
+                };
+                draw_quad(block_cursor, cursor_color);
+                drew_cursor = true;
+            }
+
+            x = pos[0];
+            y += line_height;
+            if (y - line_height > max_y) break;
+        } else if (codepoint == '\t') {
+            float advance = font_get_glyph(font, ' ')->xadvance * TAB_WIDTH;
+            if (highlighted && row_visible) draw_quad((Rect){x, y - line_height, advance, line_height}, highlight_color);
+            if (at_cursor) {
+                draw_quad((Rect){x, y - line_height, advance, line_height}, cursor_color);
+                drew_cursor = true;
+            }
+            x += advance;
+        } else {
+            if (codepoint < 0x20 || codepoint == 0x7F) codepoint = UTF8_REPLACEMENT_CHAR;
+
+            if (!row_visible && !at_cursor) {
+                x += font_get_glyph(font, codepoint)->xadvance;
+                continue;
+            }
+
+            if (highlighted && !at_cursor) {
+                draw_quad((Rect){x, y - line_height, font_get_glyph(font, codepoint)->xadvance, line_height}, highlight_color);
+            }
+
+            if (!at_cursor) {
+                x += draw_glyph(font, codepoint, x, y, color);
+            } else {
+                Rect block_cursor = {
+                    x,
+                    y - line_height,
+                    font_get_glyph(font, codepoint)->xadvance,
+                    line_height
+                };
+                draw_quad(block_cursor, cursor_color);
+                vec4 inverted_color = {1.0f - cursor_color[0], 1.0f - cursor_color[1], 1.0f - cursor_color[2], cursor_color[3]};
+                x += draw_glyph(font, codepoint, x, y, inverted_color);
+                drew_cursor = true;
+            }
+        }
+    }
+
+    if (will_draw_cursor && !drew_cursor) {
+        Rect block_cursor = {
+            x,
+            y - line_height,
+            (float)10.0f,
+            line_height
+        };
+        draw_quad(block_cursor, cursor_color);
+    }
+}
+
+// Walks to the cursor without drawing, then draws it the way draw_string_with_cursor would
+void draw_text_cursor(const char *str, vec4 *palette, size_t cursor, vec2 pos, Font *font, float line_height) {
+    if (cursor == SIZE_MAX) return;
+
+    float x = pos[0];
+    float y = pos[1];
+    const char *cur = str;
+    while (*cur != '\0' && (size_t)(cur - str) < cursor) {
+        uint32_t codepoint;
+        cur += utf8_decode(cur, &codepoint);
+        if (codepoint == '\n') {
+            x = pos[0];
+            y += line_height;
+        } else if (codepoint == '\t') {
+            x += font_get_glyph(font, ' ')->xadvance * TAB_WIDTH;
+        } else {
+            if (codepoint < 0x20 || codepoint == 0x7F) codepoint = UTF8_REPLACEMENT_CHAR;
+            x += font_get_glyph(font, codepoint)->xadvance;
+        }
+    }
+
+    float *cursor_color = palette[0];
+    uint32_t codepoint = '\n';
+    if (*cur != '\0') utf8_decode(cur, &codepoint);
+    if (codepoint == '\n') {
+        draw_quad((Rect){x, y - line_height, 10.0f, line_height}, cursor_color);
+    } else if (codepoint == '\t') {
+        draw_quad((Rect){x, y - line_height, font_get_glyph(font, ' ')->xadvance * TAB_WIDTH, line_height}, cursor_color);
+    } else {
+        if (codepoint < 0x20 || codepoint == 0x7F) codepoint = UTF8_REPLACEMENT_CHAR;
+        draw_quad((Rect){x, y - line_height, font_get_glyph(font, codepoint)->xadvance, line_height}, cursor_color);
+        vec4 inverted_color = {1.0f - cursor_color[0], 1.0f - cursor_color[1], 1.0f - cursor_color[2], cursor_color[3]};
+        draw_glyph(font, codepoint, x, y, inverted_color);
+    }
+}
+
+static void cell_grid_resize(Cell_Grid *grid, int cols, int rows) {
+    if (grid->cols == cols && grid->rows == rows && grid->cells) return;
+
+    grid->cols = cols;
+    grid->rows = rows;
+    size_t cell_count = (size_t)cols * rows;
+    grid->cells = xrealloc(grid->cells, cell_count * sizeof(Grid_Cell));
+    grid->uploaded = xrealloc(grid->uploaded, cell_count * sizeof(Grid_Cell));
+    grid->all_dirty = true;
+
+    if (g_gl_state.backend == RENDER_BACKEND_NULL) {
+        if (!grid->cell_texture) grid->cell_texture = null_texture_id();
+        return;
+    }
+
+    if (!grid->cell_texture) {
+        glGenTextures(1, &grid->cell_texture);
+        glGenBuffers(1, &grid->glyph_buffer);
+    }
+    glBindTexture(GL_TEXTURE_2D, grid->cell_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8UI, cols, rows, 0, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// NOTE: Slots only change when a glyph is rasterized, which is rare after the first frames,
+//       so the whole table goes up at once
+static void cell_grid_upload_glyph_boxes(Cell_Grid *grid, const Font *font) {
+    if (grid->glyph_font == font && grid->glyph_generation == font->glyph_generation) return;
+    grid->glyph_font = font;
+    grid->glyph_generation = font->glyph_generation;
+
+    size_t size = font->slot_count * 4 * sizeof(float);
+    g_gl_state.stats.upload_bytes += size;
+    if (g_gl_state.backend == RENDER_BACKEND_NULL) return;
+
+    float *boxes = arena_alloc(&g_frame_arena, size);
+    for (size_t i = 0; i < font->slot_count; i++) {
+        const Glyph_Slot *slot = &font->slots[i];
+        boxes[i * 4 + 0] = slot->xoff;
+        boxes[i * 4 + 1] = slot->yoff;
+        boxes[i * 4 + 2] = slot->w;
+        boxes[i * 4 + 3] = slot->h;
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, grid->glyph_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, boxes, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+// Uploads the changed span of every row that differs from what the texture holds
+static void cell_grid_upload_cells(Cell_Grid *grid) {
+    if (g_gl_state.backend == RENDER_BACKEND_GL) {
+        glBindTexture(GL_TEXTURE_2D, grid->cell_texture);
+    }
+
+    for (int row = 0; row < grid->rows; row++) {
+        Grid_Cell *cells = grid->cells + (size_t)row * grid->cols;
+        Grid_Cell *uploaded = grid->uploaded + (size_t)row * grid->cols;
+
+        int first = 0, last = grid->cols - 1;
+        if (!grid->all_dirty) {
+            while (first <= last && memcmp(&cells[first], &uploaded[first], sizeof(Grid_Cell)) == 0) first++;
+            while (last >= first && memcmp(&cells[last], &uploaded[last], sizeof(Grid_Cell)) == 0) last--;
+            if (first > last) continue;
+        }
+
+        int span = last - first + 1;
+        memcpy(uploaded + first, cells + first, span * sizeof(Grid_Cell));
+        g_gl_state.stats.upload_bytes += span * sizeof(Grid_Cell);
+        if (g_gl_state.backend == RENDER_BACKEND_GL) {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, first, row, span, 1, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, cells + first);
+        }
+    }
+    grid->all_dirty = false;
+
+    if (g_gl_state.backend == RENDER_BACKEND_GL) {
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+}
+
+// Returns false if a glyph slot was given to another glyph meanwhile, which may have changed cells filled earlier
+static bool cell_grid_fill(Cell_Grid *grid, const char *str, const uint8_t *color_classes, size_t cursor,
+                           const Text_Range *highlights, size_t highlight_count, Font *font) {
+    uint64_t eviction_count = font->eviction_count;
+    int cols = grid->cols, rows = grid->rows;
+    Grid_Cell blank = { GRID_EMPTY_GLYPH, 0, 0 };
+    for (size_t i = 0; i < (size_t)cols * rows; i++) grid->cells[i] = blank;
+
+    bool will_draw_cursor = cursor != SIZE_MAX;
+    int row = 0, col = 0;
+    size_t highlight_index = 0;
+    const char *cur = str;
+    while (*cur != '\0') {
+        size_t current_index = cur - str;
+        uint32_t codepoint;
+        cur += utf8_decode(cur, &codepoint);
+
+        while (highlight_index < highlight_count && highlights[highlight_index].end <= current_index) highlight_index++;
+        bool highlighted = highlight_index < highlight_count && highlights[highlight_index].start <= current_index;
+
+        uint8_t flags = highlighted ? GRID_CELL_HIGHLIGHT : 0;
+        if (will_draw_cursor && current_index == cursor) flags |= GRID_CELL_CURSOR;
+
+        if (codepoint == '\n') {
+            if (col < cols) grid->cells[(size_t)row * cols + col].flags = flags & GRID_CELL_CURSOR;
+            col = 0;
+            if (++row >= rows) break;
+            continue;
+        }
+
+        if (col >= cols) {
+            // NOTE: Past the right edge, nothing else on this line can show
+            const char *line_end = strchr(cur, '\n');
+            if (!line_end) break;
+            cur = line_end;
+            continue;
+        }
+
+        Grid_Cell *cell = &grid->cells[(size_t)row * cols + col];
+        if (codepoint == '\t') {
+            for (int i = 0; i < TAB_WIDTH && col < cols; i++, col++) cell[i].flags = flags;
+        } else {
+            if (codepoint < 0x20 || codepoint == 0x7F) codepoint = UTF8_REPLACEMENT_CHAR;
+            Glyph_Slot *glyph = font_get_glyph(font, codepoint);
+            cell->glyph = (uint16_t)(glyph - font->slots);
+            cell->color = color_classes[current_index];
+            cell->flags = flags;
+            col++;
+        }
+    }
+    // The cursor after the last character has no cell of its own. Anywhere else it was either placed above
+    // or sits in a part of a line cut off at the right edge, where it isn't drawn.
+    bool cursor_at_end = *cur == '\0' && cursor == (size_t)(cur - str);
+    if (will_draw_cursor && cursor_at_end && row < rows && col < cols) {
+        grid->cells[(size_t)row * cols + col].flags |= GRID_CELL_CURSOR;
+    }
+
+    return font->eviction_count == eviction_count;
+}
+
+bool draw_string_grid(Cell_Grid *grid, const char *str, const uint8_t *color_classes, vec4 *palette, size_t palette_count,
+                      size_t cursor, const Text_Range *highlights, size_t highlight_count, vec4 highlight_color,
+                      vec2 pos, float max_y, Font *font, float line_height) {
+    assert(font->slot_count < GRID_EMPTY_GLYPH);
+    assert(palette_count <= GRID_PALETTE_MAX);
+
+    int ascent_units, descent_units, line_gap_units;
+    stbtt_GetFontVMetrics(&font->info, &ascent_units, &descent_units, &line_gap_units);
+    float ascent = roundf(ascent_units * font->scale);
+    float advance = font_get_glyph(font, ' ')->xadvance;
+
+    // NOTE: Cells span from the ascent above each baseline, so descenders stay inside their own row
+    vec2 origin = { pos[0], pos[1] - ascent };
+    float visible_w = g_gl_state.viewport_w / g_gl_state.zoom - pos[0];
+    int cols = visible_w > advance ? (int)ceilf(visible_w / advance) : 1;
+    int rows = (int)((max_y - pos[1]) / line_height) + 2;
+    if (rows < 1) rows = 1;
+    cell_grid_resize(grid, cols, rows);
+
+    // NOTE: Cells keep a slot index, so unlike the quad path an eviction would change cells filled before it.
+    //       The first fill can only evict glyphs of earlier frames unless this screen alone has more distinct
+    //       glyphs than the atlas has slots, so it is filled again once. If that still evicts, the quad path draws it.
+    if (!cell_grid_fill(grid, str, color_classes, cursor, highlights, highlight_count, font) &&
+        !cell_grid_fill(grid, str, color_classes, cursor, highlights, highlight_count, font)) {
+        return false;
+    }
+
+    cell_grid_upload_glyph_boxes(grid, font);
+    cell_grid_upload_cells(grid);
+
+    g_gl_state.stats.draw_calls++;
+    g_gl_state.stats.upload_bytes += (palette_count + 1) * sizeof(vec4) + 8 * sizeof(float);
+    if (g_gl_state.backend == RENDER_BACKEND_NULL) return true;
+
+    uint32_t shader = g_gl_state.grid_shader;
+    glUseProgram(shader);
+    glUniform2f(glGetUniformLocation(shader, "origin"), origin[0], origin[1]);
+    glUniform2f(glGetUniformLocation(shader, "grid_extent"), cols * advance, rows * line_height);
+    glUniform2f(glGetUniformLocation(shader, "cell_size"), advance, line_height);
+    glUniform1f(glGetUniformLocation(shader, "ascent"), ascent);
+    glUniform3i(glGetUniformLocation(shader, "atlas_layout"), font->cols, font->cell_w, font->cell_h);
+    glUniform1f(glGetUniformLocation(shader, "atlas_dim"), (float)font->atlas_dim);
+    glUniform4fv(glGetUniformLocation(shader, "palette"), (GLsizei)palette_count, (float *)palette);
+    glUniform4fv(glGetUniformLocation(shader, "highlight_color"), 1, highlight_color);
+    glUniform1i(glGetUniformLocation(shader, "sdf"), font->sdf);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, grid->cell_texture);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, font->tex.id);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GRID_GLYPH_BINDING, grid->glyph_buffer);
+    glBindVertexArray(g_gl_state.grid_vao);
+
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    glBindVertexArray(0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GRID_GLYPH_BINDING, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+    return true;
+}
+
+void cell_grid_free(Cell_Grid *grid) {
+    if (g_gl_state.backend == RENDER_BACKEND_GL && grid->cell_texture) {
+        glDeleteTextures(1, &grid->cell_texture);
+        glDeleteBuffers(1, &grid->glyph_buffer);
+    }
+    free(grid->cells);
+    free(grid->uploaded);
+    memset(grid, 0, sizeof(*grid));
+}
@@ -0,0 +1,171 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "cglm/cglm.h"
+#include "stb/stb_truetype.h"
+
+#include "common.h"
+
+enum { TAB_WIDTH = 4 };
+
+typedef struct Texture {
+    uint32_t id;
+    float w, h;
+} Texture;
+
+// Decoded on a worker thread, uploaded by the GL thread once `decoded` is set
+typedef struct Async_Image {
+    const char *file_name;
+    pthread_t thread;
+    atomic_bool decoded;
+    uint8_t *pixels; // NULL if decoding failed
+    int w, h;
+} Async_Image;
+
+typedef struct Rect {
+    float x, y;
+    float w, h;
+} Rect;
+
+typedef enum Render_Backend {
+    RENDER_BACKEND_GL,
+    RENDER_BACKEND_NULL // Issues no GL calls, only counts what would have been drawn and uploaded
+} Render_Backend;
+
+typedef struct Render_Stats {
+    uint64_t draw_calls;
+    uint64_t upload_bytes; // Vertex, index and texture data sent to the GPU
+    uint64_t heap_allocations; // xmalloc, xcalloc and xrealloc calls on the render thread
+    uint64_t frame_arena_bytes;
+} Render_Stats;
+
+// One atlas cell. Cells are all sized to the font bounding box, so any glyph fits in any cell,
+// and an evicted cell can be reused by the next glyph without repacking.
+typedef struct Glyph_Slot {
+    uint32_t codepoint;
+    float xoff, yoff; // Bitmap top-left relative to the pen position on the baseline
+    float w, h;
+    float xadvance;
+    int32_t lru_prev, lru_next;
+} Glyph_Slot;
+
+typedef struct Font {
+    stbtt_fontinfo info;
+    uint8_t *ttf_bytes;
+    float scale;
+    float points_height;
+    bool sdf; // Atlas holds signed distance fields instead of coverage
+    uint64_t ttf_hash; // Keys the on-disk atlas cache
+    int atlas_dim;
+    Texture tex;
+
+    int cell_w, cell_h;
+    int cols;
+    Glyph_Slot *slots;
+    size_t slot_count;
+    size_t used_slot_count;
+    int32_t lru_head, lru_tail; // Head is the most recently used
+
+    // Open addressing codepoint -> slot map. Stores slot index + 1, 0 is an empty bucket.
+    uint32_t *slot_map;
+    size_t slot_map_cap;
+
+    uint8_t *cell_bytes;
+    uint64_t glyph_generation; // Bumped whenever a slot gets a new glyph
+    uint64_t eviction_count;   // Bumped whenever a used slot is given to another glyph
+} Font;
+
+enum { GRID_EMPTY_GLYPH = 0xFFFF };
+
+typedef enum Grid_Cell_Flags {
+    GRID_CELL_HIGHLIGHT = 1 << 0,
+    GRID_CELL_CURSOR    = 1 << 1
+} Grid_Cell_Flags;
+
+// Matches the RGBA8UI texel the shader reads
+typedef struct Grid_Cell {
+    uint16_t glyph; // Atlas slot, or GRID_EMPTY_GLYPH
+    uint8_t color;  // Palette index
+    uint8_t flags;
+} Grid_Cell;
+
+// Visible text as one cell per character, for monospaced fonts. The cells live in an integer texture
+// and only the spans that changed since the last frame are uploaded. One draw covers the whole grid,
+// the fragment shader looks glyph boxes up in a per-slot table and samples the atlas itself.
+typedef struct Cell_Grid {
+    int cols, rows;
+    Grid_Cell *cells;
+    Grid_Cell *uploaded; // What the texture holds
+    bool all_dirty;
+
+    uint32_t cell_texture;
+    uint32_t glyph_buffer; // vec4 (xoff, yoff, w, h) per atlas slot
+    const Font *glyph_font;
+    uint64_t glyph_generation;
+} Cell_Grid;
+
+// Offscreen color target the size of the window. It is drawn into with the window's projection,
+// redrawing only inside a damage rectangle, and composited as one opaque quad.
+typedef struct Render_Layer {
+    uint32_t fbo;
+    Texture tex;
+    bool valid; // Holds a complete image at the current size
+} Render_Layer;
+
+// The caller owns the GL context (a window, or an offscreen surface). The renderer only needs it current.
+void renderer_init(Render_Backend backend, int width, int height);
+void renderer_resize(int width, int height);
+void renderer_begin_frame();
+Render_Stats renderer_take_stats();
+void set_ortho_projection(int width, int height);
+void set_view_zoom(float zoom);
+
+Texture load_texture(const char *file);
+Texture upload_texture_rgba(const uint8_t *pixels, int width, int height);
+void load_image_async(Async_Image *image, const char *file);
+bool poll_async_texture(Async_Image *image, Texture *out_texture);
+Texture load_empty_texture();
+
+void draw_texture(Rect dest, Texture texture, Rect src, vec4 color);
+void draw_texture_with_shader(Rect dest, Texture texture, Rect src, vec4 color, uint32_t shader);
+void draw_texture_scaled(vec2 pos, Texture texture, float scale);
+void draw_texture_scaled_tinted(vec2 pos, Texture texture, float scale, vec4 color);
+void draw_quad(Rect quad, vec4 color);
+
+void layer_resize(Render_Layer *layer, int width, int height);
+void layer_free(Render_Layer *layer);
+// Damage is in window pixels. Everything drawn until layer_end lands in the layer, clipped to it.
+void layer_begin(Render_Layer *layer, Rect damage);
+void layer_end();
+void draw_layer(const Render_Layer *layer);
+
+Font load_font(const char *file_name, float points_height, int atlas_dim, bool sdf);
+void font_atlas_cache_path(const Font *font, char *out, size_t out_size);
+bool font_load_atlas_cache(Font *font, uint8_t *out_atlas_bytes);
+void font_save_atlas_cache(Font *font);
+Glyph_Slot *font_get_glyph(Font *font, uint32_t codepoint);
+bool font_is_monospaced(const Font *font);
+float font_glyph_advance(const Font *font, uint32_t codepoint);
+float draw_glyph(Font *font, uint32_t codepoint, float x, float y, vec4 color);
+void draw_string(const char *str, vec2 pos, vec4 color, Font *font, float line_height);
+// Call once per frame. The cursor restarts its blink whenever it moves.
+bool cursor_blink_visible(size_t cursor);
+// palette[0] is the default text color, also used for the cursor. SIZE_MAX draws no cursor.
+// Rows with their baseline outside [min_y, max_y] are skipped.
+void draw_string_with_cursor(const char *str, const uint8_t *color_classes, vec4 *palette, size_t cursor,
+                             const Text_Range *highlights, size_t highlight_count, vec4 highlight_color,
+                             vec2 pos, float min_y, float max_y, Font *font, float line_height);
+// Just the cursor of draw_string_with_cursor, for drawing it over text drawn without one
+void draw_text_cursor(const char *str, vec4 *palette, size_t cursor, vec2 pos, Font *font, float line_height);
+// Same output as draw_string_with_cursor, through a Cell_Grid. The font has to be monospaced.
+// Returns false without drawing when the screen has more distinct glyphs than the atlas has slots,
+// draw_string_with_cursor has to draw it then.
+bool draw_string_grid(Cell_Grid *grid, const char *str, const uint8_t *color_classes, vec4 *palette, size_t palette_count,
+                      size_t cursor, const Text_Range *highlights, size_t highlight_count, vec4 highlight_color,
+                      vec2 pos, float max_y, Font *font, float line_height);
+void cell_grid_free(Cell_Grid *grid);
+
+#endif
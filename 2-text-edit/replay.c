@@ -0,0 +1,382 @@
+// Keystroke replay harness. Drives the editing core (common.c + editor.c, no window and no GL)
+// with a trace recorded by `text-edit --record FILE` or with built-in synthetic ones, and reports
+// per-operation latency histograms and peak memory. The final text hash is printed too, so two
+// buffer implementations can be checked for the same result as well as compared for speed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "editor.h"
+
+enum { REPLAY_DEFAULT_SIZE_MB = 8, REPLAY_DEFAULT_OPS = 20000 };
+enum { LATENCY_BUCKET_COUNT = 40, HISTOGRAM_BAR_WIDTH = 40 }; // Bucket i holds [2^i, 2^(i+1)) ns
+enum { REPLAY_MAX_TIMINGS = 8 };
+
+typedef struct Op_Trace {
+    Edit_Op *ops;
+    size_t count;
+    size_t capacity;
+} Op_Trace;
+
+// Builds the ops once the text is loaded, so offsets can depend on its size
+typedef void (*Trace_Builder)(Op_Trace *trace, const Text_Edit_State *state, size_t op_count);
+
+// One whole-buffer operation timed on its own, for scenarios that aren't a stream of keystrokes
+typedef struct Replay_Timing {
+    const char *name;
+    size_t count; // Matches found or replaced
+    double ms;
+    size_t bytes; // Text size when it ran
+} Replay_Timing;
+
+// Runs after the trace, returns how many timings it filled in
+typedef size_t (*Scenario_Measure)(Text_Edit_State *state, Replay_Timing *out);
+
+typedef struct Replay_Scenario {
+    const char *name;
+    Trace_Builder build;
+    Scenario_Measure measure;
+} Replay_Scenario;
+
+typedef struct Op_Latencies {
+    double *ns;
+    size_t count;
+    uint64_t buckets[LATENCY_BUCKET_COUNT];
+} Op_Latencies;
+
+static void build_type_top(Op_Trace *trace, const Text_Edit_State *state, size_t op_count);
+static void build_type_middle(Op_Trace *trace, const Text_Edit_State *state, size_t op_count);
+static void build_mass_delete(Op_Trace *trace, const Text_Edit_State *state, size_t op_count);
+static void build_cursor_sweep(Op_Trace *trace, const Text_Edit_State *state, size_t op_count);
+static void build_undo_redo(Op_Trace *trace, const Text_Edit_State *state, size_t op_count);
+static size_t measure_search_replace(Text_Edit_State *state, Replay_Timing *out);
+
+static const Replay_Scenario g_scenarios[] = {
+    { "type_top",       build_type_top,     NULL },                   // Every keystroke moves the whole file
+    { "type_middle",    build_type_middle,  NULL },
+    { "mass_delete",    build_mass_delete,  NULL },                   // Held backspace in the middle
+    { "cursor_sweep",   build_cursor_sweep, NULL },                   // Arrow keys across lines, no edits
+    { "undo_redo",      build_undo_redo,    NULL },                   // Typing in small groups, then all undone and redone
+    { "search_replace", NULL,               measure_search_replace }, // Whole-buffer search, then replace all, undone and redone
+};
+
+void run_replay(const char *name, const Replay_Scenario *scenario, const char *trace_path,
+                const char *file_name, size_t file_size, size_t op_count, size_t undo_memory_limit);
+void run_forked(const char *name, const Replay_Scenario *scenario, const char *trace_path,
+                const char *file_name, size_t file_size, size_t op_count, size_t undo_memory_limit);
+const char *load_trace(Op_Trace *trace, const char *path);
+void print_latencies(Op_Latencies *latencies);
+
+int main(int argc, char **argv) {
+    size_t file_size = (size_t)REPLAY_DEFAULT_SIZE_MB * ONE_MB;
+    size_t op_count = REPLAY_DEFAULT_OPS;
+    size_t undo_memory_limit = UNDO_DEFAULT_MEMORY_LIMIT;
+    const char *scenario_filter = NULL;
+    const char *trace_path = NULL;
+    const char *file_name = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--size-mb") == 0 && i + 1 < argc) {
+            file_size = (size_t)(atof(argv[++i]) * ONE_MB);
+        } else if (strcmp(argv[i], "--ops") == 0 && i + 1 < argc) {
+            int count = atoi(argv[++i]);
+            if (count <= 0) exit_with_error("--ops needs a positive count");
+            op_count = (size_t)count;
+        } else if (strcmp(argv[i], "--scenario") == 0 && i + 1 < argc) {
+            scenario_filter = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--file") == 0 && i + 1 < argc) {
+            file_name = argv[++i];
+        } else if (strcmp(argv[i], "--undo-limit-mb") == 0 && i + 1 < argc) {
+            undo_memory_limit = (size_t)atoi(argv[++i]) * ONE_MB;
+        } else {
+            exit_with_error("Usage: %s [--scenario NAME] [--size-mb N] [--ops N] [--undo-limit-mb N]\n"
+                            "       %s --trace FILE [--file FILE]", argv[0], argv[0]);
+        }
+    }
+
+    // NOTE: Every run gets its own process, so peak RSS belongs to that run alone
+    if (trace_path) {
+        run_forked(trace_path, NULL, trace_path, file_name, 0, 0, undo_memory_limit);
+        return 0;
+    }
+
+    bool any = false;
+    for (size_t i = 0; i < sizeof(g_scenarios) / sizeof(g_scenarios[0]); i++) {
+        if (scenario_filter && strcmp(scenario_filter, g_scenarios[i].name) != 0) continue;
+        run_forked(g_scenarios[i].name, &g_scenarios[i], NULL, file_name, file_size, op_count, undo_memory_limit);
+        any = true;
+    }
+    if (!any) exit_with_error("Unknown scenario %s", scenario_filter);
+
+    return 0;
+}
+
+void run_forked(const char *name, const Replay_Scenario *scenario, const char *trace_path,
+                const char *file_name, size_t file_size, size_t op_count, size_t undo_memory_limit) {
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+    if (pid < 0) exit_with_error("fork failed");
+    if (pid == 0) {
+        run_replay(name, scenario, trace_path, file_name, file_size, op_count, undo_memory_limit);
+        fflush(stdout);
+        _exit(0);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        exit_with_error("Replay of %s did not finish cleanly", name);
+    }
+}
+
+static void trace_push(Op_Trace *trace, Edit_Op_Kind kind, uint64_t arg) {
+    if (trace->count == trace->capacity) {
+        trace->capacity = trace->capacity ? trace->capacity * 2 : 1024;
+        trace->ops = xrealloc(trace->ops, trace->capacity * sizeof(Edit_Op));
+    }
+    trace->ops[trace->count++] = (Edit_Op){ kind, arg };
+}
+
+static void push_typing(Op_Trace *trace, size_t char_count) {
+    static const char typed[] = "value = compute(value, 42); // typed\n";
+    for (size_t i = 0; i < char_count; i++) {
+        trace_push(trace, EDIT_OP_CHAR, (uint8_t)typed[i % (sizeof(typed) - 1)]);
+    }
+}
+
+static void build_type_top(Op_Trace *trace, const Text_Edit_State *state, size_t op_count) {
+    (void)state;
+    trace_push(trace, EDIT_OP_CURSOR, 0);
+    push_typing(trace, op_count);
+}
+
+static void build_type_middle(Op_Trace *trace, const Text_Edit_State *state, size_t op_count) {
+    trace_push(trace, EDIT_OP_CURSOR, state->used_size / 2);
+    push_typing(trace, op_count);
+}
+
+static void build_mass_delete(Op_Trace *trace, const Text_Edit_State *state, size_t op_count) {
+    size_t end = state->used_size / 2 + op_count;
+    trace_push(trace, EDIT_OP_CURSOR, end < state->used_size ? end : state->used_size);
+    for (size_t i = 0; i < op_count; i++) trace_push(trace, EDIT_OP_BACKSPACE, 0);
+}
+
+static void build_cursor_sweep(Op_Trace *trace, const Text_Edit_State *state, size_t op_count) {
+    trace_push(trace, EDIT_OP_CURSOR, state->used_size / 2);
+    for (size_t i = 0; i < op_count / 2; i++) trace_push(trace, EDIT_OP_RIGHT, 0);
+    for (size_t i = 0; i < op_count - op_count / 2; i++) trace_push(trace, EDIT_OP_LEFT, 0);
+}
+
+static void build_undo_redo(Op_Trace *trace, const Text_Edit_State *state, size_t op_count) {
+    enum { GROUP_CHARS = 8 };
+    size_t group_count = op_count / (GROUP_CHARS + 4);
+    if (group_count == 0) group_count = 1;
+
+    trace_push(trace, EDIT_OP_CURSOR, state->used_size / 2);
+    for (size_t i = 0; i < group_count; i++) {
+        push_typing(trace, GROUP_CHARS);
+        // NOTE: Moving the cursor closes the typing run, so each word is its own undo step
+        trace_push(trace, EDIT_OP_LEFT, 0);
+        trace_push(trace, EDIT_OP_RIGHT, 0);
+    }
+    for (size_t i = 0; i < group_count; i++) trace_push(trace, EDIT_OP_UNDO, 0);
+    for (size_t i = 0; i < group_count; i++) trace_push(trace, EDIT_OP_REDO, 0);
+}
+
+static size_t measure_search_replace(Text_Edit_State *state, Replay_Timing *out) {
+    static const char miss[] = "identifier_that_never_appears";
+    static const char query[] = "weights"; // On every tenth line of the generated text
+    static const char replacement[] = "weight_table";
+    size_t count = 0;
+
+    double begin_ms = get_time_ms();
+    size_t found = find_bytes(state->text_buffer, state->used_size, miss, sizeof(miss) - 1);
+    out[count++] = (Replay_Timing){ "find miss", found != SEARCH_NOT_FOUND, get_time_ms() - begin_ms, state->used_size };
+
+    begin_ms = get_time_ms();
+    size_t match_count = 0;
+    for (size_t pos = 0;;) {
+        found = find_bytes(state->text_buffer + pos, state->used_size - pos, query, sizeof(query) - 1);
+        if (found == SEARCH_NOT_FOUND) break;
+        match_count++;
+        pos += found + sizeof(query) - 1;
+    }
+    out[count++] = (Replay_Timing){ "find all", match_count, get_time_ms() - begin_ms, state->used_size };
+
+    begin_ms = get_time_ms();
+    size_t replaced = replace_all(state, query, sizeof(query) - 1, replacement, sizeof(replacement) - 1);
+    out[count++] = (Replay_Timing){ "replace all", replaced, get_time_ms() - begin_ms, state->used_size };
+
+    begin_ms = get_time_ms();
+    undo(state);
+    out[count++] = (Replay_Timing){ "undo", replaced, get_time_ms() - begin_ms, state->used_size };
+
+    begin_ms = get_time_ms();
+    redo(state);
+    out[count++] = (Replay_Timing){ "redo", replaced, get_time_ms() - begin_ms, state->used_size };
+
+    return count;
+}
+
+// Returns the file named in the trace header, if any
+const char *load_trace(Op_Trace *trace, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) exit_with_error("Failed to open trace %s", path);
+
+    static char header_file_name[4096];
+    const char *file_name = NULL;
+    char line[4096];
+    size_t line_number = 0;
+    while (fgets(line, sizeof(line), file)) {
+        line_number++;
+        if (strncmp(line, "# file: ", 8) == 0) {
+            snprintf(header_file_name, sizeof(header_file_name), "%s", line + 8);
+            header_file_name[strcspn(header_file_name, "\r\n")] = '\0';
+            file_name = header_file_name;
+            continue;
+        }
+
+        Edit_Op op;
+        if (parse_edit_op(line, &op)) {
+            trace_push(trace, op.kind, op.arg);
+        } else if (line[strspn(line, " \t\r\n")] != '\0' && line[0] != '#') {
+            exit_with_error("%s:%zu: malformed op: %s", path, line_number, line);
+        }
+    }
+    fclose(file);
+    return file_name;
+}
+
+static size_t latency_bucket(uint64_t ns) {
+    size_t bucket = 0;
+    while (ns > 1 && bucket < LATENCY_BUCKET_COUNT - 1) {
+        ns >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+void run_replay(const char *name, const Replay_Scenario *scenario, const char *trace_path,
+                const char *file_name, size_t file_size, size_t op_count, size_t undo_memory_limit) {
+    Text_Edit_State state = {0};
+    editor_init(&state, undo_memory_limit);
+
+    Op_Trace trace = {0};
+    const char *trace_file_name = trace_path ? load_trace(&trace, trace_path) : NULL;
+    if (!file_name) file_name = trace_file_name;
+
+    double load_begin_ms = get_time_ms();
+    if (file_name) {
+        state.file_name = file_name;
+        try_load_file(&state);
+    } else if (!trace_path) {
+        char *text = generate_c_text(file_size);
+        editor_set_text(&state, text, file_size);
+        free(text);
+    }
+    syntax_update(&state.syntax, state.text_buffer, state.used_size);
+    double load_ms = get_time_ms() - load_begin_ms;
+
+    if (scenario && scenario->build) scenario->build(&trace, &state, op_count);
+
+    Op_Latencies latencies[EDIT_OP_COUNT] = {0};
+    for (size_t i = 0; i < trace.count; i++) {
+        Op_Latencies *l = &latencies[trace.ops[i].kind];
+        if (!l->ns) l->ns = xmalloc(trace.count * sizeof(double));
+    }
+
+    // NOTE: The editor re-lexes before drawing every frame, so that is part of what a keystroke costs
+    double replay_begin_ms = get_time_ms();
+    for (size_t i = 0; i < trace.count; i++) {
+        uint64_t begin_ns = get_time_ns();
+        apply_edit_op(&state, trace.ops[i]);
+        syntax_update(&state.syntax, state.text_buffer, state.used_size);
+        uint64_t elapsed_ns = get_time_ns() - begin_ns;
+
+        Op_Latencies *l = &latencies[trace.ops[i].kind];
+        l->ns[l->count++] = (double)elapsed_ns;
+        l->buckets[latency_bucket(elapsed_ns)]++;
+    }
+    double replay_ms = get_time_ms() - replay_begin_ms;
+
+    Replay_Timing timings[REPLAY_MAX_TIMINGS];
+    size_t timing_count = scenario && scenario->measure ? scenario->measure(&state, timings) : 0;
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    size_t text_bytes = state.text_capacity;
+    size_t syntax_bytes = state.syntax.colors_cap + state.syntax.line_cap * sizeof(Syntax_Line);
+    size_t undo_bytes = state.undo.total_bytes;
+
+    printf("== %s: %zu ops on %.1f MB (load %.1f ms, replay %.1f ms)\n",
+           name, trace.count, state.used_size / (double)ONE_MB, load_ms, replay_ms);
+    printf("   peak RSS %.1f MB, reserved %.1f MB (text %.1f, syntax %.1f, undo %.1f), result hash %016llx\n",
+           usage.ru_maxrss / 1024.0, (text_bytes + syntax_bytes + undo_bytes) / (double)ONE_MB,
+           text_bytes / (double)ONE_MB, syntax_bytes / (double)ONE_MB, undo_bytes / (double)ONE_MB,
+           (unsigned long long)hash_bytes(state.text_buffer, state.used_size));
+    if (trace.count) printf("   %-10s %8s %10s %10s %10s %10s\n", "op", "count", "p50 us", "p90 us", "p99 us", "max us");
+    for (int kind = 0; kind < EDIT_OP_COUNT; kind++) {
+        Op_Latencies *l = &latencies[kind];
+        if (l->count == 0) continue;
+        sort_doubles(l->ns, l->count);
+        printf("   %-10s %8zu %10.2f %10.2f %10.2f %10.2f\n", edit_op_name(kind), l->count,
+               percentile(l->ns, l->count, 0.5) / 1000.0, percentile(l->ns, l->count, 0.9) / 1000.0,
+               percentile(l->ns, l->count, 0.99) / 1000.0, l->ns[l->count - 1] / 1000.0);
+    }
+    if (timing_count) printf("   %-12s %8s %10s %10s\n", "op", "count", "ms", "GB/s");
+    for (size_t i = 0; i < timing_count; i++) {
+        printf("   %-12s %8zu %10.2f %10.2f\n", timings[i].name, timings[i].count, timings[i].ms,
+               timings[i].bytes / (timings[i].ms * 1e6));
+    }
+    for (int kind = 0; kind < EDIT_OP_COUNT; kind++) {
+        if (latencies[kind].count < 2) continue;
+        printf("   %s latency:\n", edit_op_name(kind));
+        print_latencies(&latencies[kind]);
+    }
+    printf("\n");
+
+    for (int kind = 0; kind < EDIT_OP_COUNT; kind++) free(latencies[kind].ns);
+    free(trace.ops);
+    editor_free(&state);
+}
+
+static void format_duration(double ns, char *out, size_t out_size) {
+    if (ns < 1000.0)            snprintf(out, out_size, "%.0f ns", ns);
+    else if (ns < 1000000.0)    snprintf(out, out_size, "%.0f us", ns / 1000.0);
+    else if (ns < 1000000000.0) snprintf(out, out_size, "%.0f ms", ns / 1000000.0);
+    else                        snprintf(out, out_size, "%.0f s", ns / 1000000000.0);
+}
+
+// One row per power-of-two bucket between the fastest and slowest op
+void print_latencies(Op_Latencies *latencies) {
+    size_t first = LATENCY_BUCKET_COUNT, last = 0;
+    uint64_t peak = 0;
+    for (size_t i = 0; i < LATENCY_BUCKET_COUNT; i++) {
+        if (latencies->buckets[i] == 0) continue;
+        if (first == LATENCY_BUCKET_COUNT) first = i;
+        last = i;
+        if (latencies->buckets[i] > peak) peak = latencies->buckets[i];
+    }
+
+    for (size_t i = first; i <= last; i++) {
+        char low[32], high[32];
+        format_duration((double)(1ull << i), low, sizeof(low));
+        format_duration((double)(1ull << (i + 1)), high, sizeof(high));
+
+        char bar[HISTOGRAM_BAR_WIDTH + 1];
+        size_t bar_len = (size_t)((latencies->buckets[i] * HISTOGRAM_BAR_WIDTH + peak - 1) / peak);
+        memset(bar, '#', bar_len);
+        bar[bar_len] = '\0';
+
+        printf("     %7s - %-7s |%-*s %llu\n", low, high, HISTOGRAM_BAR_WIDTH, bar,
+               (unsigned long long)latencies->buckets[i]);
+    }
+}
@@ -0,0 +1,451 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profiler.h"
+#include "view.h"
+
+void view_init(Editor_View *view, Font *font, int width, int height, bool cell_grid, bool layers) {
+    memset(view, 0, sizeof(*view));
+    view->font = font;
+    view->use_layers = layers;
+
+    view->use_cell_grid = cell_grid && font_is_monospaced(font);
+    if (cell_grid && !view->use_cell_grid) {
+        trace_log("Font is not monospaced, drawing text as quads instead of a cell grid");
+    }
+
+    vec4 palette[SYNTAX_COLOR_COUNT] = {
+        [SYNTAX_DEFAULT] = {0.76f, 0.8f, 0.8f, 0.8f},
+        [SYNTAX_KEYWORD] = {0.86f, 0.62f, 0.42f, 0.9f},
+        [SYNTAX_TYPE]    = {0.52f, 0.72f, 0.86f, 0.9f},
+        [SYNTAX_NUMBER]  = {0.82f, 0.56f, 0.76f, 0.9f},
+        [SYNTAX_STRING]  = {0.6f, 0.78f, 0.5f, 0.9f},
+        [SYNTAX_COMMENT] = {0.5f, 0.5f, 0.46f, 0.8f},
+        [SYNTAX_PREPROC] = {0.74f, 0.6f, 0.86f, 0.9f},
+        [SYNTAX_PUNCT]   = {0.66f, 0.7f, 0.7f, 0.8f},
+    };
+    memcpy(view->palette, palette, sizeof(palette));
+
+    view_resize(view, width, height);
+}
+
+void view_free(Editor_View *view) {
+    cell_grid_free(&view->grid);
+    layer_free(&view->text_layer);
+    free(view->layer_contents.text);
+    free(view->layer_contents.colors);
+    memset(&view->layer_contents, 0, sizeof(view->layer_contents));
+}
+
+void view_resize(Editor_View *view, int width, int height) {
+    view->w = width;
+    view->h = height;
+    renderer_resize(width, height);
+    if (view->use_layers) layer_resize(&view->text_layer, width, height);
+}
+
+static void snapshot_reserve(Render_Snapshot *snapshot, size_t size) {
+    if (size <= snapshot->text_cap) return;
+    size_t new_cap = snapshot->text_cap ? snapshot->text_cap : 4096;
+    while (new_cap < size) new_cap *= 2;
+    snapshot->text = xrealloc(snapshot->text, new_cap);
+    snapshot->colors = xrealloc(snapshot->colors, new_cap);
+    snapshot->text_cap = new_cap;
+}
+
+// Copies the rows that fit in the window, breaking wrapped lines with extra newlines so both text paths draw them as is
+void view_build_snapshot(Render_Snapshot *snapshot, Text_Edit_State *state, Layout_Cache *layout) {
+    layout_update_scroll(layout, state);
+
+    Syntax_State *syntax = &state->syntax;
+    float zoom = state->zoom;
+    size_t max_rows = (size_t)(layout->height / zoom / layout->line_height) + 1;
+
+    // Lay out the visible lines first, matches are searched for in one go
+    size_t first_line = state->scroll_line;
+    size_t end_line = first_line;
+    for (size_t rows = 0; rows < max_rows + state->scroll_row && end_line < syntax->line_count; end_line++) {
+        rows += layout_line(layout, state, end_line)->row_count;
+    }
+    Line_Layout *first_layout = layout_line(layout, state, first_line);
+    size_t view_start = syntax_line_start(syntax, first_line) + first_layout->offsets[first_layout->row_starts[state->scroll_row]];
+    size_t view_end = end_line < syntax->line_count ? syntax_line_start(syntax, end_line) : state->used_size;
+
+    static Text_Range matches[MAX_VISIBLE_MATCHES];
+    size_t match_count = search_visible_matches(state, view_start, view_end, matches, MAX_VISIBLE_MATCHES);
+    if (state->search.mode == INPUT_MODE_EDIT && state->has_mark) {
+        size_t point = state->text_buffer_cursor;
+        size_t start = state->mark < point ? state->mark : point;
+        size_t end = state->mark < point ? point : state->mark;
+        if (start < view_start) start = view_start;
+        if (end > view_end) end = view_end;
+        if (start < end) matches[match_count++] = (Text_Range){ start, end };
+    }
+    size_t match_index = 0;
+
+    bool show_annotation = state->annotation[0] && state->annotation_version == state->edit_version;
+    snapshot->annotation_row = SIZE_MAX;
+
+    size_t cursor = state->text_buffer_cursor;
+    snapshot->cursor = SIZE_MAX;
+    snapshot->match_count = 0;
+    snapshot->overlay_count = 0;
+    snapshot->overlay_text_len = 0;
+    snapshot->palette_mask = 0;
+    snapshot->text_len = 0;
+    size_t row_total = 0;
+    for (size_t line_index = first_line; line_index < end_line; line_index++) {
+        Line_Layout *line = layout_line(layout, state, line_index);
+        size_t line_start = syntax_line_start(syntax, line_index);
+        size_t line_end = line_index + 1 < syntax->line_count ? syntax_line_start(syntax, line_index + 1) : state->used_size;
+        bool has_newline = line_end > line_start && state->text_buffer[line_end - 1] == '\n';
+
+        uint32_t first_row = line_index == first_line ? (uint32_t)state->scroll_row : 0;
+        for (uint32_t row = first_row; row < line->row_count && row_total < max_rows; row++, row_total++) {
+            bool last_row = row + 1 == line->row_count;
+            size_t row_start = line_start + line->offsets[line->row_starts[row]];
+            size_t row_end = line_start + line->offsets[layout_row_visible_end(layout, line, row)];
+
+            size_t dest = snapshot->text_len;
+            size_t copy_len = row_end - row_start;
+            snapshot_reserve(snapshot, dest + copy_len + 2);
+            memcpy(snapshot->text + dest, state->text_buffer + row_start, copy_len);
+            syntax_copy_colors(syntax, row_start, copy_len, snapshot->colors + dest);
+            snapshot->text_len += copy_len;
+            if (!last_row || has_newline) {
+                snapshot->text[snapshot->text_len] = '\n';
+                snapshot->colors[snapshot->text_len] = SYNTAX_DEFAULT;
+                snapshot->text_len++;
+            }
+
+            // A cursor on a row break shows at the start of the next row, one past the visible part shows where it is cut
+            if (cursor >= row_start && cursor < row_end) {
+                snapshot->cursor = dest + (cursor - row_start);
+            } else if (last_row && cursor >= row_end && cursor < line_end) {
+                snapshot->cursor = dest + copy_len;
+            }
+
+            size_t next_row_start = last_row ? line_end : line_start + line->offsets[line->row_starts[row + 1]];
+            size_t pos = state->annotation_pos;
+            if (show_annotation && pos >= row_start && (pos < next_row_start || (last_row && pos == line_end))) {
+                snapshot->annotation_row = row_total;
+                snapshot->annotation_x = line->x[layout_row_visible_end(layout, line, row)] - line->x[line->row_starts[row]];
+            }
+            while (match_index < match_count && matches[match_index].start < next_row_start) {
+                Text_Range match = matches[match_index];
+                if (match.start < row_end && match.end > row_start && snapshot->match_count < MAX_VISIBLE_MATCHES) {
+                    size_t start = match.start > row_start ? match.start : row_start;
+                    size_t end = match.end < row_end ? match.end : row_end;
+                    snapshot->matches[snapshot->match_count++] = (Text_Range){ dest + (start - row_start), dest + (end - row_start) };
+                }
+                if (match.end > next_row_start) break; // Continues on the next row
+                match_index++;
+            }
+        }
+    }
+    if (cursor == state->used_size && view_end == state->used_size) {
+        snapshot->cursor = snapshot->text_len;
+    }
+
+    snapshot_reserve(snapshot, snapshot->text_len + 1);
+    snapshot->text[snapshot->text_len] = '\0';
+    snapshot->colors[snapshot->text_len] = SYNTAX_DEFAULT;
+    snapshot->zoom = zoom;
+    snapshot->search = state->search;
+    snapshot->save_count = state->save_count;
+    memcpy(snapshot->annotation, state->annotation, sizeof(snapshot->annotation));
+}
+
+void render_snapshot_free(Render_Snapshot *snapshot) {
+    free(snapshot->text);
+    free(snapshot->colors);
+    free(snapshot->overlay);
+    free(snapshot->overlay_text);
+    memset(snapshot, 0, sizeof(*snapshot));
+}
+
+static Overlay_Item *snapshot_overlay_push(Render_Snapshot *snapshot) {
+    if (snapshot->overlay_count == snapshot->overlay_cap) {
+        snapshot->overlay_cap = snapshot->overlay_cap ? snapshot->overlay_cap * 2 : 64;
+        snapshot->overlay = xrealloc(snapshot->overlay, snapshot->overlay_cap * sizeof(Overlay_Item));
+    }
+    return &snapshot->overlay[snapshot->overlay_count++];
+}
+
+void snapshot_overlay_quad(Render_Snapshot *snapshot, Rect rect, vec4 color) {
+    Overlay_Item *item = snapshot_overlay_push(snapshot);
+    item->rect = rect;
+    glm_vec4_copy(color, item->color);
+    item->text = -1;
+}
+
+void snapshot_overlay_text(Render_Snapshot *snapshot, vec2 pos, const char *text, vec4 color) {
+    size_t len = strlen(text) + 1;
+    if (snapshot->overlay_text_len + len > INT32_MAX) return;
+    if (snapshot->overlay_text_len + len > snapshot->overlay_text_cap) {
+        size_t new_cap = snapshot->overlay_text_cap ? snapshot->overlay_text_cap : 1024;
+        while (new_cap < snapshot->overlay_text_len + len) new_cap *= 2;
+        snapshot->overlay_text = xrealloc(snapshot->overlay_text, new_cap);
+        snapshot->overlay_text_cap = new_cap;
+    }
+    Overlay_Item *item = snapshot_overlay_push(snapshot);
+    item->rect = (Rect){ pos[0], pos[1], 0.0f, 0.0f };
+    glm_vec4_copy(color, item->color);
+    item->text = (int32_t)snapshot->overlay_text_len;
+    memcpy(snapshot->overlay_text + snapshot->overlay_text_len, text, len);
+    snapshot->overlay_text_len += len;
+}
+
+static void draw_background(Editor_View *view) {
+    if (view->background.id != 0) {
+        float bg_scale = 0.7f;
+        vec2 bg_pos = {
+            view->w * 0.5f - view->background.w * bg_scale * 0.5f,
+            view->h * 0.5f - view->background.h * bg_scale * 0.5f
+        };
+        draw_texture_scaled_tinted(bg_pos, view->background, bg_scale, (vec4){0.22f, 0.2f, 0.2f, 0.5f});
+    }
+}
+
+// Text rows with their baseline in [min_y, max_y], in zoomed units. The grid path always draws all of them.
+static void draw_text(Editor_View *view, const Render_Snapshot *snapshot, vec4 *palette, size_t cursor, float min_y, float max_y) {
+    Font *font = view->font;
+    float zoom = snapshot->zoom;
+    float line_height = font->points_height;
+    vec4 highlight_color = {0.5f, 0.42f, 0.2f, 0.6f};
+    vec2 text_pos = {TEXT_MARGIN_LEFT / zoom, TEXT_MARGIN_TOP / zoom};
+    set_view_zoom(zoom);
+    bool drew_grid = view->use_cell_grid &&
+                     draw_string_grid(&view->grid,
+                                      snapshot->text,
+                                      snapshot->colors,
+                                      palette, SYNTAX_COLOR_COUNT,
+                                      cursor,
+                                      snapshot->matches, snapshot->match_count, highlight_color,
+                                      text_pos,
+                                      view->h / zoom + line_height,
+                                      font,
+                                      line_height);
+    if (!drew_grid) {
+        draw_string_with_cursor(snapshot->text,
+                                snapshot->colors,
+                                palette,
+                                cursor,
+                                snapshot->matches, snapshot->match_count, highlight_color,
+                                text_pos,
+                                min_y,
+                                max_y,
+                                font,
+                                line_height);
+    }
+    if (snapshot->annotation_row != SIZE_MAX) {
+        vec2 annotation_pos = {
+            text_pos[0] + snapshot->annotation_x + font_glyph_advance(font, ' ') * 2.0f,
+            text_pos[1] + snapshot->annotation_row * line_height
+        };
+        draw_string(snapshot->annotation, annotation_pos, (vec4){0.55f, 0.75f, 0.6f, 0.75f}, font, line_height);
+    }
+    set_view_zoom(1.0f);
+}
+
+static size_t count_newlines(const char *text, size_t start, size_t end) {
+    size_t count = 0;
+    for (size_t i = start; i < end; i++) count += text[i] == '\n';
+    return count;
+}
+
+// Rows [first, last] of the new text whose bytes or colors differ from the old text, last is SIZE_MAX when
+// the rows below moved. Typing on a row damages just that row, the common prefix and suffix match.
+static bool changed_rows(const Text_Layer_Contents *old, const Render_Snapshot *snapshot, size_t *first_row, size_t *last_row) {
+    size_t old_len = old->text_len, new_len = snapshot->text_len;
+    size_t min_len = old_len < new_len ? old_len : new_len;
+    size_t prefix = 0;
+    while (prefix < min_len && old->text[prefix] == snapshot->text[prefix] && old->colors[prefix] == snapshot->colors[prefix]) prefix++;
+    if (prefix == old_len && prefix == new_len) return false;
+
+    size_t suffix = 0;
+    while (suffix < min_len - prefix &&
+           old->text[old_len - 1 - suffix] == snapshot->text[new_len - 1 - suffix] &&
+           old->colors[old_len - 1 - suffix] == snapshot->colors[new_len - 1 - suffix]) {
+        suffix++;
+    }
+
+    *first_row = count_newlines(snapshot->text, 0, prefix);
+    size_t new_rows = count_newlines(snapshot->text, prefix, new_len - suffix);
+    size_t old_rows = count_newlines(old->text, prefix, old_len - suffix);
+    *last_row = new_rows == old_rows ? *first_row + new_rows : SIZE_MAX;
+    return true;
+}
+
+static void add_row(size_t row, bool *damaged, size_t *first_row, size_t *last_row) {
+    if (row == SIZE_MAX) return;
+    if (!*damaged || row < *first_row) *first_row = row;
+    if (!*damaged || (*last_row != SIZE_MAX && row > *last_row)) *last_row = row;
+    *damaged = true;
+}
+
+// What changed since the last frame drawn from layer_contents, in window pixels
+static bool text_layer_damage(Editor_View *view, const Render_Snapshot *snapshot, vec4 *palette, Rect *damage) {
+    const Text_Layer_Contents *contents = &view->layer_contents;
+    if (!contents->text ||
+        contents->zoom != snapshot->zoom ||
+        contents->background_id != view->background.id ||
+        memcmp(contents->palette, palette, sizeof(contents->palette)) != 0 ||
+        contents->match_count != snapshot->match_count ||
+        memcmp(contents->matches, snapshot->matches, snapshot->match_count * sizeof(Text_Range)) != 0) {
+        *damage = (Rect){0.0f, 0.0f, (float)view->w, (float)view->h};
+        return true;
+    }
+
+    size_t first_row = 0, last_row = 0;
+    bool damaged = changed_rows(contents, snapshot, &first_row, &last_row);
+    if (contents->annotation_row != snapshot->annotation_row ||
+        contents->annotation_x != snapshot->annotation_x ||
+        strcmp(contents->annotation, snapshot->annotation) != 0) {
+        add_row(contents->annotation_row, &damaged, &first_row, &last_row);
+        add_row(snapshot->annotation_row, &damaged, &first_row, &last_row);
+    }
+    if (!damaged) return false;
+
+    // NOTE: Half a row of margin on both sides covers ascenders and descenders reaching into the neighbours
+    float zoom = snapshot->zoom;
+    float line_height = view->font->points_height;
+    float text_y = TEXT_MARGIN_TOP / zoom;
+    float top = (text_y + (first_row - 1.5f) * line_height) * zoom;
+    float bottom = last_row == SIZE_MAX ? (float)view->h : (text_y + (last_row + 0.5f) * line_height) * zoom;
+    if (top < 0.0f) top = 0.0f;
+    if (bottom > view->h) bottom = (float)view->h;
+    *damage = (Rect){0.0f, top, (float)view->w, bottom - top};
+    return bottom > top;
+}
+
+static void remember_layer_contents(Editor_View *view, const Render_Snapshot *snapshot, vec4 *palette) {
+    Text_Layer_Contents *contents = &view->layer_contents;
+    if (snapshot->text_len + 1 > contents->text_cap) {
+        contents->text_cap = snapshot->text_cap;
+        contents->text = xrealloc(contents->text, contents->text_cap);
+        contents->colors = xrealloc(contents->colors, contents->text_cap);
+    }
+    memcpy(contents->text, snapshot->text, snapshot->text_len + 1);
+    memcpy(contents->colors, snapshot->colors, snapshot->text_len + 1);
+    contents->text_len = snapshot->text_len;
+    memcpy(contents->matches, snapshot->matches, snapshot->match_count * sizeof(Text_Range));
+    contents->match_count = snapshot->match_count;
+    memcpy(contents->annotation, snapshot->annotation, sizeof(contents->annotation));
+    contents->annotation_row = snapshot->annotation_row;
+    contents->annotation_x = snapshot->annotation_x;
+    contents->zoom = snapshot->zoom;
+    memcpy(contents->palette, palette, sizeof(contents->palette));
+    contents->background_id = view->background.id;
+}
+
+void draw_editor_frame(Editor_View *view, const Render_Snapshot *snapshot) {
+    Font *font = view->font;
+
+    vec4 palette[SYNTAX_COLOR_COUNT];
+    memcpy(palette, view->palette, sizeof(palette));
+    for (int i = 0; i < SYNTAX_COLOR_COUNT; i++) {
+        if (snapshot->palette_mask & (1u << i)) memcpy(palette[i], snapshot->palette[i], sizeof(vec4));
+    }
+    size_t cursor = cursor_blink_visible(snapshot->cursor) ? snapshot->cursor : SIZE_MAX;
+    float zoom = snapshot->zoom;
+    float line_height = font->points_height;
+
+    // NOTE: A frame that changes nearly everything, like a scroll, gains nothing from the layer, it would only add
+    //       the composite. Those draw straight to the window and the layer is rebuilt once the text holds still.
+    Rect damage = {0.0f, 0.0f, (float)view->w, (float)view->h};
+    bool damaged = true;
+    bool direct = !view->use_layers;
+    if (view->use_layers) {
+        damaged = text_layer_damage(view, snapshot, palette, &damage);
+        bool full = damaged && damage.h >= view->h * 0.75f;
+        if (full) {
+            direct = true;
+        } else if (!view->text_layer.valid) {
+            damage = (Rect){0.0f, 0.0f, (float)view->w, (float)view->h};
+            damaged = true;
+        }
+    }
+
+    if (direct) {
+        profile_begin(PROFILE_ZONE_BACKGROUND);
+        renderer_begin_frame();
+        draw_background(view);
+        profile_end(PROFILE_ZONE_BACKGROUND);
+
+        profile_begin(PROFILE_ZONE_TEXT);
+        draw_text(view, snapshot, palette, cursor, 0.0f, view->h / zoom + line_height);
+        if (view->use_layers) {
+            remember_layer_contents(view, snapshot, palette);
+            view->text_layer.valid = false;
+        }
+        profile_end(PROFILE_ZONE_TEXT);
+    } else {
+        // NOTE: The composite covers every pixel, so there is no clear. A frame where only the cursor
+        //       blinked or moved costs the composite quad and the cursor's quads.
+        if (damaged) {
+            profile_begin(PROFILE_ZONE_BACKGROUND);
+            layer_begin(&view->text_layer, damage);
+            draw_background(view);
+            profile_end(PROFILE_ZONE_BACKGROUND);
+
+            profile_begin(PROFILE_ZONE_TEXT);
+            draw_text(view, snapshot, palette, SIZE_MAX, damage.y / zoom - 0.5f * line_height, (damage.y + damage.h) / zoom);
+            layer_end();
+            remember_layer_contents(view, snapshot, palette);
+            view->text_layer.valid = true;
+            profile_end(PROFILE_ZONE_TEXT);
+        }
+
+        profile_begin(PROFILE_ZONE_COMPOSITE);
+        draw_layer(&view->text_layer);
+        set_view_zoom(zoom);
+        draw_text_cursor(snapshot->text, palette, cursor, (vec2){TEXT_MARGIN_LEFT / zoom, TEXT_MARGIN_TOP / zoom}, font, line_height);
+        set_view_zoom(1.0f);
+        profile_end(PROFILE_ZONE_COMPOSITE);
+    }
+
+    profile_begin(PROFILE_ZONE_UI);
+    for (size_t i = 0; i < snapshot->overlay_count; i++) {
+        const Overlay_Item *item = &snapshot->overlay[i];
+        vec4 color;
+        memcpy(color, item->color, sizeof(color));
+        if (item->text < 0) {
+            draw_quad(item->rect, color);
+        } else {
+            draw_string(snapshot->overlay_text + item->text, (vec2){item->rect.x, item->rect.y}, color, font, font->points_height);
+        }
+    }
+
+    if (snapshot->search.mode != INPUT_MODE_EDIT) {
+        draw_search_bar(view, &snapshot->search);
+    }
+
+    if (snapshot->save_count != view->seen_save_count) {
+        view->seen_save_count = snapshot->save_count;
+        view->notify_frames = 30;
+    }
+    if (view->notify_frames > 0) {
+        view->notify_frames--;
+        float dim = 50.0f;
+        draw_quad((Rect){view->w - dim, view->h - dim, dim, dim}, (vec4){0.6f, 0.55f, 0.55f, 0.6f});
+    }
+    profile_end(PROFILE_ZONE_UI);
+}
+
+void draw_search_bar(Editor_View *view, const Search_State *search) {
+    Font *font = view->font;
+    float bar_h = font->points_height * 1.5f;
+    float bar_y = view->h - bar_h;
+    draw_quad((Rect){0.0f, bar_y, (float)view->w, bar_h}, (vec4){0.14f, 0.12f, 0.12f, 0.95f});
+
+    char line[SEARCH_MAX_QUERY * 2 + 64];
+    if (search->mode == INPUT_MODE_REPLACE) {
+        snprintf(line, sizeof(line), "Replace \"%s\" with: %s", search->query, search->replacement);
+    } else {
+        snprintf(line, sizeof(line), "Find: %s%s", search->query,
+                 (search->query_len && !search->has_match) ? "  (no match)" : "");
+    }
+    draw_string(line, (vec2){20.0f, bar_y + font->points_height}, (vec4){0.76f, 0.8f, 0.8f, 0.9f}, font, font->points_height);
+}
@@ -0,0 +1,91 @@
+#ifndef VIEW_H
+#define VIEW_H
+
+#include "editor.h"
+#include "layout.h"
+#include "renderer.h"
+
+enum { MAX_VISIBLE_MATCHES = 256 };
+
+// Drawn over the text in window pixels, these come from extension draw hooks
+typedef struct Overlay_Item {
+    Rect rect;    // Text is drawn with its baseline at rect.y
+    vec4 color;
+    int32_t text; // Into overlay_text, -1 for a quad
+} Overlay_Item;
+
+// Everything a frame draws, copied out of the editor state so drawing never reads the live buffer.
+// Only the rows that fit in the window are copied, so building one costs about a screenful.
+typedef struct Render_Snapshot {
+    char *text;      // Null terminated
+    uint8_t *colors; // One color class per byte of text
+    size_t text_len;
+    size_t text_cap;
+    size_t cursor;   // Into text, SIZE_MAX when the cursor is off screen
+    Text_Range matches[MAX_VISIBLE_MATCHES]; // Into text, the selection outside of search
+    size_t match_count;
+    char annotation[ANNOTATION_MAX];
+    size_t annotation_row; // SIZE_MAX when there is none on screen
+    float annotation_x;    // End of that row, in zoomed units from the text origin
+    float zoom;
+    Search_State search;
+    uint32_t save_count;
+    uint64_t applied_commands; // Commands from the render thread this reflects, see editor_thread_push
+
+    Overlay_Item *overlay;
+    size_t overlay_count;
+    size_t overlay_cap;
+    char *overlay_text;
+    size_t overlay_text_len;
+    size_t overlay_text_cap;
+    uint32_t palette_mask; // Bit per color class in palette that replaces the view's
+    vec4 palette[SYNTAX_COLOR_COUNT];
+} Render_Snapshot;
+
+// What the text layer was last drawn from, compared against each new snapshot to find the damage
+typedef struct Text_Layer_Contents {
+    char *text;
+    uint8_t *colors;
+    size_t text_len;
+    size_t text_cap;
+    Text_Range matches[MAX_VISIBLE_MATCHES];
+    size_t match_count;
+    char annotation[ANNOTATION_MAX];
+    size_t annotation_row;
+    float annotation_x;
+    float zoom;
+    vec4 palette[SYNTAX_COLOR_COUNT];
+    uint32_t background_id;
+} Text_Layer_Contents;
+
+// Everything besides the editor state needed to draw it into the current framebuffer
+typedef struct Editor_View {
+    Font *font;
+    Texture background; // Skipped while the id is 0
+    vec4 palette[SYNTAX_COLOR_COUNT];
+    int w, h;
+
+    bool use_cell_grid; // Only honored for monospaced fonts
+    Cell_Grid grid;
+
+    // Background and text are cached in text_layer and only redrawn where the snapshot changed.
+    // The cursor and the UI go on top of it every frame.
+    bool use_layers;
+    Render_Layer text_layer;
+    Text_Layer_Contents layer_contents;
+
+    uint32_t seen_save_count;
+    int notify_frames;
+} Editor_View;
+
+void view_init(Editor_View *view, Font *font, int width, int height, bool cell_grid, bool layers);
+void view_free(Editor_View *view);
+void view_resize(Editor_View *view, int width, int height);
+void view_build_snapshot(Render_Snapshot *snapshot, Text_Edit_State *state, Layout_Cache *layout);
+void render_snapshot_free(Render_Snapshot *snapshot);
+void snapshot_overlay_quad(Render_Snapshot *snapshot, Rect rect, vec4 color);
+void snapshot_overlay_text(Render_Snapshot *snapshot, vec2 pos, const char *text, vec4 color);
+void draw_editor_frame(Editor_View *view, const Render_Snapshot *snapshot);
+void draw_search_bar(Editor_View *view, const Search_State *search);
+
+#endif